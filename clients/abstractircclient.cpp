@@ -18,8 +18,19 @@
 
 #include "clients/abstractircclient.h"
 
+// Channel prefixes of RFC 2811, until the server tells its own
+#define IRC_DEFAULT_CHANTYPES "#&!+"
+
 AbstractIrcClient::AbstractIrcClient(QObject *parent, ServerSettings *serverSettings) :
-    QObject(parent)
+    QObject(parent),
+    _linesReceived(0),
+    _bytesReceived(0),
+    _channelTypes(IRC_DEFAULT_CHANTYPES)
 {
     Q_UNUSED(serverSettings)
 }
+
+void AbstractIrcClient::resetChannelTypes()
+{
+    _channelTypes = IRC_DEFAULT_CHANTYPES;
+}
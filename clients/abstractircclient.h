@@ -20,11 +20,23 @@
 #define ABSTRACTIRCCLIENT_H
 
 #include <QtCore/QObject>
+#include <QtCore/QList>
 #include <QtNetwork/QAbstractSocket>
 
 #include "helpers/util.h"
 
 class ServerSettings;
+class SendQueue;
+class LagMeter;
+
+// A message played back from the history of a channel, eg. by a bouncer
+struct IrcHistoryLine
+{
+    // Milliseconds since the epoch, when the server received the message
+    qint64 time;
+    QString userName, hostmask, message;
+    bool isAction;
+};
 
 // This class abstracts away the actual IRC client implementations from
 // the model layer of the application. It contains code that is common
@@ -35,8 +47,24 @@ class AbstractIrcClient : public QObject
 {
     Q_OBJECT
 
+protected:
+    // Implementations SHOULD count the lines and bytes received from the server
+    quint64 _linesReceived, _bytesReceived;
+    // Implementations SHOULD set this to nick!user@host of the sender before emitting the signals of a message
+    QString _senderHostmask;
+    // The prefixes of the channel names, implementations SHOULD set this from CHANTYPES when the server tells it
+    QString _channelTypes;
+
+    // Forgets the CHANTYPES of the last connection
+    void resetChannelTypes();
+
 public:
     explicit AbstractIrcClient(QObject *parent, ServerSettings *serverSettings);
+    quint64 linesReceived() const { return _linesReceived; }
+    quint64 bytesReceived() const { return _bytesReceived; }
+    const QString &senderHostmask() const { return _senderHostmask; }
+    // Whether the name is of a channel on this server, otherwise it's of a user
+    bool isChannelName(const QString &name) const { return name.length() && _channelTypes.contains(name.at(0)); }
     
 signals:
     // Implementations of this class SHOULD emit these signals when appropriate.
@@ -55,6 +83,8 @@ signals:
     void receiveTopic(const QString &channelName, const QString &topic);
     void receiveKick(const QString &channelName, const QString &userName, const QString &kickedUserName, const QString &message);
     void receiveModeChange(const QString &channelName, const QString &mode, const QString &arguments);
+    // A whole batch of playback at once, in the order the messages were sent
+    void receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines);
 
     // Messages corresponding to the server itself.
     void receiveQuit(const QString &userName, const QString &message);
@@ -62,6 +92,7 @@ signals:
     void receiveMotd(const QString &motd);
     void receiveError(const QString &error);
     void joinedChannel(const QString &channelName);
+    void joinedChannels(const QStringList &channelNames);
     void queriedUser(const QString &channelName);
     void partedChannel(const QString &channelName);
     void closedUser(const QString &channelName);
@@ -75,6 +106,8 @@ public:
 
     virtual void quit(const QString &message) = 0;
     virtual void joinChannel(const QString &channelName, const QString &channelKey) = 0;
+    // Joins many channels at once, the keys correspond to the channel names at the same index
+    virtual void joinChannels(const QStringList &channelNames, const QStringList &channelKeys) = 0;
     virtual void partChannel(const QString &channelName, const QString &reason) = 0;
     virtual void queryUser(const QString &userName) = 0;
     virtual void closeUser(const QString &userName) = 0;
@@ -90,6 +123,10 @@ public:
     virtual void sendWhois(const QString userName) = 0;
 
     virtual QAbstractSocket *socket() = 0;
+    virtual SendQueue *sendQueue() = 0;
+    virtual LagMeter *lagMeter() = 0;
+    // Milliseconds from opening the connection until the server accepted the registration, -1 while not registered
+    virtual int registrationTime() = 0;
 
 };
 
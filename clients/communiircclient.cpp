@@ -16,8 +16,14 @@
 //
 // Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
 
-#include <QtCore/QTimer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
 #include <QtNetwork/QSslSocket>
+#include <QtNetwork/QSslConfiguration>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
 
 #include <Communi/IrcCore/irc.h>
 //#include <Communi/IrcSession>
@@ -28,13 +34,49 @@
 #include <Communi/IrcCore/irccommand.h>
 
 #include "clients/communiircclient.h"
+#include "clients/reconnectengine.h"
+#include "clients/lagmeter.h"
+#include "clients/connectionracer.h"
+#include "clients/trafficcapture.h"
+#include "helpers/tracer.h"
 #include "model/settings/serversettings.h"
 
-#define FIX_EMPTY_CHANNEL_NAME(channelName) channelName.length() > 0 ? channelName : _ircSession->host()
+#define FIX_EMPTY_CHANNEL_NAME(channelName) channelName.length() > 0 ? channelName : _serverSettings->serverUrl()
+
+// Maximum length of a line sent to the server, without the trailing CR-LF
+#define IRC_MAX_LINE_LENGTH 510
+// Nick length guaranteed by RFC 2812, longer nicks may get truncated by the server
+#define IRC_MIN_NICK_LENGTH 9
+// IRCv3 capabilities requested when the server has them
+#define IRC_WANTED_CAPABILITIES "batch" << "server-time"
+// Communi parses the IRCv3 message tags since 3.1. Older versions (1.x has no IRC_VERSION) would
+// take the tags of a line for its command, and every message of the connection would be Unknown.
+#if defined(IRC_VERSION) && IRC_VERSION >= 0x030100
+#define IRC_HAS_MESSAGE_TAGS
+#endif
+// The numeric which tells what the server supports, like CHANTYPES
+#define IRC_RPL_ISUPPORT 5
 
 CommuniIrcClient::CommuniIrcClient(QObject *parent, ServerSettings *serverSettings) :
-    AbstractIrcClient(parent, serverSettings)
+    AbstractIrcClient(parent, serverSettings),
+    _serverSettings(serverSettings),
+    _sendQueue(new SendQueue(this)),
+    _reconnectEngine(new ReconnectEngine(this)),
+    _lagMeter(new LagMeter(this)),
+    _connectionRacer(new ConnectionRacer(this)),
+    _lastSocketError(QAbstractSocket::UnknownSocketError),
+    _preferredNick(serverSettings->userNickname()),
+    _alternativeNicks(alternativeNicks(serverSettings->userNickname())),
+    _alternativeNickIndex(0),
+    _isRegistered(false),
+    _socketConnectedAt(-1),
+    _encryptedAt(-1),
+    _registrationTime(-1),
+    _captureId(TrafficCapture::instance()->registerServer(serverSettings->serverUrl()))
 {
+    _sendQueue->setFloodControlForHost(serverSettings->serverUrl());
+    connect(_sendQueue, SIGNAL(flush(QByteArray)), this, SLOT(writeToSocket(QByteArray)));
+
     _ircSession = new IrcSession(this);
     _ircSession->setNickName(serverSettings->userNickname());
     _ircSession->setHost(serverSettings->serverUrl());
@@ -50,44 +92,529 @@ CommuniIrcClient::CommuniIrcClient(QObject *parent, ServerSettings *serverSettin
         _ircSession->setRealName(serverSettings->userNickname());
 
     _ircSession->setPort(serverSettings->serverPort());
+    _defaultEncoding = _encoding = _ircSession->encoding();
+    // Outgoing lines always use the encoding of the session, not the detected one
+    _sendQueue->setEncoding(_defaultEncoding);
+
+    // Our own sockets replace the default one of Communi, so that traffic can be captured
+    QAbstractSocket *socket;
 
     if (serverSettings->serverSSL())
     {
         // When SSL is enabled, create an SSL socket
-        QSslSocket *socket = new QSslSocket(_ircSession);
-        // Don't care about the identity of the server
-        socket->ignoreSslErrors();
-        socket->setPeerVerifyMode(QSslSocket::QueryPeer);
+        QSslSocket *sslSocket = new TrafficCaptureSocket<QSslSocket>(_captureId, _ircSession);
+        socket = sslSocket;
         // Ask it to start encrypting when it's connected - since Qt 5, doesn't work without this
-        connect(socket, SIGNAL(connected()), socket, SLOT(startClientEncryption()));
-        // Set the socket of the IRC session to the new socket
-        _ircSession->setSocket(socket);
+        connect(sslSocket, SIGNAL(connected()), sslSocket, SLOT(startClientEncryption()));
+        connect(sslSocket, SIGNAL(encrypted()), this, SLOT(socketEncrypted()));
+        connect(sslSocket, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrors(QList<QSslError>)));
+#if QT_VERSION >= 0x050F00
+        // With TLS 1.3 the session ticket arrives after the handshake
+        connect(sslSocket, SIGNAL(newSessionTicketReceived()), this, SLOT(storeSslSession()));
+#endif
+    }
+    else
+    {
+        socket = new TrafficCaptureSocket<QTcpSocket>(_captureId, _ircSession);
     }
 
+    // Connected before Communi's own slot, which reads everything that arrived
+    connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+    // The capabilities are negotiated before Communi registers, so that the playback of a bouncer has them
+    connect(socket, SIGNAL(connected()), this, SLOT(requestCapabilities()));
+    // Set the socket of the IRC session to the new socket
+    _ircSession->setSocket(socket);
+
+    // Communi writes PASS, NICK and USER when the socket connects, they leave in one segment
+    connect(_ircSession->socket(), SIGNAL(connected()), this, SLOT(socketConnected()));
+
     connect(_ircSession, SIGNAL(password(QString*)), serverSettings, SLOT(backendAsksForPassword(QString*)));
+    connect(_ircSession, SIGNAL(connected()), this, SLOT(registered()));
+    connect(_ircSession, SIGNAL(disconnected()), this, SLOT(unregistered()));
     connect(_ircSession, SIGNAL(connected()), this, SIGNAL(connectedToServer()));
     connect(_ircSession, SIGNAL(disconnected()), this, SIGNAL(disconnectedFromServer()));
+    // Nothing that was queued can be sent anymore, autojoin runs again after reconnecting
+    connect(_ircSession, SIGNAL(disconnected()), _sendQueue, SLOT(clear()));
     connect(_ircSession, SIGNAL(messageReceived(IrcMessage*)), this, SLOT(messageReceived(IrcMessage*)));
     connect(_ircSession, SIGNAL(socketError(QAbstractSocket::SocketError)), this, SLOT(socketError(QAbstractSocket::SocketError)));
+
+    // Unless we asked for it, a lost connection is opened again
+    connect(_reconnectEngine, SIGNAL(reconnectRequested()), this, SLOT(openSession()));
+    connect(_ircSession, SIGNAL(connected()), _reconnectEngine, SLOT(reset()));
+    connect(_ircSession, SIGNAL(disconnected()), _reconnectEngine, SLOT(scheduleReconnect()));
+
+    // Probing the connection while it's registered
+    connect(_ircSession, SIGNAL(connected()), _lagMeter, SLOT(start()));
+    connect(_ircSession, SIGNAL(disconnected()), _lagMeter, SLOT(stop()));
+    connect(_lagMeter, SIGNAL(sendProbe(QString)), this, SLOT(sendLagProbe(QString)));
+    connect(_lagMeter, SIGNAL(connectionStale()), this, SLOT(connectionStale()));
+
+    // The address to connect to is chosen by racing the addresses of the host
+    connect(_connectionRacer, SIGNAL(connectTo(QString)), this, SLOT(openSessionTo(QString)));
+    connect(_connectionRacer, SIGNAL(probeWon(QTcpSocket*)), this, SLOT(takeOverConnection(QTcpSocket*)));
+    connect(_connectionRacer, SIGNAL(failed()), this, SLOT(connectionRaceFailed()));
+}
+
+void CommuniIrcClient::send(IrcCommand *command, SendQueue::Priority priority)
+{
+    _sendQueue->enqueue(command->toString(), priority);
+    delete command;
+}
+
+void CommuniIrcClient::socketReadyRead()
+{
+    QAbstractSocket *socket = _ircSession->socket();
+    QByteArray data = socket->peek(socket->bytesAvailable());
+    _bytesReceived += data.length();
+
+    if (TrafficCapture::isEnabled())
+        TrafficCapture::instance()->record(_captureId, TrafficCapture::InboundRecord, data);
+
+    _playbackTracker.addData(data);
+
+    // Communi decodes these lines right after this slot, the ones that are not UTF-8 with the encoding given here.
+    // When they need different legacy encodings, the encoding is left alone, see EncodingDetector.
+    QByteArray encoding = _encodingDetector.codecNameForData(data);
+    if (!encoding.isEmpty() && encoding != _encoding)
+    {
+        _encoding = encoding;
+        _ircSession->setEncoding(encoding);
+    }
+}
+
+void CommuniIrcClient::writeToSocket(const QByteArray &data)
+{
+    _ircSession->socket()->write(data);
+}
+
+void CommuniIrcClient::sendLagProbe(const QString &token)
+{
+    _sendQueue->enqueue("PING :" + token, SendQueue::Urgent);
+}
+
+void CommuniIrcClient::connectionStale()
+{
+    qDebug() << Q_FUNC_INFO << "connection to" << _serverSettings->serverUrl() << "is not responding, reconnecting";
+    _ircSession->socket()->abort();
+    _reconnectEngine->scheduleReconnect();
+}
+
+void CommuniIrcClient::openSession()
+{
+    // Every connection attempt starts over with the configured nick
+    _isRegistered = false;
+    _alternativeNickIndex = 0;
+    _socketConnectedAt = -1;
+    _encryptedAt = -1;
+    _registrationTime = -1;
+    resetChannelTypes();
+    if (_ircSession->nickName() != _preferredNick)
+        _ircSession->setNickName(_preferredNick);
+    applySslConfiguration();
+
+    _registrationClock.start();
+
+#if QT_VERSION < 0x050400
+    if (sslSocket())
+    {
+        // Without setPeerVerifyName() the certificate would be checked against the address
+        openSessionTo(_serverSettings->serverUrl());
+        return;
+    }
+#endif
+
+    _connectionRacer->race(_serverSettings->serverUrl(), _serverSettings->serverPort());
+}
+
+void CommuniIrcClient::openSessionTo(const QString &address)
+{
+    // A connection attempt to an address that lost the race is dropped
+    if (_ircSession->socket()->state() != QAbstractSocket::UnconnectedState)
+        _ircSession->socket()->abort();
+
+    _encodingDetector.reset();
+    _playbackTracker.reset();
+    _ircSession->setHost(address);
+    _ircSession->open();
+}
+
+void CommuniIrcClient::takeOverConnection(QTcpSocket *probe)
+{
+    QString address = probe->peerAddress().toString();
+
+#ifdef Q_OS_UNIX
+    // The session socket takes over the connection of the probe, instead of connecting again
+    int descriptor = ::dup(probe->socketDescriptor());
+    if (descriptor != -1)
+    {
+        QAbstractSocket *socket = _ircSession->socket();
+        if (socket->state() != QAbstractSocket::UnconnectedState)
+            socket->abort();
+        probe->abort();
+
+        _encodingDetector.reset();
+        _playbackTracker.reset();
+        _ircSession->setHost(address);
+
+        if (socket->setSocketDescriptor(descriptor, QAbstractSocket::ConnectedState))
+        {
+            // Everything that is done when the socket connects is done now: TLS, CAP, registration
+            QMetaObject::invokeMethod(socket, "connected");
+            return;
+        }
+
+        qWarning() << Q_FUNC_INFO << "could not take over the connection to" << address << socket->errorString();
+        ::close(descriptor);
+    }
+#endif
+
+    openSessionTo(address);
+}
+
+void CommuniIrcClient::connectionRaceFailed()
+{
+    emit this->socketErrorHappened(_lastSocketError);
+    _reconnectEngine->scheduleReconnect();
+}
+
+int CommuniIrcClient::tlsHandshakeTime() const
+{
+    return _encryptedAt >= 0 && _socketConnectedAt >= 0 ? (int) (_encryptedAt - _socketConnectedAt) : -1;
+}
+
+QSslSocket *CommuniIrcClient::sslSocket()
+{
+    return qobject_cast<QSslSocket*>(_ircSession->socket());
+}
+
+void CommuniIrcClient::applySslConfiguration()
+{
+    QSslSocket *socket = sslSocket();
+    if (!socket)
+        return;
+
+    // Certificates are checked in sslErrors() and socketEncrypted() according to the policy
+    socket->setPeerVerifyMode(_serverSettings->sslVerification() == ServerSettings::SslIgnoreErrors
+                              ? QSslSocket::QueryPeer
+                              : QSslSocket::VerifyPeer);
+
+#if QT_VERSION >= 0x050400
+    // The session is opened to an address, the certificate still belongs to the host
+    socket->setPeerVerifyName(_serverSettings->serverUrl());
+
+    // Offering the session of the previous connection saves a full handshake
+    QSslConfiguration configuration = socket->sslConfiguration();
+    configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    configuration.setSessionTicket(_serverSettings->sslSession());
+    socket->setSslConfiguration(configuration);
+#endif
+}
+
+QByteArray CommuniIrcClient::peerCertificateDigest()
+{
+#if QT_VERSION >= 0x050000
+    return sslSocket()->peerCertificate().digest(QCryptographicHash::Sha256).toHex();
+#else
+    return sslSocket()->peerCertificate().digest(QCryptographicHash::Sha1).toHex();
+#endif
+}
+
+void CommuniIrcClient::sslErrors(const QList<QSslError> &errors)
+{
+    QSslSocket *socket = sslSocket();
+    int verification = _serverSettings->sslVerification();
+
+    if (verification == ServerSettings::SslIgnoreErrors)
+    {
+        socket->ignoreSslErrors();
+    }
+    else if (verification == ServerSettings::SslPinCertificate
+             && (_serverSettings->sslPinnedDigest().isEmpty() || _serverSettings->sslPinnedDigest() == peerCertificateDigest()))
+    {
+        // The pinned certificate is trusted even if it is self-signed, socketEncrypted() pins a new one
+        socket->ignoreSslErrors();
+    }
+    else
+    {
+        QStringList messages;
+        foreach (const QSslError &error, errors)
+            messages.append(error.errorString());
+
+        qDebug() << Q_FUNC_INFO << "rejecting the certificate of" << _serverSettings->serverUrl() << messages;
+        emit receiveError("The certificate of the server is not trusted: " + messages.join(" "));
+    }
+}
+
+void CommuniIrcClient::storeSslSession()
+{
+#if QT_VERSION >= 0x050400
+    QByteArray session = sslSocket()->sslConfiguration().sessionTicket();
+    if (session.length())
+        _serverSettings->setSslSession(session);
+#endif
+}
+
+void CommuniIrcClient::socketConnected()
+{
+    _connectionRacer->primaryConnected();
+    _socketConnectedAt = _registrationClock.elapsed();
+    // Registration and the lines after it are small, don't let Nagle hold them back
+    _ircSession->socket()->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+}
+
+void CommuniIrcClient::socketEncrypted()
+{
+    _encryptedAt = _registrationClock.elapsed();
+    qDebug() << "tls handshake with" << _serverSettings->serverUrl() << "took" << _encryptedAt - _socketConnectedAt
+             << "ms, offered a previous session:" << !_serverSettings->sslSession().isEmpty();
+
+    if (_serverSettings->sslVerification() == ServerSettings::SslPinCertificate)
+    {
+        QByteArray digest = peerCertificateDigest();
+
+        if (_serverSettings->sslPinnedDigest().isEmpty())
+        {
+            qDebug() << "pinning the certificate of" << _serverSettings->serverUrl() << digest;
+            _serverSettings->setSslPinnedDigest(digest);
+            _serverSettings->save();
+        }
+        else if (_serverSettings->sslPinnedDigest() != digest)
+        {
+            // A certificate that is valid but different from the pinned one doesn't get through either
+            qDebug() << Q_FUNC_INFO << "the certificate of" << _serverSettings->serverUrl() << "changed, disconnecting";
+            emit receiveError("The certificate of the server is different from the pinned one.");
+            _ircSession->socket()->abort();
+            return;
+        }
+    }
+
+    storeSslSession();
+}
+
+void CommuniIrcClient::registered()
+{
+    _isRegistered = true;
+    _registrationTime = _registrationClock.isValid() ? (int)_registrationClock.elapsed() : -1;
+    qDebug() << "registered with" << _serverSettings->serverUrl() << "as" << _ircSession->nickName()
+             << "in" << _registrationTime << "ms, tcp connect:" << _socketConnectedAt
+             << "ms, tls handshake done:" << _encryptedAt << "ms, nick attempts:" << _alternativeNickIndex + 1;
+}
+
+void CommuniIrcClient::unregistered()
+{
+    _isRegistered = false;
+    _registrationTime = -1;
+
+    // What was played back before the connection broke is still history
+    foreach (const QByteArray &batch, _playback.keys())
+        flushPlayback(batch);
+}
+
+bool CommuniIrcClient::canNegotiateTags()
+{
+#ifdef IRC_HAS_MESSAGE_TAGS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CommuniIrcClient::requestCapabilities()
+{
+    _availableCapabilities.clear();
+    _capabilities.clear();
+
+    // The capabilities we want all bring tags, without them the server doesn't tag the lines
+    if (canNegotiateTags())
+        _sendQueue->enqueue("CAP LS 302", SendQueue::Urgent);
+}
+
+void CommuniIrcClient::processCapabilityMessage(IrcMessage *message)
+{
+    // CAP <nick> <subcommand> [*] :<capabilities>
+    QStringList parameters = message->parameters();
+    if (parameters.count() < 3)
+        return;
+
+    QString subCommand = parameters[1].toUpper();
+    QStringList capabilities = parameters.last().split(' ', QString::SkipEmptyParts);
+
+    if (subCommand == "LS")
+    {
+        // Values like sasl=PLAIN don't matter here
+        foreach (const QString &capability, capabilities)
+            _availableCapabilities.append(capability.section('=', 0, 0));
+
+        // More lines of the list are coming
+        if (parameters.count() > 3 && parameters[2] == "*")
+            return;
+
+        QStringList wanted;
+        foreach (const QString &capability, QStringList() << IRC_WANTED_CAPABILITIES)
+        {
+            if (_availableCapabilities.contains(capability))
+                wanted.append(capability);
+        }
+
+        if (wanted.count())
+            _sendQueue->enqueue("CAP REQ :" + wanted.join(" "), SendQueue::Urgent);
+        else if (!_isRegistered)
+            _sendQueue->enqueue("CAP END", SendQueue::Urgent);
+    }
+    else if (subCommand == "ACK" || subCommand == "NAK")
+    {
+        if (subCommand == "ACK")
+            _capabilities += capabilities;
+
+        qDebug() << "capabilities of" << _serverSettings->serverUrl() << "are" << _capabilities;
+        if (!_isRegistered)
+            _sendQueue->enqueue("CAP END", SendQueue::Urgent);
+    }
+}
+
+QString CommuniIrcClient::conversationOf(const QString &target, const QString &sender)
+{
+    // What we sent ourselves, played back or echoed, belongs to where it was sent
+    if (isChannelName(target) || !sender.compare(currentNick(), Qt::CaseInsensitive))
+        return target;
+
+    return sender;
+}
+
+bool CommuniIrcClient::collectPlayback(IrcMessage *message, const PlaybackTracker::LineTags &tags)
+{
+    IrcHistoryLine line;
+    QString channelName;
+
+    if (message->type() == IrcMessage::Private)
+    {
+        IrcPrivateMessage *msg = static_cast<IrcPrivateMessage*>(message);
+        // Old CTCP requests are not answered
+        if (msg->isRequest())
+            return true;
+
+        channelName = conversationOf(msg->target(), msg->sender().name());
+        line.message = msg->message();
+        line.isAction = msg->isAction();
+    }
+    else if (message->type() == IrcMessage::Notice)
+    {
+        IrcNoticeMessage *msg = static_cast<IrcNoticeMessage*>(message);
+        if (msg->isReply())
+            return true;
+
+        channelName = conversationOf(msg->target(), msg->sender().name());
+        line.message = msg->message();
+        line.isAction = false;
+    }
+    else
+    {
+        // Anything else of the playback takes the live path
+        return false;
+    }
+
+    line.time = tags.time >= 0 ? tags.time : QDateTime::currentMSecsSinceEpoch();
+    line.userName = message->sender().name();
+    line.hostmask = message->sender().prefix();
+    _playback[tags.batch][FIX_EMPTY_CHANNEL_NAME(channelName)].append(line);
+    return true;
+}
+
+void CommuniIrcClient::flushPlayback(const QByteArray &batch)
+{
+    TRACE_FUNCTION();
+    QMap<QString, QList<IrcHistoryLine> > channels = _playback.take(batch);
+
+    for (QMap<QString, QList<IrcHistoryLine> >::const_iterator i = channels.constBegin(); i != channels.constEnd(); ++i)
+        emit receiveHistory(i.key(), i.value());
+}
+
+QStringList CommuniIrcClient::alternativeNicks(const QString &nick)
+{
+    // Computed once, so a nick collision is answered right away with the next candidate
+    QString base = nick.left(IRC_MIN_NICK_LENGTH - 1);
+    QStringList candidates, result;
+
+    // A server that truncates long nicks would make the appended variants collide too
+    if (nick.length() >= IRC_MIN_NICK_LENGTH)
+        candidates << base + "_" << nick.left(IRC_MIN_NICK_LENGTH - 2) + "__";
+
+    candidates << nick + "_" << nick + "__" << nick + "`";
+
+    for (int i = 1; i <= 9; i++)
+        candidates << base + QString::number(i);
+
+    foreach (const QString &candidate, candidates)
+    {
+        if (candidate != nick && !result.contains(candidate))
+            result.append(candidate);
+    }
+
+    return result;
+}
+
+void CommuniIrcClient::tryAlternativeNick()
+{
+    QString oldNick = _ircSession->nickName();
+    QString newNick = _alternativeNickIndex < _alternativeNicks.count()
+            ? _alternativeNicks[_alternativeNickIndex]
+            : _preferredNick.left(IRC_MIN_NICK_LENGTH - 4) + QString::number(qrand() % 10000);
+    _alternativeNickIndex++;
+
+    emit receiveError("The nickname '" + oldNick + "' is already in use. Trying '" + newNick + "'.");
+    // Not queued, the server waits for a usable nick before it registers us
+    changeNick(newNick);
 }
 
 void CommuniIrcClient::socketError(QAbstractSocket::SocketError error)
 {
+    if (_connectionRacer->isRacing())
+    {
+        // Other addresses of the host may still work, the racer reports when none did
+        qDebug() << Q_FUNC_INFO << "socket error:" << error << "while connecting to" << _ircSession->host();
+        _lastSocketError = error;
+        _connectionRacer->primaryFailed();
+        return;
+    }
+
     qDebug() << Q_FUNC_INFO << "socket error:" << error << "trying to reopen session";
     emit this->socketErrorHappened(error);
-    QTimer::singleShot(8000, _ircSession, SLOT(open()));
+    _reconnectEngine->scheduleReconnect();
 }
 
 void CommuniIrcClient::messageReceived(IrcMessage *message)
 {
+    TRACE_FUNCTION();
+    _linesReceived++;
+    _senderHostmask = message->sender().prefix();
+
+    QString command = message->command().toUpper();
+    PlaybackTracker::LineTags tags = _playbackTracker.takeLine(command);
+
+    if (command == "CAP")
+    {
+        processCapabilityMessage(message);
+        return;
+    }
+
+    if (command == "BATCH")
+    {
+        // A batch of the playback is handed over when it ends, the rest don't need anything
+        if (tags.endsBatch && tags.isPlayback)
+            flushPlayback(tags.batch);
+        return;
+    }
+
+    if (tags.isPlayback && collectPlayback(message, tags))
+        return;
+
     switch (message->type())
     {
     case IrcMessage::Private:
     {
         IrcPrivateMessage *msg = static_cast<IrcPrivateMessage*>(message);
-        QString channelName = msg->target().startsWith('#')
-                ? msg->target() // This is a channel message
-                : msg->sender().name(); // This is a private message
+        // A channel message, or a private message
+        QString channelName = conversationOf(msg->target(), msg->sender().name());
 
         if (msg->isAction())
         {
@@ -150,15 +677,10 @@ void CommuniIrcClient::messageReceived(IrcMessage *message)
             // This is a CTCP reply message
             emit receiveCtcpReply(FIX_EMPTY_CHANNEL_NAME(msg->sender().name()), msg->message());
         }
-        else if (msg->target().startsWith('#'))
-        {
-            // This is a channel notice message
-            emit receiveMessage(FIX_EMPTY_CHANNEL_NAME(msg->target()), msg->sender().name(), msg->message());
-        }
         else
         {
-            // This is a channel notice message
-            emit receiveMessage(FIX_EMPTY_CHANNEL_NAME(msg->sender().name()), msg->sender().name(), msg->message());
+            // This is a channel or a private notice message
+            emit receiveMessage(FIX_EMPTY_CHANNEL_NAME(conversationOf(msg->target(), msg->sender().name())), msg->sender().name(), msg->message());
         }
         break;
     }
@@ -177,8 +699,12 @@ void CommuniIrcClient::messageReceived(IrcMessage *message)
         // TODO? Errors are also appearing as numeric messages?
         break;
     case IrcMessage::Ping:
+        // This should be handled by communi itself
+        break;
     case IrcMessage::Pong:
-        // These should be handled by communi itself
+        // Replies to our own lag probes
+        if (message->parameters().count())
+            _lagMeter->receivePong(message->parameters().last());
         break;
     case IrcMessage::Numeric:
         processNumericMessage((IrcNumericMessage*)message);
@@ -186,7 +712,7 @@ void CommuniIrcClient::messageReceived(IrcMessage *message)
     case IrcMessage::Unknown:
     default:
     {
-        qDebug() << "Unknown message received from" << _ircSession->host() << "command is" << message->command() << "parameters are" << message->parameters();
+        qDebug() << "Unknown message received from" << _serverSettings->serverUrl() << "command is" << message->command() << "parameters are" << message->parameters();
         break;
     }
     }
@@ -225,6 +751,15 @@ void CommuniIrcClient::processNumericMessage(IrcNumericMessage *message)
 
         _receivedUserNames[message->parameters()[2]] += newNames;
     }
+    else if (message->code() == IRC_RPL_ISUPPORT)
+    {
+        // <nick> <token>... :are supported by this server
+        foreach (const QString &token, message->parameters())
+        {
+            if (token.startsWith("CHANTYPES="))
+                _channelTypes = token.mid(10);
+        }
+    }
     else if (message->code() == Irc::RPL_WHOISUSER)
     {
         qDebug() << "received whois" << message->code() << message->parameters();
@@ -239,10 +774,16 @@ void CommuniIrcClient::processNumericMessage(IrcNumericMessage *message)
     }
     else if (message->code() == Irc::ERR_NICKNAMEINUSE)
     {
-        QString oldNick = _ircSession->nickName();
-        QString newNick = _ircSession->nickName() + "_";
-        receiveError("The nickname '" + oldNick + "'' is already in use. Trying '" + newNick + "'.");
-        changeNick(newNick);
+        if (!_isRegistered)
+        {
+            tryAlternativeNick();
+        }
+        else
+        {
+            // The user asked for a nick that is taken, keep the current one
+            QString nick = message->parameters().count() > 1 ? message->parameters().at(1) : QString();
+            emit receiveError("The nickname '" + nick + "' is already in use.");
+        }
     }
     else if (message->code() == Irc::ERR_NICKCOLLISION)
     {
@@ -301,29 +842,93 @@ const QString CommuniIrcClient::currentNick()
 
 void CommuniIrcClient::connectToServer()
 {
-    _ircSession->open();
+    _reconnectEngine->reset();
+    _reconnectEngine->setEnabled(true);
+    openSession();
 }
 
 void CommuniIrcClient::disconnectFromServer()
 {
+    _reconnectEngine->setEnabled(false);
+    _connectionRacer->abort();
     _ircSession->close();
     _ircSession->socket()->disconnectFromHost();
 }
 
 void CommuniIrcClient::quit(const QString &message)
 {
-    _ircSession->sendCommand(IrcCommand::createQuit(message));
+    send(IrcCommand::createQuit(message), SendQueue::Urgent);
 }
 
 void CommuniIrcClient::joinChannel(const QString &channelName, const QString &channelKey)
 {
-    _ircSession->sendCommand(IrcCommand::createJoin(channelName, channelKey));
+    send(IrcCommand::createJoin(channelName, channelKey), SendQueue::Interactive);
     emit joinedChannel(FIX_EMPTY_CHANNEL_NAME(channelName));
 }
 
+QStringList CommuniIrcClient::packJoinLines(const QStringList &channelNames, const QStringList &channelKeys)
+{
+    // Keys are matched to the channels by position, so the channels with keys go first
+    QStringList keyedNames, keys, unkeyedNames;
+    for (int i = 0; i < channelNames.count(); i++)
+    {
+        QString key = i < channelKeys.count() ? channelKeys[i] : QString();
+        if (key.length())
+        {
+            keyedNames.append(channelNames[i]);
+            keys.append(key);
+        }
+        else
+        {
+            unkeyedNames.append(channelNames[i]);
+        }
+    }
+
+    QStringList names = keyedNames + unkeyedNames;
+    QStringList lines, lineNames, lineKeys;
+    int length = 4; // "JOIN"
+
+    for (int i = 0; i < names.count(); i++)
+    {
+        // A space or comma before the name, and the same for the key
+        int added = names[i].toUtf8().length() + 1;
+        if (i < keys.count())
+            added += keys[i].toUtf8().length() + 1;
+
+        if (lineNames.count() && length + added > IRC_MAX_LINE_LENGTH)
+        {
+            lines.append("JOIN " + lineNames.join(",") + (lineKeys.count() ? " " + lineKeys.join(",") : QString()));
+            lineNames.clear();
+            lineKeys.clear();
+            length = 4;
+        }
+
+        lineNames.append(names[i]);
+        if (i < keys.count())
+            lineKeys.append(keys[i]);
+        length += added;
+    }
+
+    if (lineNames.count())
+        lines.append("JOIN " + lineNames.join(",") + (lineKeys.count() ? " " + lineKeys.join(",") : QString()));
+
+    return lines;
+}
+
+void CommuniIrcClient::joinChannels(const QStringList &channelNames, const QStringList &channelKeys)
+{
+    if (channelNames.isEmpty())
+        return;
+
+    emit joinedChannels(channelNames);
+
+    foreach (const QString &line, packJoinLines(channelNames, channelKeys))
+        _sendQueue->enqueue(line, SendQueue::Bulk);
+}
+
 void CommuniIrcClient::partChannel(const QString &channelName, const QString &message)
 {
-    _ircSession->sendCommand(IrcCommand::createPart(channelName, message));
+    send(IrcCommand::createPart(channelName, message), SendQueue::Interactive);
     emit partedChannel(FIX_EMPTY_CHANNEL_NAME(channelName));
 }
 
@@ -341,35 +946,43 @@ void CommuniIrcClient::closeUser(const QString &userName)
 
 void CommuniIrcClient::sendCtcpAction(const QString &channelName, const QString &action)
 {
-    _ircSession->sendCommand(IrcCommand::createCtcpAction(channelName, action));
+    send(IrcCommand::createCtcpAction(channelName, action), SendQueue::Interactive);
     emit receiveCtcpAction(channelName, _ircSession->nickName(), action);
 }
 
 void CommuniIrcClient::sendCtcpRequest(const QString &userName, const QString &request)
 {
-    _ircSession->sendCommand(IrcCommand::createCtcpRequest(userName, request));
+    send(IrcCommand::createCtcpRequest(userName, request), SendQueue::Interactive);
 }
 
 void CommuniIrcClient::sendCtcpReply(const QString &userName, const QString &message)
 {
-    _ircSession->sendCommand(IrcCommand::createCtcpReply(userName, message));
+    send(IrcCommand::createCtcpReply(userName, message), SendQueue::Automated);
 }
 
 void CommuniIrcClient::sendMessage(const QString &channelName, const QString &message)
 {
-    _ircSession->sendCommand(IrcCommand::createMessage(channelName, message));
+    // The first line of a multi-line paste is what the user is waiting for, the rest is bulk
+#if QT_VERSION >= 0x050E00
+    QStringList lines = message.split('\n', Qt::SkipEmptyParts);
+#else
+    QStringList lines = message.split('\n', QString::SkipEmptyParts);
+#endif
+    for (int i = 0; i < lines.count(); i++)
+        send(IrcCommand::createMessage(channelName, lines[i]), i == 0 ? SendQueue::Interactive : SendQueue::Bulk);
+
     emit receiveMessage(channelName, _ircSession->nickName(), message);
 }
 
 void CommuniIrcClient::requestTopic(const QString &channelName)
 {
-    _ircSession->sendCommand(IrcCommand::createTopic(channelName));
+    send(IrcCommand::createTopic(channelName), SendQueue::Interactive);
 }
 
 void CommuniIrcClient::setTopic(const QString &channelName, const QString &topic)
 {
     qDebug() << "setting topic of" << channelName << "to" << topic;
-    _ircSession->sendCommand(IrcCommand::createTopic(channelName, topic));
+    send(IrcCommand::createTopic(channelName, topic), SendQueue::Interactive);
 }
 
 void CommuniIrcClient::changeNick(const QString &newNick)
@@ -379,21 +992,35 @@ void CommuniIrcClient::changeNick(const QString &newNick)
 
 void CommuniIrcClient::kick(const QString &channelName, const QString &userName, const QString &message)
 {
-    _ircSession->sendCommand(IrcCommand::createKick(channelName, userName, message));
+    send(IrcCommand::createKick(channelName, userName, message), SendQueue::Interactive);
 }
 
 void CommuniIrcClient::sendRaw(const QString &message)
 {
-    _ircSession->sendRaw(message);
+    _sendQueue->enqueue(message, SendQueue::Interactive);
 }
 
 void CommuniIrcClient::sendWhois(const QString userName)
 {
-    IrcCommand *command = IrcCommand::createWhois(userName);
-    _ircSession->sendCommand(command);
+    send(IrcCommand::createWhois(userName), SendQueue::Interactive);
 }
 
 QAbstractSocket *CommuniIrcClient::socket()
 {
     return _ircSession->socket();
 }
+
+SendQueue *CommuniIrcClient::sendQueue()
+{
+    return _sendQueue;
+}
+
+LagMeter *CommuniIrcClient::lagMeter()
+{
+    return _lagMeter;
+}
+
+int CommuniIrcClient::registrationTime()
+{
+    return _registrationTime;
+}
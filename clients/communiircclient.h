@@ -20,30 +20,95 @@
 #define COMMUNIIRCCLIENT_H
 
 #include <QtCore/QHash>
+#include <QtCore/QMap>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
+#include <QtCore/QElapsedTimer>
+#include <QtNetwork/QSslError>
 
 #include "clients/abstractircclient.h"
+#include "clients/sendqueue.h"
+#include "clients/encodingdetector.h"
+#include "clients/playbacktracker.h"
 
+class ServerSettings;
+class ReconnectEngine;
+class ConnectionRacer;
+class LagMeter;
+class QSslSocket;
+class QTcpSocket;
 class IrcSession;
+class IrcCommand;
 class IrcMessage;
 class IrcNumericMessage;
 
 class CommuniIrcClient : public AbstractIrcClient
 {
     Q_OBJECT
+    ServerSettings *_serverSettings;
     IrcSession *_ircSession;
     QHash<QString, QStringList> _receivedUserNames;
+    SendQueue *_sendQueue;
+    ReconnectEngine *_reconnectEngine;
+    LagMeter *_lagMeter;
+    ConnectionRacer *_connectionRacer;
+    QAbstractSocket::SocketError _lastSocketError;
+    QString _preferredNick;
+    QStringList _alternativeNicks;
+    int _alternativeNickIndex;
+    bool _isRegistered;
+    QElapsedTimer _registrationClock;
+    qint64 _socketConnectedAt, _encryptedAt;
+    int _registrationTime;
+    int _captureId;
+    EncodingDetector _encodingDetector;
+    // The encoding Communi was created with, and the one it decodes with now
+    QByteArray _defaultEncoding, _encoding;
+    PlaybackTracker _playbackTracker;
+    // The playback not yet handed over, by batch and channel
+    QHash<QByteArray, QMap<QString, QList<IrcHistoryLine> > > _playback;
+    QStringList _availableCapabilities, _capabilities;
 
     void processNumericMessage(IrcNumericMessage *message);
+    void processCapabilityMessage(IrcMessage *message);
+    // The channel or the query that a message to the target from the sender belongs to
+    QString conversationOf(const QString &target, const QString &sender);
+    bool collectPlayback(IrcMessage *message, const PlaybackTracker::LineTags &tags);
+    void flushPlayback(const QByteArray &batch);
+    void tryAlternativeNick();
+    QSslSocket *sslSocket();
+    void applySslConfiguration();
+    QByteArray peerCertificateDigest();
+    static QStringList alternativeNicks(const QString &nick);
+    void send(IrcCommand *command, SendQueue::Priority priority);
+    static QStringList packJoinLines(const QStringList &channelNames, const QStringList &channelKeys);
 
 public:
     explicit CommuniIrcClient(QObject *parent, ServerSettings *serverSettings);
+    // Duration of the TLS handshake of the current connection in milliseconds, -1 if none
+    int tlsHandshakeTime() const;
+    // Whether the Communi it's built against parses IRCv3 message tags, batch and server-time are only requested then
+    static bool canNegotiateTags();
 
 private slots:
     void messageReceived(IrcMessage *message);
     void socketError(QAbstractSocket::SocketError error);
-    
+    void writeToSocket(const QByteArray &data);
+    void socketReadyRead();
+    void requestCapabilities();
+    void sendLagProbe(const QString &token);
+    void connectionStale();
+    void openSession();
+    void openSessionTo(const QString &address);
+    void takeOverConnection(QTcpSocket *probe);
+    void connectionRaceFailed();
+    void socketConnected();
+    void socketEncrypted();
+    void sslErrors(const QList<QSslError> &errors);
+    void storeSslSession();
+    void registered();
+    void unregistered();
+
 public slots:
     virtual const QString currentNick();
     virtual void connectToServer();
@@ -51,6 +116,7 @@ public slots:
 
     virtual void quit(const QString &message);
     virtual void joinChannel(const QString &channelName, const QString &channelKey);
+    virtual void joinChannels(const QStringList &channelNames, const QStringList &channelKeys);
     virtual void partChannel(const QString &channelName, const QString &message);
     virtual void queryUser(const QString &userName);
     virtual void closeUser(const QString &userName);
@@ -66,6 +132,9 @@ public slots:
     virtual void sendWhois(const QString userName);
 
     virtual QAbstractSocket *socket();
+    virtual SendQueue *sendQueue();
+    virtual LagMeter *lagMeter();
+    virtual int registrationTime();
     
 };
 
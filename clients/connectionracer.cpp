@@ -0,0 +1,262 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+#include <QtNetwork/QTcpSocket>
+
+#include "clients/connectionracer.h"
+
+// Time given to an address before the next one is tried too, as in RFC 6555
+#define CONNECTIONRACER_DELAY 250
+// Time for which the resolved addresses of a host are reused
+#define CONNECTIONRACER_CACHE_TTL 300
+
+QHash<QString, ConnectionRacer::CachedHost> ConnectionRacer::_cache;
+
+ConnectionRacer::ConnectionRacer(QObject *parent) :
+    QObject(parent),
+    _raceTimer(new QTimer(this)),
+    _port(0),
+    _nextAddress(0),
+    _lookupId(-1),
+    _isRacing(false),
+    _isPrimaryFailed(false)
+{
+    _raceTimer->setSingleShot(true);
+    _raceTimer->setInterval(CONNECTIONRACER_DELAY);
+    connect(_raceTimer, SIGNAL(timeout()), this, SLOT(raceNextAddress()));
+}
+
+void ConnectionRacer::clearCache()
+{
+    _cache.clear();
+}
+
+void ConnectionRacer::race(const QString &host, quint16 port)
+{
+    abort();
+    _host = host;
+    _port = port;
+
+    if (!QHostAddress(host).isNull())
+    {
+        // Nothing to race when the host is given as an address
+        emit connectTo(host);
+        return;
+    }
+
+    _isRacing = true;
+
+    if (_cache.contains(host) && _cache[host].expires > QDateTime::currentDateTime())
+    {
+        startRace(orderAddresses(_cache[host].addresses, _cache[host].preferred));
+        return;
+    }
+
+    _lookupId = QHostInfo::lookupHost(host, this, SLOT(hostLookedUp(QHostInfo)));
+}
+
+void ConnectionRacer::abort()
+{
+    if (_lookupId != -1)
+    {
+        QHostInfo::abortHostLookup(_lookupId);
+        _lookupId = -1;
+    }
+
+    stopProbes();
+    _addresses.clear();
+    _isRacing = false;
+    _isPrimaryFailed = false;
+}
+
+void ConnectionRacer::hostLookedUp(const QHostInfo &info)
+{
+    if (info.lookupId() != _lookupId)
+        return;
+
+    _lookupId = -1;
+
+    if (info.error() != QHostInfo::NoError || info.addresses().isEmpty())
+    {
+        // Letting the socket look it up again, so that it reports the error
+        qDebug() << Q_FUNC_INFO << "could not resolve" << _host << info.errorString();
+        _isRacing = false;
+        emit connectTo(_host);
+        return;
+    }
+
+    CachedHost &cached = _cache[_host];
+    cached.addresses = info.addresses();
+    cached.expires = QDateTime::currentDateTime().addSecs(CONNECTIONRACER_CACHE_TTL);
+    if (!cached.addresses.contains(cached.preferred))
+        cached.preferred = QHostAddress();
+
+    startRace(orderAddresses(cached.addresses, cached.preferred));
+}
+
+QList<QHostAddress> ConnectionRacer::orderAddresses(const QList<QHostAddress> &addresses, const QHostAddress &preferred)
+{
+    // Alternating the address families, IPv6 first, the winner of last time goes before all
+    QList<QHostAddress> ipv6, ipv4, result;
+    foreach (const QHostAddress &address, addresses)
+    {
+        if (address == preferred)
+            continue;
+        else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+            ipv6.append(address);
+        else
+            ipv4.append(address);
+    }
+
+    if (!preferred.isNull())
+        result.append(preferred);
+
+    while (ipv6.count() || ipv4.count())
+    {
+        if (ipv6.count())
+            result.append(ipv6.takeFirst());
+        if (ipv4.count())
+            result.append(ipv4.takeFirst());
+    }
+
+    return result;
+}
+
+void ConnectionRacer::startRace(const QList<QHostAddress> &addresses)
+{
+    _addresses = addresses;
+    _primaryAddress = _addresses.first();
+    _nextAddress = 1;
+    _isPrimaryFailed = false;
+
+    emit connectTo(_primaryAddress.toString());
+
+    if (_nextAddress < _addresses.count())
+        _raceTimer->start();
+}
+
+void ConnectionRacer::raceNextAddress()
+{
+    if (!_isRacing || _nextAddress >= _addresses.count())
+        return;
+
+    QHostAddress address = _addresses[_nextAddress++];
+    QTcpSocket *probe = new QTcpSocket(this);
+    _probes.insert(probe, address);
+    connect(probe, SIGNAL(connected()), this, SLOT(probeConnected()));
+    connect(probe, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(probeFailed()));
+    probe->connectToHost(address, _port);
+
+    if (_nextAddress < _addresses.count())
+        _raceTimer->start();
+}
+
+void ConnectionRacer::stopProbes()
+{
+    _raceTimer->stop();
+
+    foreach (QTcpSocket *probe, _probes.keys())
+    {
+        probe->disconnect(this);
+        probe->abort();
+        probe->deleteLater();
+    }
+
+    _probes.clear();
+}
+
+void ConnectionRacer::win(const QHostAddress &address)
+{
+    if (_cache.contains(_host))
+        _cache[_host].preferred = address;
+
+    stopProbes();
+    _nextAddress = _addresses.count();
+}
+
+void ConnectionRacer::primaryConnected()
+{
+    if (!_isRacing)
+        return;
+
+    win(_primaryAddress);
+    _isRacing = false;
+}
+
+void ConnectionRacer::primaryFailed()
+{
+    if (!_isRacing)
+        return;
+
+    if (_nextAddress < _addresses.count())
+    {
+        // Not waiting for the timer, the next address becomes the primary one
+        _primaryAddress = _addresses[_nextAddress++];
+        emit connectTo(_primaryAddress.toString());
+
+        if (_nextAddress < _addresses.count())
+            _raceTimer->start();
+        return;
+    }
+
+    _isPrimaryFailed = true;
+    checkFailed();
+}
+
+void ConnectionRacer::probeConnected()
+{
+    QTcpSocket *probe = static_cast<QTcpSocket*>(sender());
+    QHostAddress address = _probes.value(probe);
+    qDebug() << "address" << address.toString() << "of" << _host << "was faster than" << _primaryAddress.toString();
+
+    // Only the losers are aborted, the connection of the winner is kept
+    _probes.remove(probe);
+    probe->disconnect(this);
+    win(address);
+    _primaryAddress = address;
+    _isPrimaryFailed = false;
+
+    emit probeWon(probe);
+    probe->deleteLater();
+}
+
+void ConnectionRacer::probeFailed()
+{
+    QTcpSocket *probe = static_cast<QTcpSocket*>(sender());
+    _probes.remove(probe);
+    probe->disconnect(this);
+    probe->deleteLater();
+
+    // An address that is refused makes room for the next one right away
+    if (_nextAddress < _addresses.count())
+        raceNextAddress();
+    else
+        checkFailed();
+}
+
+void ConnectionRacer::checkFailed()
+{
+    if (_isPrimaryFailed && _probes.isEmpty() && _nextAddress >= _addresses.count())
+    {
+        qDebug() << Q_FUNC_INFO << "none of the addresses of" << _host << "could be reached";
+        _cache.remove(_host);
+        _isRacing = false;
+        _isPrimaryFailed = false;
+        emit failed();
+    }
+}
@@ -0,0 +1,94 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef CONNECTIONRACER_H
+#define CONNECTIONRACER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QDateTime>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QHostInfo>
+
+class QTimer;
+class QTcpSocket;
+
+// Picks the address of a host to connect to, in the spirit of happy eyeballs.
+// The session socket is pointed at the most promising address with
+// connectTo(), and if it doesn't connect in a short while, the other
+// addresses are tried with probe sockets. If a probe wins, the losers are
+// aborted and the connected probe is handed over with probeWon(), so that
+// the session can take its connection over. The resolved addresses and the
+// one that won last time are cached per host, so reconnecting needs no lookup.
+
+class ConnectionRacer : public QObject
+{
+    Q_OBJECT
+
+    struct CachedHost
+    {
+        QList<QHostAddress> addresses;
+        QHostAddress preferred;
+        QDateTime expires;
+    };
+
+    static QHash<QString, CachedHost> _cache;
+
+    QTimer *_raceTimer;
+    QString _host;
+    quint16 _port;
+    QList<QHostAddress> _addresses;
+    QHostAddress _primaryAddress;
+    QHash<QTcpSocket*, QHostAddress> _probes;
+    int _nextAddress, _lookupId;
+    bool _isRacing, _isPrimaryFailed;
+
+    static QList<QHostAddress> orderAddresses(const QList<QHostAddress> &addresses, const QHostAddress &preferred);
+    void startRace(const QList<QHostAddress> &addresses);
+    void stopProbes();
+    void win(const QHostAddress &address);
+    void checkFailed();
+
+public:
+    explicit ConnectionRacer(QObject *parent = 0);
+
+    void race(const QString &host, quint16 port);
+    void abort();
+    bool isRacing() const { return _isRacing; }
+    // Forgets every resolved host, eg. when the network changes
+    static void clearCache();
+
+public slots:
+    void primaryConnected();
+    void primaryFailed();
+
+signals:
+    void connectTo(const QString &address);
+    // The probe is deleted later, its connection has to be taken over right away
+    void probeWon(QTcpSocket *probe);
+    void failed();
+
+private slots:
+    void hostLookedUp(const QHostInfo &info);
+    void raceNextAddress();
+    void probeConnected();
+    void probeFailed();
+
+};
+
+#endif // CONNECTIONRACER_H
@@ -0,0 +1,324 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QList>
+#include <QtCore/QTextCodec>
+
+#include <cstring>
+
+#include "clients/encodingdetector.h"
+
+// Channels and senders remembered, the cache starts over when it's full
+#define ENCODINGDETECTOR_MAX_SOURCES 4096
+// An incomplete line longer than this is not a line of IRC, it is dropped
+#define ENCODINGDETECTOR_MAX_LINE 16384
+// Every byte of a word of ASCII has the high bit clear
+#define ENCODINGDETECTOR_HIGH_BITS Q_UINT64_C(0x8080808080808080)
+
+enum Script
+{
+    NoScript = 0,
+    LatinScript,
+    OtherScript
+};
+
+// The legacy encodings still seen on IRC, in the order they win a tie
+static QList<QTextCodec*> candidateCodecs()
+{
+    static QList<QTextCodec*> codecs;
+    if (codecs.isEmpty())
+    {
+        const char *names[] = { "windows-1252", "ISO-8859-2", "windows-1251", "KOI8-R" };
+        for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+            if (QTextCodec *codec = QTextCodec::codecForName(names[i]))
+                codecs.append(codec);
+    }
+    return codecs;
+}
+
+// The offset of the first byte that is not ASCII, or the length if there's none
+static int firstNonAscii(const char *data, int length)
+{
+    int i = 0;
+    for (; i + 8 <= length; i += 8)
+    {
+        quint64 word;
+        memcpy(&word, data + i, 8);
+        if (word & ENCODINGDETECTOR_HIGH_BITS)
+            break;
+    }
+    for (; i < length; i++)
+        if (data[i] & 0x80)
+            return i;
+    return length;
+}
+
+// How much the decoded text looks like something a human wrote: letters
+// count for it, stray symbols and control characters against it, and so
+// does a word that switches between scripts. Lowercase letters count a bit
+// more, which tells apart the encodings that only swap the cases.
+static int plausibility(const QString &text)
+{
+    int score = 0;
+    int previousScript = NoScript;
+
+    for (int i = 0; i < text.length(); i++)
+    {
+        QChar c = text[i];
+        int script = NoScript;
+
+        if (c.unicode() < 0x80)
+        {
+            if (c.isLetter())
+                script = LatinScript;
+        }
+        else if (c.isLetter())
+        {
+            script = c.unicode() < 0x250 ? LatinScript : OtherScript;
+            score += script == LatinScript ? 2 : 3;
+            if (c.isLower())
+                score++;
+        }
+        else if (c.unicode() == QChar::ReplacementCharacter || c.category() == QChar::Other_Control)
+        {
+            score -= 5;
+        }
+        else if (!c.isSpace())
+        {
+            score -= 2;
+        }
+
+        if (script != NoScript && previousScript != NoScript && script != previousScript)
+            score -= 3;
+        previousScript = script;
+    }
+
+    return score;
+}
+
+EncodingDetector::EncodingDetector() :
+    _detections(0),
+    _cacheHits(0),
+    _mixedChunks(0)
+{
+}
+
+bool EncodingDetector::isAscii(const char *data, int length)
+{
+    return firstNonAscii(data, length) == length;
+}
+
+bool EncodingDetector::isValidUtf8(const char *data, int length)
+{
+    const uchar *p = (const uchar*) data;
+    const uchar *end = p + length;
+
+    while (p < end)
+    {
+        if (*p < 0x80)
+        {
+            p += firstNonAscii((const char*) p, end - p);
+            continue;
+        }
+
+        int extra;
+        uint c, min;
+        if ((*p & 0xe0) == 0xc0)
+        {
+            extra = 1;
+            c = *p & 0x1f;
+            min = 0x80;
+        }
+        else if ((*p & 0xf0) == 0xe0)
+        {
+            extra = 2;
+            c = *p & 0x0f;
+            min = 0x800;
+        }
+        else if ((*p & 0xf8) == 0xf0)
+        {
+            extra = 3;
+            c = *p & 0x07;
+            min = 0x10000;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (end - p <= extra)
+            return false;
+        for (int i = 1; i <= extra; i++)
+        {
+            if ((p[i] & 0xc0) != 0x80)
+                return false;
+            c = (c << 6) | (p[i] & 0x3f);
+        }
+
+        // Overlong forms, surrogates and code points beyond Unicode are not valid
+        if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+            return false;
+        p += extra + 1;
+    }
+
+    return true;
+}
+
+EncodingDetector::LineKind EncodingDetector::classify(const char *data, int length)
+{
+    int ascii = firstNonAscii(data, length);
+    if (ascii == length)
+        return Ascii;
+    return isValidUtf8(data + ascii, length - ascii) ? Utf8 : Legacy;
+}
+
+QTextCodec *EncodingDetector::detect(const QByteArray &line)
+{
+    // Only the text is scored, the rest of the line is ASCII anyway
+    int trailing = line.indexOf(" :");
+    QByteArray text = trailing == -1 ? line : line.mid(trailing + 2);
+
+    QTextCodec *best = 0;
+    int bestScore = 0;
+    foreach (QTextCodec *codec, candidateCodecs())
+    {
+        QTextCodec::ConverterState state;
+        QString decoded = codec->toUnicode(text.constData(), text.length(), &state);
+        int score = plausibility(decoded) - 5 * state.invalidChars;
+
+        if (!best || score > bestScore)
+        {
+            best = codec;
+            bestScore = score;
+        }
+    }
+
+    return best ? best : QTextCodec::codecForName("ISO-8859-1");
+}
+
+QByteArray EncodingDetector::sourceOf(const QByteArray &line)
+{
+    // [@tags] [:nick!user@host] command target ...
+    int position = 0;
+    if (line.startsWith('@'))
+    {
+        position = line.indexOf(' ') + 1;
+        if (position == 0)
+            return QByteArray();
+    }
+
+    // The encoding belongs to the client of the sender, so the sender is the source when there's one
+    if (position < line.length() && line.at(position) == ':')
+    {
+        int end = line.indexOf(' ', position);
+        if (end == -1)
+            return QByteArray();
+
+        QByteArray nick = line.mid(position + 1, end - position - 1);
+        int bang = nick.indexOf('!');
+        if (bang != -1)
+            nick.truncate(bang);
+        return nick.toLower();
+    }
+
+    // Otherwise the channel or user the line is for
+    int end = line.indexOf(' ', position);
+    if (end == -1)
+        return QByteArray();
+
+    position = end + 1;
+    if (position < line.length() && line.at(position) == ':')
+        position++;
+    end = line.indexOf(' ', position);
+    return line.mid(position, end == -1 ? -1 : end - position).toLower();
+}
+
+QTextCodec *EncodingDetector::codecForLegacyLine(const QByteArray &line)
+{
+    QByteArray source = sourceOf(line);
+    QTextCodec *codec = _codecsBySource.value(source);
+    if (codec)
+    {
+        _cacheHits++;
+        return codec;
+    }
+
+    codec = detect(line);
+    _detections++;
+
+    if (_codecsBySource.count() >= ENCODINGDETECTOR_MAX_SOURCES)
+        _codecsBySource.clear();
+    _codecsBySource.insert(source, codec);
+    return codec;
+}
+
+QString EncodingDetector::decode(const QByteArray &line)
+{
+    switch (classify(line.constData(), line.length()))
+    {
+    case Ascii:
+        return QString::fromLatin1(line.constData(), line.length());
+    case Utf8:
+        return QString::fromUtf8(line.constData(), line.length());
+    default:
+        return codecForLegacyLine(line)->toUnicode(line);
+    }
+}
+
+QByteArray EncodingDetector::codecNameForData(const QByteArray &data)
+{
+    QByteArray buffer = _partialLine.isEmpty() ? data : _partialLine + data;
+    QTextCodec *legacyCodec = 0;
+    bool isMixed = false;
+
+    int start = 0, end;
+    while ((end = buffer.indexOf('\n', start)) != -1)
+    {
+        int length = end - start;
+        if (length && buffer.at(end - 1) == '\r')
+            length--;
+
+        switch (classify(buffer.constData() + start, length))
+        {
+        case Ascii:
+        case Utf8:
+            break;
+        case Legacy:
+        {
+            QTextCodec *codec = codecForLegacyLine(buffer.mid(start, length));
+            isMixed = isMixed || (legacyCodec && legacyCodec != codec);
+            legacyCodec = codec;
+            break;
+        }
+        }
+
+        start = end + 1;
+    }
+
+    _partialLine = buffer.mid(start);
+    if (_partialLine.length() > ENCODINGDETECTOR_MAX_LINE)
+        _partialLine.clear();
+
+    // Communi decodes the valid UTF-8 lines as UTF-8 whatever the encoding is, so only
+    // two different legacy encodings in the same read don't mix
+    if (isMixed)
+    {
+        _mixedChunks++;
+        return QByteArray();
+    }
+    return legacyCodec ? legacyCodec->name() : QByteArray("UTF-8");
+}
@@ -0,0 +1,87 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef ENCODINGDETECTOR_H
+#define ENCODINGDETECTOR_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+class QTextCodec;
+
+// Finds out the encoding of the lines received from a server. Almost every
+// line is ASCII or valid UTF-8, which is checked eight bytes at a time, and
+// those lines are accepted right away. Only the lines that are not valid
+// UTF-8 are detected, by scoring how the text looks like in a few legacy
+// encodings, and the result is cached for the sender of the line, or for
+// its channel when it has no sender, so the next lines from there are not
+// detected again.
+//
+// Communi decodes every line that is valid UTF-8 as UTF-8, and the other
+// lines with the encoding of the session, which is set once for everything
+// read from the socket at once. So the legacy encoding is chosen for each
+// read, not for each line, and UTF-8 lines can be in the same read. Only
+// when a read has lines in two different legacy encodings, the encoding is
+// left as it was, and some of those lines may come out garbled. Such reads
+// are counted as mixed chunks; irc-chatter-replay --decode reports how
+// often it happens with a trace.
+
+class EncodingDetector
+{
+public:
+    enum LineKind
+    {
+        Ascii,
+        Utf8,
+        Legacy
+    };
+
+private:
+    // The codec of every sender, or channel, that sent a line which is not UTF-8
+    QHash<QByteArray, QTextCodec*> _codecsBySource;
+    QByteArray _partialLine;
+    quint64 _detections, _cacheHits, _mixedChunks;
+
+    QTextCodec *codecForLegacyLine(const QByteArray &line);
+    static QByteArray sourceOf(const QByteArray &line);
+
+public:
+    EncodingDetector();
+
+    static LineKind classify(const char *data, int length);
+    static bool isAscii(const char *data, int length);
+    static bool isValidUtf8(const char *data, int length);
+    // Scores the candidate encodings for a line that is not valid UTF-8
+    static QTextCodec *detect(const QByteArray &line);
+
+    // Decodes a line without the CR-LF
+    QString decode(const QByteArray &line);
+    // The codec of the complete lines of the data that are not UTF-8, UTF-8
+    // when there are none, or an empty name when they need different ones.
+    // The last incomplete line is kept until the rest arrives.
+    QByteArray codecNameForData(const QByteArray &data);
+    // Forgets the incomplete line, when the connection is opened again
+    void reset() { _partialLine.clear(); }
+
+    quint64 detections() const { return _detections; }
+    quint64 cacheHits() const { return _cacheHits; }
+    quint64 mixedChunks() const { return _mixedChunks; }
+
+};
+
+#endif // ENCODINGDETECTOR_H
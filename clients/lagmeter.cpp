@@ -0,0 +1,153 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+
+#include "clients/lagmeter.h"
+
+#define LAGMETER_DEFAULT_INTERVAL 20000
+#define LAGMETER_DEFAULT_MAX_MISSED 3
+#define LAGMETER_TOKEN_PREFIX "ircchatter-lag-"
+// Number of samples in the rolling histogram
+#define LAGMETER_SAMPLES 64
+
+static const int histogramLimits[] = { 50, 100, 250, 500, 1000, 2000, 5000, -1 };
+
+LagMeter::LagMeter(QObject *parent) :
+    QObject(parent),
+    _timer(new QTimer(this)),
+    _outstandingSince(0),
+    _lastRtt(-1),
+    _missedProbes(0),
+    _maxMissedProbes(LAGMETER_DEFAULT_MAX_MISSED)
+{
+    _clock.start();
+    _timer->setInterval(LAGMETER_DEFAULT_INTERVAL);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(probe()));
+}
+
+void LagMeter::setProbing(int interval, int maxMissedProbes)
+{
+    _timer->setInterval(qMax(1000, interval));
+    _maxMissedProbes = qMax(1, maxMissedProbes);
+}
+
+int LagMeter::lag() const
+{
+    // While waiting for a reply which is already late, the lag is at least that much
+    if (_outstandingToken.length())
+        return qMax((qint64) _lastRtt, _clock.elapsed() - _outstandingSince);
+
+    return _lastRtt;
+}
+
+int LagMeter::averageRtt() const
+{
+    if (_samples.isEmpty())
+        return -1;
+
+    qint64 sum = 0;
+    foreach (int sample, _samples)
+        sum += sample;
+    return (int) (sum / _samples.count());
+}
+
+QList<int> LagMeter::histogramBuckets()
+{
+    QList<int> result;
+    for (int i = 0; histogramLimits[i] != -1; i++)
+        result.append(histogramLimits[i]);
+    return result;
+}
+
+QList<int> LagMeter::histogram() const
+{
+    // The last bucket contains everything above the highest limit
+    QList<int> result;
+    int bucketCount = histogramBuckets().count() + 1;
+    for (int i = 0; i < bucketCount; i++)
+        result.append(0);
+
+    foreach (int sample, _samples)
+    {
+        int i = 0;
+        while (histogramLimits[i] != -1 && sample > histogramLimits[i])
+            i++;
+        result[i]++;
+    }
+
+    return result;
+}
+
+bool LagMeter::receivePong(const QString &token)
+{
+    if (!token.startsWith(LAGMETER_TOKEN_PREFIX))
+        return false;
+
+    // The token contains the time when the probe was sent, so late replies are measured correctly too
+    qint64 sentAt = token.mid(QString(LAGMETER_TOKEN_PREFIX).length()).toLongLong();
+    _lastRtt = (int) (_clock.elapsed() - sentAt);
+
+    _samples.append(_lastRtt);
+    if (_samples.count() > LAGMETER_SAMPLES)
+        _samples.removeFirst();
+
+    if (token == _outstandingToken)
+        _outstandingToken.clear();
+
+    _missedProbes = 0;
+    emit lagChanged(_lastRtt);
+    return true;
+}
+
+void LagMeter::start()
+{
+    _missedProbes = 0;
+    _outstandingToken.clear();
+    _timer->start();
+    probe();
+}
+
+void LagMeter::stop()
+{
+    _timer->stop();
+    _outstandingToken.clear();
+    _lastRtt = -1;
+    emit lagChanged(-1);
+}
+
+void LagMeter::probe()
+{
+    if (_outstandingToken.length())
+    {
+        _missedProbes++;
+        emit lagChanged(lag());
+        qDebug() << Q_FUNC_INFO << "no reply to the last probe, missed" << _missedProbes << "in a row";
+
+        if (_missedProbes >= _maxMissedProbes)
+        {
+            stop();
+            emit connectionStale();
+            return;
+        }
+    }
+
+    _outstandingSince = _clock.elapsed();
+    _outstandingToken = LAGMETER_TOKEN_PREFIX + QString::number(_outstandingSince);
+    emit sendProbe(_outstandingToken);
+}
@@ -0,0 +1,71 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef LAGMETER_H
+#define LAGMETER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+
+class QTimer;
+
+// Measures the latency of a connection with timestamped PING probes.
+// The round trip times of the last few probes are kept for a histogram.
+// When too many probes in a row get no reply, the connection is
+// considered dead and connectionStale() is emitted, which is usually
+// a lot sooner than the socket would time out.
+
+class LagMeter : public QObject
+{
+    Q_OBJECT
+    QTimer *_timer;
+    QElapsedTimer _clock;
+    QList<int> _samples;
+    QString _outstandingToken;
+    qint64 _outstandingSince;
+    int _lastRtt, _missedProbes, _maxMissedProbes;
+
+public:
+    explicit LagMeter(QObject *parent = 0);
+
+    void setProbing(int interval, int maxMissedProbes);
+    int lag() const;
+    int lastRtt() const { return _lastRtt; }
+    int averageRtt() const;
+    int missedProbes() const { return _missedProbes; }
+    // Number of samples in each bucket, the upper limits are given by histogramBuckets()
+    QList<int> histogram() const;
+    static QList<int> histogramBuckets();
+
+    bool receivePong(const QString &token);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void sendProbe(const QString &token);
+    void lagChanged(int lag);
+    void connectionStale();
+
+private slots:
+    void probe();
+
+};
+
+#endif // LAGMETER_H
@@ -0,0 +1,151 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDateTime>
+
+#include "clients/playbacktracker.h"
+
+// Lines that Communi didn't hand over are forgotten beyond this
+#define PLAYBACKTRACKER_MAX_LINES 4096
+// An incomplete line longer than this is not a line of IRC, it is dropped
+#define PLAYBACKTRACKER_MAX_LINE 16384
+
+void PlaybackTracker::addData(const QByteArray &data)
+{
+    QByteArray buffer = _partialLine.isEmpty() ? data : _partialLine + data;
+
+    int start = 0, end;
+    while ((end = buffer.indexOf('\n', start)) != -1)
+    {
+        int length = end - start;
+        if (length && buffer.at(end - 1) == '\r')
+            length--;
+        if (length)
+            addLine(buffer.mid(start, length));
+        start = end + 1;
+    }
+
+    _partialLine = buffer.mid(start);
+    if (_partialLine.length() > PLAYBACKTRACKER_MAX_LINE)
+        _partialLine.clear();
+
+    if (_lines.count() > PLAYBACKTRACKER_MAX_LINES)
+        _lines.erase(_lines.begin(), _lines.end() - PLAYBACKTRACKER_MAX_LINES);
+}
+
+void PlaybackTracker::addLine(const QByteArray &line)
+{
+    // [@tags] [:prefix] command parameters
+    LineTags tags;
+    int position = 0;
+
+    if (line.startsWith('@'))
+    {
+        position = line.indexOf(' ') + 1;
+        if (position == 0)
+            return;
+
+        foreach (const QByteArray &tag, line.mid(1, position - 2).split(';'))
+        {
+            if (tag.startsWith("time="))
+                tags.time = parseTime(tag.mid(5));
+            else if (tag.startsWith("batch="))
+                tags.batch = tag.mid(6);
+        }
+    }
+
+    if (position < line.length() && line.at(position) == ':')
+    {
+        position = line.indexOf(' ', position) + 1;
+        if (position == 0)
+            return;
+    }
+
+    int end = line.indexOf(' ', position);
+    tags.command = QString::fromLatin1(line.mid(position, end == -1 ? -1 : end - position)).toUpper();
+    tags.isPlayback = !tags.batch.isEmpty() && _batches.value(tags.batch);
+
+    if (tags.command == "BATCH" && end != -1)
+    {
+        // BATCH +id type [parameters], or BATCH -id
+        QList<QByteArray> parameters = line.mid(end + 1).split(' ');
+        QByteArray reference = parameters.first();
+
+        if (reference.startsWith('+') && reference.length() > 1)
+        {
+            // A batch in a batch of the history is history too
+            bool isPlayback = tags.isPlayback || (parameters.count() > 1 && isPlaybackBatchType(parameters[1]));
+            _batches.insert(reference.mid(1), isPlayback);
+        }
+        else if (reference.startsWith('-') && reference.length() > 1)
+        {
+            tags.batch = reference.mid(1);
+            tags.isPlayback = _batches.take(tags.batch);
+            tags.endsBatch = true;
+        }
+    }
+
+    _lines.append(tags);
+}
+
+PlaybackTracker::LineTags PlaybackTracker::takeLine(const QString &command)
+{
+    for (int i = 0; i < _lines.count(); i++)
+    {
+        if (_lines[i].command == command)
+        {
+            LineTags tags = _lines[i];
+            _lines.erase(_lines.begin(), _lines.begin() + i + 1);
+            return tags;
+        }
+    }
+
+    return LineTags();
+}
+
+void PlaybackTracker::reset()
+{
+    _lines.clear();
+    _batches.clear();
+    _partialLine.clear();
+}
+
+qint64 PlaybackTracker::parseTime(const QByteArray &value)
+{
+    // 2012-06-30T23:59:60.419Z, always in UTC
+    QDateTime dateTime = QDateTime::fromString(QString::fromLatin1(value.left(19)), Qt::ISODate);
+    if (!dateTime.isValid())
+        return -1;
+
+    dateTime.setTimeSpec(Qt::UTC);
+    qint64 time = dateTime.toMSecsSinceEpoch();
+
+    if (value.length() > 20 && value.at(19) == '.')
+    {
+        int digits = 0;
+        while (digits < 3 && 20 + digits < value.length() && value.at(20 + digits) >= '0' && value.at(20 + digits) <= '9')
+            digits++;
+        time += value.mid(20, digits).leftJustified(3, '0').toInt();
+    }
+
+    return time;
+}
+
+bool PlaybackTracker::isPlaybackBatchType(const QByteArray &type)
+{
+    return type == "chathistory" || type == "znc.in/playback";
+}
@@ -0,0 +1,68 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef PLAYBACKTRACKER_H
+#define PLAYBACKTRACKER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+// Follows the IRCv3 batches and the server-time tags in the raw lines
+// received from a server, which Communi doesn't tell about. The lines are
+// seen here before Communi parses them, so their tags are queued, and
+// taken again in the same order as Communi hands over the messages.
+// A line belongs to the playback when it is in a batch of the history,
+// like the ones a bouncer sends after connecting.
+
+class PlaybackTracker
+{
+public:
+    struct LineTags
+    {
+        QString command;
+        // Milliseconds since the epoch from the time tag, -1 without one
+        qint64 time;
+        // The batch the line is in, or the one it ends for BATCH -id
+        QByteArray batch;
+        bool isPlayback, endsBatch;
+
+        LineTags() : time(-1), isPlayback(false), endsBatch(false) { }
+    };
+
+private:
+    QList<LineTags> _lines;
+    // The open batches, whether they are playback by their id
+    QHash<QByteArray, bool> _batches;
+    QByteArray _partialLine;
+
+    void addLine(const QByteArray &line);
+
+public:
+    // Records the complete lines in the data, the last incomplete line is kept until the rest arrives
+    void addData(const QByteArray &data);
+    // The tags of the next line with the given command, the lines skipped before it are dropped
+    LineTags takeLine(const QString &command);
+    void reset();
+
+    static qint64 parseTime(const QByteArray &value);
+    static bool isPlaybackBatchType(const QByteArray &type);
+
+};
+
+#endif // PLAYBACKTRACKER_H
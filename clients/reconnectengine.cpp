@@ -0,0 +1,109 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+
+#include "clients/reconnectengine.h"
+
+#define RECONNECT_BASE_DELAY 2000
+#define RECONNECT_MAX_DELAY 300000
+// The delay is randomly changed by at most this percentage
+#define RECONNECT_JITTER_PERCENT 25
+
+ReconnectEngine::ReconnectEngine(QObject *parent) :
+    QObject(parent),
+    _timer(new QTimer(this)),
+    _attempts(0),
+    _baseDelay(RECONNECT_BASE_DELAY),
+    _maxDelay(RECONNECT_MAX_DELAY),
+    _isEnabled(true)
+{
+    // Seeded once, the engines draw from the same sequence so they don't retry in lockstep.
+    // The engines live on the GUI thread, which is the one the seed belongs to.
+    static bool isSeeded = false;
+    if (!isSeeded)
+    {
+        qsrand((uint) QDateTime::currentDateTime().toTime_t() ^ (uint) QCoreApplication::applicationPid());
+        isSeeded = true;
+    }
+
+    _timer->setSingleShot(true);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+void ReconnectEngine::setDelays(int baseDelay, int maxDelay)
+{
+    _baseDelay = baseDelay;
+    _maxDelay = maxDelay;
+}
+
+bool ReconnectEngine::isPending() const
+{
+    return _timer->isActive();
+}
+
+int ReconnectEngine::nextDelay() const
+{
+    if (_attempts == 0)
+        return 0;
+
+    // Doubling the delay for every failed attempt, without overflowing
+    qint64 delay = _baseDelay;
+    for (int i = 1; i < _attempts && delay < _maxDelay; i++)
+        delay *= 2;
+    delay = qMin(delay, (qint64) _maxDelay);
+
+    int jitter = (int) (delay * RECONNECT_JITTER_PERCENT / 100);
+    if (jitter > 0)
+        delay += (qrand() % (2 * jitter + 1)) - jitter;
+
+    return (int) delay;
+}
+
+void ReconnectEngine::scheduleReconnect()
+{
+    // Only one retry at a time, eg. a socket error is usually followed by a disconnect
+    if (!_isEnabled || _timer->isActive())
+        return;
+
+    int delay = nextDelay();
+    qDebug() << Q_FUNC_INFO << "attempt" << _attempts + 1 << "in" << delay << "ms";
+    _attempts++;
+    _timer->start(delay);
+}
+
+void ReconnectEngine::reset()
+{
+    _attempts = 0;
+    _timer->stop();
+}
+
+void ReconnectEngine::setEnabled(bool value)
+{
+    _isEnabled = value;
+
+    if (!_isEnabled)
+        _timer->stop();
+}
+
+void ReconnectEngine::timeout()
+{
+    emit reconnectRequested();
+}
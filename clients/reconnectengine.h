@@ -0,0 +1,60 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef RECONNECTENGINE_H
+#define RECONNECTENGINE_H
+
+#include <QtCore/QObject>
+
+class QTimer;
+
+// Decides when a lost connection should be opened again.
+// The first retry happens immediately, the next ones are delayed
+// exponentially with some random jitter, so that a server ban or a DNS
+// outage doesn't cause a reconnect storm. Each connection has its own
+// engine, which is reset when the connection is registered again.
+
+class ReconnectEngine : public QObject
+{
+    Q_OBJECT
+    QTimer *_timer;
+    int _attempts;
+    int _baseDelay, _maxDelay;
+    bool _isEnabled;
+
+public:
+    explicit ReconnectEngine(QObject *parent = 0);
+
+    void setDelays(int baseDelay, int maxDelay);
+    int attempts() const { return _attempts; }
+    bool isPending() const;
+    int nextDelay() const;
+
+public slots:
+    void scheduleReconnect();
+    void reset();
+    void setEnabled(bool value);
+
+signals:
+    void reconnectRequested();
+
+private slots:
+    void timeout();
+
+};
+
+#endif // RECONNECTENGINE_H
@@ -0,0 +1,284 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDebug>
+
+#include "clients/remoteircclient.h"
+#include "clients/sendqueue.h"
+#include "clients/lagmeter.h"
+#include "helpers/coreprotocol.h"
+#include "model/coreconnection.h"
+#include "model/settings/serversettings.h"
+
+RemoteIrcClient::RemoteIrcClient(QObject *parent, ServerSettings *serverSettings, CoreConnection *connection, int serverId, const QString &nick) :
+    AbstractIrcClient(parent, serverSettings),
+    _connection(connection),
+    _serverSettings(serverSettings),
+    _serverId(serverId),
+    _nick(nick),
+    _sendQueue(new SendQueue(this)),
+    _lagMeter(new LagMeter(this))
+{
+}
+
+void RemoteIrcClient::call(const QString &method, const QStringList &arguments)
+{
+    if (_connection)
+        _connection->call(_serverId, method, arguments);
+    else
+        qDebug() << Q_FUNC_INFO << "detached from the core, dropping" << method;
+}
+
+void RemoteIrcClient::detach()
+{
+    _connection = 0;
+}
+
+IrcHistoryLine RemoteIrcClient::historyLine(const CoreProtocol::Event &event, bool isAction)
+{
+    IrcHistoryLine line;
+    line.time = event.fields[CoreProtocol::Extra].toLongLong();
+    line.userName = event.fields[CoreProtocol::Nick];
+    line.message = event.fields[CoreProtocol::Text];
+    line.hostmask = event.fields[CoreProtocol::Hostmask];
+    line.isAction = isAction;
+    return line;
+}
+
+void RemoteIrcClient::dispatch(const CoreProtocol::Event &event)
+{
+    using namespace CoreProtocol;
+    const QString &channelName = event.fields[Channel], &nick = event.fields[Nick], &text = event.fields[Text], &extra = event.fields[Extra];
+
+    _linesReceived++;
+    // For the ignore rules, like the prefix of a message that Communi emits
+    _senderHostmask = event.fields[Hostmask];
+
+    switch (event.type)
+    {
+    case Connected:
+        // Not emitted as connectedToServer(), the core has already joined the channels
+        _serverSettings->setIsConnecting(false);
+        _serverSettings->setIsConnected(true);
+        break;
+    case Disconnected:
+        _serverSettings->setIsConnected(false);
+        emit disconnectedFromServer();
+        break;
+    case OwnNick:
+        _nick = nick;
+        break;
+    case UserNames:
+        // Long lists come in more than one event
+        _receivedUserNames[channelName] += text.split(' ', QString::SkipEmptyParts);
+        if (extra != "more")
+            emit receiveUserNames(channelName, _receivedUserNames.take(channelName));
+        break;
+    case Message:
+        if (extra.length())
+            emit receiveHistory(channelName, QList<IrcHistoryLine>() << historyLine(event, false));
+        else
+            emit receiveMessage(channelName, nick, text);
+        break;
+    case CtcpRequest:
+        emit receiveCtcpRequest(nick, text);
+        break;
+    case CtcpReply:
+        emit receiveCtcpReply(nick, text);
+        break;
+    case CtcpAction:
+        if (extra.length())
+            emit receiveHistory(channelName, QList<IrcHistoryLine>() << historyLine(event, true));
+        else
+            emit receiveCtcpAction(channelName, nick, text);
+        break;
+    case Part:
+        emit receivePart(channelName, nick, text);
+        break;
+    case Join:
+        emit receiveJoin(channelName, nick);
+        break;
+    case Topic:
+        emit receiveTopic(channelName, text);
+        break;
+    case Kick:
+        emit receiveKick(channelName, nick, extra, text);
+        break;
+    case ModeChange:
+        emit receiveModeChange(channelName, text, extra);
+        break;
+    case Quit:
+        emit receiveQuit(nick, text);
+        break;
+    case NickChange:
+        if (nick == _nick)
+            _nick = extra;
+        emit receiveNickChange(nick, extra);
+        break;
+    case Motd:
+        emit receiveMotd(text);
+        break;
+    case Error:
+        emit receiveError(text);
+        break;
+    case JoinedChannel:
+        emit joinedChannel(channelName);
+        break;
+    case QueriedUser:
+        emit queriedUser(channelName);
+        break;
+    case PartedChannel:
+        emit partedChannel(channelName);
+        break;
+    case ClosedUser:
+        emit closedUser(channelName);
+        break;
+    default:
+        break;
+    }
+}
+
+void RemoteIrcClient::restoreChannel(const QString &channelName, const QString &topic, const QStringList &userNames)
+{
+    emit joinedChannel(channelName);
+
+    if (topic.length())
+        emit receiveTopic(channelName, topic);
+    if (userNames.count())
+        emit receiveUserNames(channelName, userNames);
+}
+
+const QString RemoteIrcClient::currentNick()
+{
+    return _nick;
+}
+
+void RemoteIrcClient::connectToServer()
+{
+    // The core connects and reconnects by itself
+}
+
+void RemoteIrcClient::disconnectFromServer()
+{
+    // Only the core may close its connections
+}
+
+void RemoteIrcClient::quit(const QString &message)
+{
+    call("quit", QStringList() << message);
+}
+
+void RemoteIrcClient::joinChannel(const QString &channelName, const QString &channelKey)
+{
+    call("joinChannel", QStringList() << channelName << channelKey);
+}
+
+void RemoteIrcClient::joinChannels(const QStringList &channelNames, const QStringList &channelKeys)
+{
+    for (int i = 0; i < channelNames.count(); i++)
+        joinChannel(channelNames[i], channelKeys.value(i));
+}
+
+void RemoteIrcClient::partChannel(const QString &channelName, const QString &message)
+{
+    call("partChannel", QStringList() << channelName << message);
+}
+
+void RemoteIrcClient::queryUser(const QString &userName)
+{
+    call("queryUser", QStringList() << userName);
+}
+
+void RemoteIrcClient::closeUser(const QString &userName)
+{
+    call("closeUser", QStringList() << userName);
+}
+
+void RemoteIrcClient::sendCtcpAction(const QString &channelName, const QString &action)
+{
+    call("sendCtcpAction", QStringList() << channelName << action);
+}
+
+void RemoteIrcClient::sendCtcpRequest(const QString &userName, const QString &request)
+{
+    call("sendCtcpRequest", QStringList() << userName << request);
+}
+
+void RemoteIrcClient::sendCtcpReply(const QString &userName, const QString &message)
+{
+    // The core answers the requests itself, every attached UI would answer them again
+    Q_UNUSED(userName)
+    Q_UNUSED(message)
+}
+
+void RemoteIrcClient::sendMessage(const QString &channelName, const QString &message)
+{
+    call("sendMessage", QStringList() << channelName << message);
+}
+
+void RemoteIrcClient::requestTopic(const QString &channelName)
+{
+    call("requestTopic", QStringList() << channelName);
+}
+
+void RemoteIrcClient::setTopic(const QString &channelName, const QString &topic)
+{
+    call("setTopic", QStringList() << channelName << topic);
+}
+
+void RemoteIrcClient::changeNick(const QString &newNick)
+{
+    call("changeNick", QStringList() << newNick);
+}
+
+void RemoteIrcClient::kick(const QString &channelName, const QString &userName, const QString &message)
+{
+    call("kick", QStringList() << channelName << userName << message);
+}
+
+void RemoteIrcClient::sendRaw(const QString &message)
+{
+    // The core doesn't take raw commands from the UIs
+    Q_UNUSED(message)
+    qWarning() << Q_FUNC_INFO << "raw commands can't be sent through the core";
+    emit receiveError("Raw commands can't be sent from a UI that is attached to the core.");
+}
+
+void RemoteIrcClient::sendWhois(const QString userName)
+{
+    call("sendWhois", QStringList() << userName);
+}
+
+QAbstractSocket *RemoteIrcClient::socket()
+{
+    return &_socket;
+}
+
+SendQueue *RemoteIrcClient::sendQueue()
+{
+    return _sendQueue;
+}
+
+LagMeter *RemoteIrcClient::lagMeter()
+{
+    return _lagMeter;
+}
+
+int RemoteIrcClient::registrationTime()
+{
+    return -1;
+}
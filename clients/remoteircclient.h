@@ -0,0 +1,96 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef REMOTEIRCCLIENT_H
+#define REMOTEIRCCLIENT_H
+
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtNetwork/QTcpSocket>
+
+#include "clients/abstractircclient.h"
+
+class CoreConnection;
+class ServerSettings;
+
+namespace CoreProtocol
+{
+    struct Event;
+}
+
+// Stands in for a client which lives in the core process. The events that
+// the core publishes for the server are emitted as signals, and the commands
+// are sent to the core. The core owns the connection, so this client never
+// connects or disconnects by itself.
+
+class RemoteIrcClient : public AbstractIrcClient
+{
+    Q_OBJECT
+    CoreConnection *_connection;
+    ServerSettings *_serverSettings;
+    int _serverId;
+    QString _nick;
+    // Never connected, only here because the models expect a socket
+    QTcpSocket _socket;
+    SendQueue *_sendQueue;
+    LagMeter *_lagMeter;
+    QHash<QString, QStringList> _receivedUserNames;
+
+    void call(const QString &method, const QStringList &arguments = QStringList());
+    static IrcHistoryLine historyLine(const CoreProtocol::Event &event, bool isAction);
+
+public:
+    explicit RemoteIrcClient(QObject *parent, ServerSettings *serverSettings, CoreConnection *connection, int serverId, const QString &nick);
+    int serverId() const { return _serverId; }
+
+    // Emits the signal corresponding to an event of the core
+    void dispatch(const CoreProtocol::Event &event);
+    // Recreates a channel which the core is already in
+    void restoreChannel(const QString &channelName, const QString &topic, const QStringList &userNames);
+    // Commands are dropped from now on, for example when the UI is quitting
+    void detach();
+
+public slots:
+    virtual const QString currentNick();
+    virtual void connectToServer();
+    virtual void disconnectFromServer();
+
+    virtual void quit(const QString &message);
+    virtual void joinChannel(const QString &channelName, const QString &channelKey);
+    virtual void joinChannels(const QStringList &channelNames, const QStringList &channelKeys);
+    virtual void partChannel(const QString &channelName, const QString &message);
+    virtual void queryUser(const QString &userName);
+    virtual void closeUser(const QString &userName);
+    virtual void sendCtcpAction(const QString &channelName, const QString &action);
+    virtual void sendCtcpRequest(const QString &userName, const QString &request);
+    virtual void sendCtcpReply(const QString &userName, const QString &message);
+    virtual void sendMessage(const QString &channelName, const QString &message);
+    virtual void requestTopic(const QString &channelName);
+    virtual void setTopic(const QString &channelName, const QString &topic);
+    virtual void changeNick(const QString &newNick);
+    virtual void kick(const QString &channelName, const QString &userName, const QString &message);
+    virtual void sendRaw(const QString &message);
+    virtual void sendWhois(const QString userName);
+
+    virtual QAbstractSocket *socket();
+    virtual SendQueue *sendQueue();
+    virtual LagMeter *lagMeter();
+    virtual int registrationTime();
+
+};
+
+#endif // REMOTEIRCCLIENT_H
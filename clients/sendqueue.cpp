@@ -0,0 +1,209 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+#include <QtCore/QTextCodec>
+
+#include "clients/sendqueue.h"
+
+// Flood control used when the network is not known
+#define SENDQUEUE_DEFAULT_BURST 5
+#define SENDQUEUE_DEFAULT_INTERVAL 2000
+// Lines longer than this cost more than one token
+#define SENDQUEUE_BYTES_PER_TOKEN 256
+
+struct FloodControlProfile
+{
+    const char *hostSuffix;
+    int burst;
+    int interval;
+};
+
+// Known networks and how many lines they let through without penalty
+static const FloodControlProfile floodControlProfiles[] =
+{
+    { "freenode.net", 5, 1500 },
+    { "libera.chat", 5, 1500 },
+    { "oftc.net", 5, 2000 },
+    { "quakenet.org", 4, 2000 },
+    { "undernet.org", 4, 2000 },
+    { "rizon.net", 6, 1500 },
+    { 0, 0, 0 }
+};
+
+SendQueue::SendQueue(QObject *parent) :
+    QObject(parent),
+    _timer(new QTimer(this)),
+    _codec(0),
+    _lastRefill(0),
+    _burst(SENDQUEUE_DEFAULT_BURST),
+    _interval(SENDQUEUE_DEFAULT_INTERVAL),
+    _lastDelay(0),
+    _maxDelay(0),
+    _totalDelay(0),
+    _linesSent(0),
+    _bytesSent(0),
+    _writes(0)
+{
+    _budget = _burst * _interval;
+    _clock.start();
+    _timer->setSingleShot(true);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(dispatch()));
+}
+
+void SendQueue::setFloodControl(int burst, int interval)
+{
+    _burst = qMax(1, burst);
+    _interval = qMax(0, interval);
+    _budget = qMin(_budget, (qint64) _burst * _interval);
+}
+
+void SendQueue::setFloodControlForHost(const QString &host)
+{
+    for (int i = 0; floodControlProfiles[i].hostSuffix; i++)
+    {
+        if (host.endsWith(floodControlProfiles[i].hostSuffix, Qt::CaseInsensitive))
+        {
+            setFloodControl(floodControlProfiles[i].burst, floodControlProfiles[i].interval);
+            return;
+        }
+    }
+
+    setFloodControl(SENDQUEUE_DEFAULT_BURST, SENDQUEUE_DEFAULT_INTERVAL);
+}
+
+void SendQueue::setEncoding(const QByteArray &encoding)
+{
+    _codec = QTextCodec::codecForName(encoding);
+
+    if (!_codec)
+        qWarning() << Q_FUNC_INFO << "unknown encoding" << encoding << ", sending UTF-8";
+}
+
+void SendQueue::enqueue(const QString &line, Priority priority)
+{
+    Entry entry;
+    entry.data = (_codec ? _codec->fromUnicode(line) : line.toUtf8()) + "\r\n";
+    entry.queuedAt = _clock.elapsed();
+    _queues[priority].enqueue(entry);
+
+    if (priority == Urgent)
+        dispatch();
+    else
+        scheduleDispatch();
+
+    emit metricsChanged();
+}
+
+void SendQueue::clear()
+{
+    for (int i = 0; i < PriorityCount; i++)
+        _queues[i].clear();
+
+    _timer->stop();
+    emit metricsChanged();
+}
+
+int SendQueue::queueDepth() const
+{
+    int result = 0;
+    for (int i = 0; i < PriorityCount; i++)
+        result += _queues[i].count();
+    return result;
+}
+
+int SendQueue::queueDepth(Priority priority) const
+{
+    return _queues[priority].count();
+}
+
+void SendQueue::refill()
+{
+    qint64 now = _clock.elapsed();
+    _budget = qMin(_budget + now - _lastRefill, (qint64) _burst * _interval);
+    _lastRefill = now;
+}
+
+int SendQueue::cost(const QByteArray &data) const
+{
+    // Never more than a full bucket, otherwise the line could never be sent
+    return qMin(_interval * (1 + data.length() / SENDQUEUE_BYTES_PER_TOKEN), _burst * _interval);
+}
+
+void SendQueue::scheduleDispatch()
+{
+    // Dispatching from the event loop, so that lines queued together are written together
+    if (!_timer->isActive())
+        _timer->start(0);
+}
+
+void SendQueue::dispatch()
+{
+    refill();
+
+    QByteArray buffer;
+    qint64 now = _clock.elapsed();
+
+    for (int priority = 0; priority < PriorityCount; priority++)
+    {
+        while (_queues[priority].count())
+        {
+            const Entry &entry = _queues[priority].head();
+            int entryCost = cost(entry.data);
+
+            // Urgent lines don't wait, but they still use up the bucket
+            if (priority != Urgent && _budget < entryCost)
+                break;
+
+            _budget -= entryCost;
+            _lastDelay = now - entry.queuedAt;
+            _maxDelay = qMax(_maxDelay, _lastDelay);
+            _totalDelay += _lastDelay;
+            _linesSent++;
+            buffer += _queues[priority].dequeue().data;
+        }
+
+        // Lower priorities wait until the higher ones are sent
+        if (_queues[priority].count())
+            break;
+    }
+
+    if (buffer.length())
+    {
+        _bytesSent += buffer.length();
+        _writes++;
+        emit flush(buffer);
+    }
+
+    if (queueDepth())
+    {
+        // Waking up when the next line can be sent
+        int next = 0;
+        for (int priority = 0; priority < PriorityCount; priority++)
+        {
+            if (_queues[priority].count())
+            {
+                next = cost(_queues[priority].head().data);
+                break;
+            }
+        }
+        _timer->start((int) qMax((qint64) 0, next - _budget));
+    }
+
+    emit metricsChanged();
+}
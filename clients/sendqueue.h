@@ -0,0 +1,107 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QQueue>
+
+class QTimer;
+class QTextCodec;
+
+// Outgoing line scheduler of a single connection.
+// Lines are queued by priority and released according to a token bucket,
+// so that bulk actions don't get us killed for excess flood. The lines
+// released at the same time are coalesced and handed over in one piece
+// through the flush() signal, which the IRC client writes to its socket.
+
+class SendQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority
+    {
+        // Sent immediately, regardless of the bucket (eg. QUIT, lag probes)
+        Urgent = 0,
+        // Typed by the user
+        Interactive = 1,
+        // Lines generated by bulk actions, like autojoin or the rest of a paste
+        Bulk = 2,
+        // Replies sent automatically, like CTCP replies
+        Automated = 3,
+        PriorityCount = 4
+    };
+
+    explicit SendQueue(QObject *parent = 0);
+
+    void setFloodControl(int burst, int interval);
+    void setFloodControlForHost(const QString &host);
+    int burst() const { return _burst; }
+    int interval() const { return _interval; }
+
+    // Lines are encoded with this, UTF-8 is used when it's not known
+    void setEncoding(const QByteArray &encoding);
+    void enqueue(const QString &line, Priority priority);
+
+    // Metrics
+    int queueDepth() const;
+    int queueDepth(Priority priority) const;
+    qint64 lastDelay() const { return _lastDelay; }
+    qint64 maxDelay() const { return _maxDelay; }
+    qint64 averageDelay() const { return _linesSent ? _totalDelay / _linesSent : 0; }
+    quint64 linesSent() const { return _linesSent; }
+    quint64 bytesSent() const { return _bytesSent; }
+    quint64 writes() const { return _writes; }
+
+public slots:
+    void clear();
+
+signals:
+    void flush(const QByteArray &data);
+    void metricsChanged();
+
+private slots:
+    void dispatch();
+
+private:
+    struct Entry
+    {
+        QByteArray data;
+        qint64 queuedAt;
+    };
+
+    QQueue<Entry> _queues[PriorityCount];
+    QTimer *_timer;
+    QTextCodec *_codec;
+    QElapsedTimer _clock;
+    // The bucket is counted in milliseconds of sending time
+    qint64 _budget, _lastRefill;
+    int _burst, _interval;
+    qint64 _lastDelay, _maxDelay, _totalDelay;
+    quint64 _linesSent, _bytesSent, _writes;
+
+    void refill();
+    int cost(const QByteArray &data) const;
+    void scheduleDispatch();
+
+};
+
+#endif // SENDQUEUE_H
@@ -0,0 +1,226 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QMetaObject>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+#include "trafficcapture.h"
+
+// Records waiting for the writer may take this many bytes, lines beyond it are dropped
+#define TRAFFICCAPTURE_MAX_PENDING 1048576
+// An incomplete line longer than this is recorded as it is
+#define TRAFFICCAPTURE_MAX_LINE 8192
+// Time between two writes of the capture file
+#define TRAFFICCAPTURE_FLUSH_INTERVAL 250
+
+TrafficCapture *TrafficCapture::_instance = 0;
+
+TrafficCapture::TrafficCapture() :
+    QObject(QCoreApplication::instance()),
+    _thread(0),
+    _writer(0),
+    _droppedLines(0),
+    _isEnabled(false)
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    stop();
+
+    if (_thread)
+    {
+        _thread->quit();
+        _thread->wait();
+        delete _writer;
+    }
+
+    _instance = 0;
+}
+
+TrafficCapture *TrafficCapture::instance()
+{
+    if (!_instance)
+        _instance = new TrafficCapture();
+
+    return _instance;
+}
+
+bool TrafficCapture::start(const QString &path)
+{
+    if (_isEnabled)
+        stop();
+
+    // Every client registers itself, but the writer thread is only needed once capturing
+    if (!_thread)
+    {
+        _thread = new QThread(this);
+        _writer = new TrafficCaptureWriter(this);
+        _writer->moveToThread(_thread);
+        _thread->start(QThread::LowPriority);
+    }
+
+    bool opened = false;
+    QMetaObject::invokeMethod(_writer, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, opened), Q_ARG(QString, path));
+    if (!opened)
+        return false;
+
+    QMutexLocker locker(&_mutex);
+    _pending.clear();
+    _partialLines.clear();
+    _droppedLines = 0;
+    _clock.start();
+    _isEnabled = true;
+
+    // The servers are known before the capture starts, their addresses come first
+    foreach (int serverId, _servers.keys())
+        appendRecord(ServerRecord, serverId, _servers[serverId].toUtf8());
+
+    qDebug() << Q_FUNC_INFO << "capturing traffic to" << path;
+    return true;
+}
+
+void TrafficCapture::stop()
+{
+    if (!_isEnabled)
+        return;
+
+    {
+        QMutexLocker locker(&_mutex);
+        _isEnabled = false;
+    }
+
+    // The writer takes the remaining records before closing the file
+    QMetaObject::invokeMethod(_writer, "close", Qt::BlockingQueuedConnection);
+
+    if (_droppedLines)
+        qWarning() << Q_FUNC_INFO << _droppedLines << "lines were dropped, the writer could not keep up";
+}
+
+int TrafficCapture::registerServer(const QString &serverUrl)
+{
+    QMutexLocker locker(&_mutex);
+    int serverId = _servers.count();
+    _servers[serverId] = serverUrl;
+
+    if (_isEnabled)
+        appendRecord(ServerRecord, serverId, serverUrl.toUtf8());
+
+    return serverId;
+}
+
+void TrafficCapture::record(int serverId, RecordType type, const QByteArray &data)
+{
+    QMutexLocker locker(&_mutex);
+    if (!_isEnabled)
+        return;
+
+    QByteArray &partialLine = _partialLines[qMakePair(serverId, (int)type)];
+    partialLine.append(data);
+
+    int start = 0, end;
+    while ((end = partialLine.indexOf('\n', start)) >= 0)
+    {
+        int length = end - start;
+        if (length > 0 && partialLine.at(end - 1) == '\r')
+            length--;
+        if (length > 0)
+            appendRecord(type, serverId, partialLine.mid(start, length));
+        start = end + 1;
+    }
+    partialLine.remove(0, start);
+
+    if (partialLine.length() > TRAFFICCAPTURE_MAX_LINE)
+    {
+        appendRecord(type, serverId, partialLine);
+        partialLine.clear();
+    }
+}
+
+void TrafficCapture::appendRecord(RecordType type, int serverId, const QByteArray &data)
+{
+    // Server records are never dropped, the lines could not be told apart without them
+    if (type != ServerRecord && _pending.length() + data.length() > TRAFFICCAPTURE_MAX_PENDING)
+    {
+        _droppedLines++;
+        return;
+    }
+
+#if QT_VERSION >= 0x040800
+    quint64 timestamp = _clock.nsecsElapsed() / 1000;
+#else
+    quint64 timestamp = _clock.elapsed() * 1000;
+#endif
+
+    QDataStream stream(&_pending, QIODevice::WriteOnly | QIODevice::Append);
+    stream << (quint8)type << (quint16)serverId << timestamp << data;
+}
+
+QByteArray TrafficCapture::takePending()
+{
+    QMutexLocker locker(&_mutex);
+    QByteArray pending = _pending;
+    _pending.clear();
+    return pending;
+}
+
+TrafficCaptureWriter::TrafficCaptureWriter(TrafficCapture *capture) :
+    _capture(capture),
+    _file(new QFile(this)),
+    _timer(new QTimer(this))
+{
+    _timer->setInterval(TRAFFICCAPTURE_FLUSH_INTERVAL);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+bool TrafficCaptureWriter::open(const QString &path)
+{
+    _file->setFileName(path);
+    if (!_file->open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << Q_FUNC_INFO << "can't open" << path << "for writing:" << _file->errorString();
+        return false;
+    }
+
+    QDataStream stream(_file);
+    stream << (quint32)TRAFFICCAPTURE_MAGIC << (quint16)TRAFFICCAPTURE_VERSION;
+    _timer->start();
+    return true;
+}
+
+void TrafficCaptureWriter::close()
+{
+    if (!_file->isOpen())
+        return;
+
+    _timer->stop();
+    flush();
+    _file->close();
+}
+
+void TrafficCaptureWriter::flush()
+{
+    QByteArray pending = _capture->takePending();
+    if (!pending.isEmpty() && _file->write(pending) != pending.length())
+        qWarning() << Q_FUNC_INFO << "can't write the capture:" << _file->errorString();
+}
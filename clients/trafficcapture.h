@@ -0,0 +1,145 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+
+class QFile;
+class QThread;
+class QTimer;
+
+// Capture file format, every number is big endian:
+//   header: quint32 magic (TRAFFICCAPTURE_MAGIC), quint16 version
+//   records: quint8 type, quint16 server id, quint64 microseconds since
+//            the capture started, quint32 length, the line without CR-LF
+// A server record carries the address of the server with the given id.
+#define TRAFFICCAPTURE_MAGIC 0x49524350
+#define TRAFFICCAPTURE_VERSION 1
+
+class TrafficCaptureWriter;
+
+// Opt-in capture of the raw lines sent to and received from the servers,
+// to reproduce performance problems with tools/replay. Lines are recorded
+// on the thread of the sockets and written by a worker thread. The memory
+// used for the lines not yet written is bounded, lines beyond it are
+// dropped and counted.
+
+class TrafficCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum RecordType
+    {
+        ServerRecord = 0,
+        InboundRecord = 1,
+        OutboundRecord = 2
+    };
+
+private:
+    QThread *_thread;
+    TrafficCaptureWriter *_writer;
+    QElapsedTimer _clock;
+    QMutex _mutex;
+    QByteArray _pending;
+    QHash<int, QString> _servers;
+    // Incomplete lines of every server and direction
+    QHash<QPair<int, int>, QByteArray> _partialLines;
+    int _droppedLines;
+    bool _isEnabled;
+
+    static TrafficCapture *_instance;
+
+    explicit TrafficCapture();
+    void appendRecord(RecordType type, int serverId, const QByteArray &data);
+
+public:
+    ~TrafficCapture();
+    static TrafficCapture *instance();
+    static bool isEnabled() { return _instance && _instance->_isEnabled; }
+
+    bool start(const QString &path);
+    void stop();
+    int droppedLines() const { return _droppedLines; }
+
+    // Gives an id to a server, which is used in its records
+    int registerServer(const QString &serverUrl);
+    // Records the lines in the data, the last incomplete line is kept until the rest arrives
+    void record(int serverId, RecordType type, const QByteArray &data);
+    // Called by the writer, returns the records that are not yet written
+    QByteArray takePending();
+
+};
+
+// Lives on the thread of the capture and writes the records to the file.
+
+class TrafficCaptureWriter : public QObject
+{
+    Q_OBJECT
+    TrafficCapture *_capture;
+    QFile *_file;
+    QTimer *_timer;
+
+public:
+    explicit TrafficCaptureWriter(TrafficCapture *capture);
+
+public slots:
+    bool open(const QString &path);
+    void close();
+
+private slots:
+    void flush();
+
+};
+
+// Socket which records everything written to it, subclasses QTcpSocket or
+// QSslSocket. The inbound side is recorded by the client from readyRead(),
+// because reading may not go through readData().
+
+template <class Socket>
+class TrafficCaptureSocket : public Socket
+{
+    int _serverId;
+
+public:
+    explicit TrafficCaptureSocket(int serverId, QObject *parent = 0) :
+        Socket(parent),
+        _serverId(serverId)
+    {
+    }
+
+    int serverId() const { return _serverId; }
+
+protected:
+    qint64 writeData(const char *data, qint64 length)
+    {
+        qint64 written = Socket::writeData(data, length);
+        if (written > 0 && TrafficCapture::isEnabled())
+            TrafficCapture::instance()->record(_serverId, TrafficCapture::OutboundRecord, QByteArray(data, written));
+        return written;
+    }
+
+};
+
+#endif // TRAFFICCAPTURE_H
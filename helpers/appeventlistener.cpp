@@ -19,15 +19,26 @@
 #include <QtDBus/QDBusConnection>
 
 #include "helpers/notifier.h"
+#include "helpers/startupprofiler.h"
+#include "helpers/stallwatchdog.h"
+#include "helpers/tracer.h"
 #include "appeventlistener.h"
 #include "model/ircmodel.h"
+#include "model/metrics.h"
 
 AppEventListener::AppEventListener(IrcModel *model) :
     QObject(model),
-    _model(model)
+    _model(model),
+    _metrics(new Metrics(model))
+{
+}
+
+void AppEventListener::registerOnSessionBus()
 {
     QDBusConnection::sessionBus().registerService("net.venemo.ircchatter");
     QDBusConnection::sessionBus().registerObject("/", this, QDBusConnection::ExportAllSlots);
+    QDBusConnection::sessionBus().registerObject("/metrics", _metrics, QDBusConnection::ExportAllSlots);
+    StartupProfiler::mark("registered on the session bus");
 }
 
 bool AppEventListener::eventFilter(QObject *obj, QEvent *event)
@@ -51,3 +62,35 @@ void AppEventListener::activateApplication()
     qDebug() << "activating application";
     emit applicationActivated();
 }
+
+void AppEventListener::startTracing()
+{
+    Tracer::instance()->clear();
+    Tracer::instance()->setEnabled(true);
+}
+
+void AppEventListener::stopTracing()
+{
+    Tracer::instance()->setEnabled(false);
+}
+
+bool AppEventListener::exportTrace(const QString &path)
+{
+    return Tracer::instance()->exportTo(path);
+}
+
+void AppEventListener::startStallWatchdog()
+{
+    StallWatchdog::instance()->start();
+}
+
+void AppEventListener::stopStallWatchdog()
+{
+    StallWatchdog::instance()->stop();
+    StallWatchdog::instance()->logReport();
+}
+
+QString AppEventListener::stallReport()
+{
+    return StallWatchdog::instance()->report();
+}
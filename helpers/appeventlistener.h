@@ -21,19 +21,34 @@
 #include <QtCore/QObject>
 
 class IrcModel;
+class Metrics;
 
 class AppEventListener : public QObject
 {
     Q_OBJECT
     Q_CLASSINFO("D-Bus Interface", "net.venemo.ircchatter")
     IrcModel *_model;
+    Metrics *_metrics;
 
 public:
     explicit AppEventListener(IrcModel *model);
+    Metrics *metrics() { return _metrics; }
     bool eventFilter(QObject *obj, QEvent *event);
 
 public slots:
     void activateApplication();
+    // Hot path tracing, see Tracer
+    void startTracing();
+    void stopTracing();
+    bool exportTrace(const QString &path);
+    // Event loop stalls, see StallWatchdog
+    void startStallWatchdog();
+    void stopStallWatchdog();
+    QString stallReport();
+
+private slots:
+    // Not a public slot, so that it isn't exported on the bus
+    void registerOnSessionBus();
 
 signals:
     void applicationActivated();
@@ -15,47 +15,111 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 // Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
-//
-// Authors of code borrowed from Konversation (colorForNick method):
-// Copyright (C) 2006 Michael Kreitzer <mrgrim@gr1m.org>
 
-#include <QtCore/QList>
 #include "channelhelper.h"
 
-QList<QString> *_colors = 0;
-QString _ownNickColor("#000000");
+// Limit for the nicks remembered by a NickStyleCache, it starts over when reached
+#define NICKSTYLECACHE_MAX_NICKS 4096
 
-// This code is copypasted from Konversation (and modified by Timur Kristóf) - I hereby thank its authors
-const QString &ChannelHelper::colorForNick(const QString &nick, const QString &ownNick)
+static QStringList _colors;
+static const QString _ownNickColor("#000000");
+
+QStringList ChannelHelper::defaultNickColors()
 {
-    if (!_colors)
+    if (_colors.isEmpty())
     {
-        _colors = new QList<QString>();
-        // Red
-        _colors->append("#ff0000");
-        // Green
-        _colors->append("#00ff00");
-        // Blue
-        _colors->append("#0000ff");
-        // Dark purple
-        _colors->append("#400758");
-        // Dark green
-        _colors->append("#0c5807");
-        // Dark orange
-        _colors->append("#ba770e");
-        // Yellowish green (my favourite colour)
-        _colors->append("#73ba0e");
-        // Yellow
-        _colors->append("#cec700");
+        _colors
+                // Red
+                << "#ff0000"
+                // Green
+                << "#00ff00"
+                // Blue
+                << "#0000ff"
+                // Dark purple
+                << "#400758"
+                // Dark green
+                << "#0c5807"
+                // Dark orange
+                << "#ba770e"
+                // Yellowish green (my favourite colour)
+                << "#73ba0e"
+                // Yellow
+                << "#cec700";
     }
 
+    return _colors;
+}
+
+int ChannelHelper::colorIndexForNick(const QString &nick, int paletteSize)
+{
+    // FNV-1a over the lowercase nick, similar nicks end up far apart unlike with a sum
+    quint32 hash = 2166136261u;
+    QString lower = nick.toLower();
+
+    for (int index = 0; index < lower.length(); index++)
+    {
+        ushort c = lower[index].unicode();
+        hash = (hash ^ (c & 0xff)) * 16777619u;
+        hash = (hash ^ (c >> 8)) * 16777619u;
+    }
+
+    return paletteSize > 0 ? hash % paletteSize : 0;
+}
+
+const QString &ChannelHelper::colorForNick(const QString &nick, const QString &ownNick)
+{
     if (nick == ownNick)
         return _ownNickColor;
 
-    int nickvalue = 0;
+    defaultNickColors();
+    return _colors[colorIndexForNick(nick, _colors.count())];
+}
+
+NickStyleCache::NickStyleCache() :
+    _palette(ChannelHelper::defaultNickColors())
+{
+}
+
+NickStyleCache::NickStyle NickStyleCache::createStyle(const QString &nick, const QString &color)
+{
+    NickStyle style;
+    style.color = color;
+    style.link = "<a href='user://" + nick + "' style='text-decoration: none; color: " + color + "'>" + nick + "</a>";
+    style.span = "<span style='color: " + color + "'>" + nick + "</span>";
+    return style;
+}
 
-    for (int index = 0; index < nick.length(); index++)
-        nickvalue += nick[index].unicode();
+NickStyleCache::NickStyle NickStyleCache::style(const QString &nick, const QString &ownNick)
+{
+    if (nick == ownNick)
+    {
+        if (_ownNick != ownNick)
+        {
+            _ownNick = ownNick;
+            _ownStyle = createStyle(ownNick, _ownNickColor);
+        }
+
+        return _ownStyle;
+    }
 
-    return (*_colors)[nickvalue % _colors->count()];
+    QHash<QString, NickStyle>::const_iterator i = _styles.constFind(nick);
+    if (i != _styles.constEnd())
+        return i.value();
+
+    if (_styles.count() >= NICKSTYLECACHE_MAX_NICKS)
+        _styles.clear();
+
+    return *_styles.insert(nick, createStyle(nick, _palette[ChannelHelper::colorIndexForNick(nick, _palette.count())]));
+}
+
+void NickStyleCache::setPalette(const QStringList &palette)
+{
+    _palette = palette.isEmpty() ? ChannelHelper::defaultNickColors() : palette;
+    clear();
+}
+
+void NickStyleCache::clear()
+{
+    _styles.clear();
+    _ownNick.clear();
 }
@@ -19,12 +19,48 @@
 #ifndef CHANNELHELPER_H
 #define CHANNELHELPER_H
 
+#include <QtCore/QHash>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 
 class ChannelHelper
 {
 public:
     static const QString &colorForNick(const QString &nick, const QString &ownNick);
+    static int colorIndexForNick(const QString &nick, int paletteSize);
+    static QStringList defaultNickColors();
+};
+
+// Remembers the colour and the markup of every nick seen on a server,
+// so that rendering a line only appends strings that are already built.
+// Nicks are case insensitive on IRC, so are their colours.
+
+class NickStyleCache
+{
+public:
+    struct NickStyle
+    {
+        QString color;
+        // Nick linked to its query, used for messages
+        QString link;
+        // Coloured nick, used for actions
+        QString span;
+    };
+
+private:
+    QHash<QString, NickStyle> _styles;
+    QStringList _palette;
+    QString _ownNick;
+    NickStyle _ownStyle;
+
+    static NickStyle createStyle(const QString &nick, const QString &color);
+
+public:
+    NickStyleCache();
+    // A copy, the next call may invalidate what the cache holds
+    NickStyle style(const QString &nick, const QString &ownNick);
+    void setPalette(const QStringList &palette);
+    void clear();
 };
 
 #endif // CHANNELHELPER_H
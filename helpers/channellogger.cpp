@@ -0,0 +1,341 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMetaObject>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSettings>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+#include "channellogger.h"
+#include "tracer.h"
+#include "model/settings/appsettings.h"
+
+// Time between two writes of the logs
+#define CHANNELLOGGER_FLUSH_INTERVAL 1000
+// Records after which the writer is woken up without waiting for the timer
+#define CHANNELLOGGER_BATCH_SIZE 4096
+// Records that may wait for the writer, about 30 seconds of a very busy network
+#define CHANNELLOGGER_MAX_PENDING 300000
+// Time between two syncs with SyncPeriodically
+#define CHANNELLOGGER_SYNC_INTERVAL 30000
+
+ChannelLogger *ChannelLogger::_instance = 0;
+
+static QString fileNameFor(const QString &name)
+{
+    // Channel names may contain anything but spaces, commas and BEL
+    QString result = name.toLower();
+    result.replace('/', '_');
+    result.replace('\\', '_');
+    return result.startsWith('.') ? "_" + result : result;
+}
+
+ChannelLogger::ChannelLogger() :
+    QObject(QCoreApplication::instance()),
+    _thread(new QThread(this)),
+    _writer(new ChannelLoggerWriter(this)),
+    _appSettings(0),
+    _droppedRecords(0),
+    _isEnabled(false),
+    _isFlushRequested(false),
+    _format(Structured),
+    _syncPolicy(SyncNever)
+{
+    _writer->moveToThread(_thread);
+    _thread->start(QThread::LowPriority);
+}
+
+ChannelLogger::~ChannelLogger()
+{
+    stop();
+    _thread->quit();
+    _thread->wait();
+    delete _writer;
+    _instance = 0;
+}
+
+ChannelLogger *ChannelLogger::instance()
+{
+    if (!_instance)
+        _instance = new ChannelLogger();
+
+    return _instance;
+}
+
+QString ChannelLogger::defaultDirectory()
+{
+    return QFileInfo(QSettings().fileName()).absolutePath() + "/logs";
+}
+
+void ChannelLogger::log(const QString &server, const QString &channel, const QString &type, const QString &nick, const QString &text, qint64 time)
+{
+    ChannelLogRecord record;
+    record.time = time >= 0 ? time : QDateTime::currentMSecsSinceEpoch();
+    record.server = server;
+    record.channel = channel;
+    record.type = type;
+    record.nick = nick;
+    record.text = text;
+
+    QMutexLocker locker(&_instance->_mutex);
+
+    if (_instance->_pending.count() >= CHANNELLOGGER_MAX_PENDING)
+    {
+        _instance->_droppedRecords++;
+        return;
+    }
+
+    _instance->_pending.append(record);
+
+    // A burst is written in big batches, without waiting for the timer
+    if (_instance->_pending.count() >= CHANNELLOGGER_BATCH_SIZE && !_instance->_isFlushRequested)
+    {
+        _instance->_isFlushRequested = true;
+        QMetaObject::invokeMethod(_instance->_writer, "flush", Qt::QueuedConnection);
+    }
+}
+
+bool ChannelLogger::start(const QString &directory, int format, int syncPolicy)
+{
+    if (_isEnabled)
+        stop();
+
+    bool opened = false;
+    QMetaObject::invokeMethod(_writer, "open", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, opened),
+                              Q_ARG(QString, directory), Q_ARG(int, format), Q_ARG(int, syncPolicy));
+    _isEnabled = opened;
+    _format = format;
+    _syncPolicy = syncPolicy;
+
+    if (opened)
+        qDebug() << Q_FUNC_INFO << "logging the channels to" << directory;
+    return opened;
+}
+
+void ChannelLogger::stop()
+{
+    if (!_isEnabled)
+        return;
+
+    _isEnabled = false;
+    // The writer takes the remaining records before closing the files
+    QMetaObject::invokeMethod(_writer, "close", Qt::BlockingQueuedConnection);
+
+    // What came in while the writer was closing has no file to go to anymore
+    QMutexLocker locker(&_mutex);
+    _droppedRecords += _pending.count();
+    _pending.clear();
+    _isFlushRequested = false;
+    quint64 dropped = _droppedRecords;
+    locker.unlock();
+
+    if (dropped)
+        qWarning() << Q_FUNC_INFO << dropped << "records were dropped, the disk couldn't keep up";
+}
+
+void ChannelLogger::followSettings(AppSettings *appSettings)
+{
+    _appSettings = appSettings;
+    connect(appSettings, SIGNAL(logChannelsChanged()), this, SLOT(applySettings()));
+    connect(appSettings, SIGNAL(logFormatChanged()), this, SLOT(applySettings()));
+    connect(appSettings, SIGNAL(logSyncPolicyChanged()), this, SLOT(applySettings()));
+    applySettings();
+}
+
+void ChannelLogger::applySettings()
+{
+    bool shouldLog = _appSettings->logChannels();
+    int format = _appSettings->logFormat(), syncPolicy = _appSettings->logSyncPolicy();
+
+    // The writer is reopened when the format or the policy changes
+    if (_isEnabled && (!shouldLog || format != _format || syncPolicy != _syncPolicy))
+        stop();
+    if (shouldLog && !_isEnabled)
+        start(defaultDirectory(), format, syncPolicy);
+}
+
+quint64 ChannelLogger::droppedRecords()
+{
+    QMutexLocker locker(&_mutex);
+    return _droppedRecords;
+}
+
+QList<ChannelLogRecord> ChannelLogger::takePending()
+{
+    QMutexLocker locker(&_mutex);
+    QList<ChannelLogRecord> pending = _pending;
+    _pending.clear();
+    _isFlushRequested = false;
+    return pending;
+}
+
+ChannelLoggerWriter::ChannelLoggerWriter(ChannelLogger *logger) :
+    _logger(logger),
+    _format(ChannelLogger::Structured),
+    _syncPolicy(ChannelLogger::SyncNever),
+    _timer(new QTimer(this)),
+    _cachedSecond(-1)
+{
+    _timer->setInterval(CHANNELLOGGER_FLUSH_INTERVAL);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+bool ChannelLoggerWriter::open(const QString &directory, int format, int syncPolicy)
+{
+    if (!QDir().mkpath(directory))
+    {
+        qWarning() << Q_FUNC_INFO << "can't create" << directory;
+        return false;
+    }
+
+    _directory = directory;
+    _format = format;
+    _syncPolicy = syncPolicy;
+    _syncClock.start();
+    _timer->start();
+    return true;
+}
+
+void ChannelLoggerWriter::close()
+{
+    _timer->stop();
+    flush();
+
+    for (QHash<QString, LogFile>::iterator i = _files.begin(); i != _files.end(); ++i)
+    {
+        writeFile(i.value(), _syncPolicy != ChannelLogger::SyncNever);
+        delete i.value().file;
+    }
+    _files.clear();
+}
+
+void ChannelLoggerWriter::updateTimeCache(qint64 time)
+{
+    qint64 second = time / 1000;
+    if (second == _cachedSecond)
+        return;
+
+    QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(time);
+    _cachedSecond = second;
+    _cachedDay = dateTime.toString("yyyy-MM-dd");
+    _cachedTime = dateTime.toString("HH:mm:ss");
+    _cachedTimestamp = dateTime.toUTC().toString(Qt::ISODate);
+}
+
+ChannelLoggerWriter::LogFile &ChannelLoggerWriter::fileFor(const ChannelLogRecord &record)
+{
+    QString key = record.server + " " + record.channel.toLower();
+    QHash<QString, LogFile>::iterator i = _files.find(key);
+
+    if (i != _files.end())
+    {
+        if (i.value().day == _cachedDay)
+            return i.value();
+
+        // A new day, the log of the last one is finished
+        writeFile(i.value(), _syncPolicy != ChannelLogger::SyncNever);
+        delete i.value().file;
+        _files.erase(i);
+    }
+
+    QString serverDirectory = _directory + "/" + fileNameFor(record.server);
+    QDir().mkpath(serverDirectory);
+
+    LogFile logFile;
+    logFile.file = new QFile(serverDirectory + "/" + fileNameFor(record.channel) + "-" + _cachedDay
+                             + (_format == ChannelLogger::PlainText ? ".log" : ".jsonl"));
+    logFile.day = _cachedDay;
+    logFile.isUnsynced = false;
+
+    if (!logFile.file->open(QIODevice::WriteOnly | QIODevice::Append))
+        qWarning() << Q_FUNC_INFO << "can't open" << logFile.file->fileName() << "for writing:" << logFile.file->errorString();
+
+    return _files.insert(key, logFile).value();
+}
+
+void ChannelLoggerWriter::writeFile(LogFile &logFile, bool sync)
+{
+    if (logFile.batch.length() && logFile.file->isOpen())
+    {
+        logFile.file->write(logFile.batch);
+        logFile.file->flush();
+        logFile.isUnsynced = true;
+    }
+    logFile.batch.clear();
+
+#if defined(Q_OS_UNIX)
+    if (sync && logFile.isUnsynced)
+        ::fsync(logFile.file->handle());
+#endif
+    if (sync)
+        logFile.isUnsynced = false;
+}
+
+QString ChannelLoggerWriter::formatRecord(const ChannelLogRecord &record)
+{
+    if (_format == ChannelLogger::Structured)
+    {
+        // Substituted in one pass, the text may contain %1 and the like
+        return QString("{\"time\":\"%1\",\"type\":\"%2\",\"nick\":\"%3\",\"text\":\"%4\"}\n")
+                .arg(_cachedTimestamp, record.type, Tracer::escapeJson(record.nick), Tracer::escapeJson(record.text));
+    }
+
+    QString prefix = "[" + _cachedTime + "] ";
+    QString line;
+
+    if (record.type == "message")
+        line = prefix + "<" + record.nick + "> " + record.text;
+    else if (record.type == "action")
+        line = prefix + "* " + record.nick + " " + record.text;
+    else
+        line = prefix + "-!- " + record.type + (record.nick.length() ? " " + record.nick : QString()) + (record.text.length() ? ": " + record.text : QString());
+
+    // Every line of a multi-line text gets the time
+    line.replace('\n', "\n" + prefix);
+    return line + "\n";
+}
+
+void ChannelLoggerWriter::flush()
+{
+    QList<ChannelLogRecord> records = _logger->takePending();
+
+    foreach (const ChannelLogRecord &record, records)
+    {
+        updateTimeCache(record.time);
+        fileFor(record).batch += formatRecord(record).toUtf8();
+    }
+
+    bool sync = _syncPolicy == ChannelLogger::SyncEveryBatch
+            || (_syncPolicy == ChannelLogger::SyncPeriodically && _syncClock.elapsed() >= CHANNELLOGGER_SYNC_INTERVAL);
+    if (sync)
+        _syncClock.restart();
+
+    // One sequential write for every file that has anything new
+    for (QHash<QString, LogFile>::iterator i = _files.begin(); i != _files.end(); ++i)
+        writeFile(i.value(), sync);
+}
@@ -0,0 +1,144 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef CHANNELLOGGER_H
+#define CHANNELLOGGER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+class QFile;
+class QThread;
+class QTimer;
+class AppSettings;
+class ChannelLoggerWriter;
+
+struct ChannelLogRecord
+{
+    // Milliseconds since the epoch, formatted by the writer
+    qint64 time;
+    QString server, channel, type, nick, text;
+};
+
+// Persists the events of the channels, one file for every channel and day:
+// <directory>/<server>/<channel>-<yyyy-MM-dd>.log as plain text, or .jsonl
+// with one JSON object on every line. The channels only enqueue the records,
+// a worker thread formats them and writes them in batches, one write for
+// every file. The queue is bounded: if the disk can't keep up, the records
+// that don't fit are counted and dropped.
+
+class ChannelLogger : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Format
+    {
+        PlainText = 0,
+        Structured
+    };
+
+    // When the written logs are synced from the page cache to the disk
+    enum SyncPolicy
+    {
+        SyncNever = 0,
+        SyncEveryBatch,
+        SyncPeriodically
+    };
+
+private:
+    QThread *_thread;
+    ChannelLoggerWriter *_writer;
+    AppSettings *_appSettings;
+    QMutex _mutex;
+    QList<ChannelLogRecord> _pending;
+    quint64 _droppedRecords;
+    bool _isEnabled, _isFlushRequested;
+    int _format, _syncPolicy;
+
+    static ChannelLogger *_instance;
+
+    explicit ChannelLogger();
+
+public:
+    ~ChannelLogger();
+    static ChannelLogger *instance();
+    static bool isEnabled() { return _instance && _instance->_isEnabled; }
+    // The time is in milliseconds since the epoch, -1 means now
+    static void log(const QString &server, const QString &channel, const QString &type, const QString &nick, const QString &text, qint64 time = -1);
+    static QString defaultDirectory();
+
+    bool start(const QString &directory, int format = Structured, int syncPolicy = SyncNever);
+    void stop();
+    // Starts and stops the logger as the settings of the application say, in the default directory
+    void followSettings(AppSettings *appSettings);
+    quint64 droppedRecords();
+    // Called by the writer, returns the records that are not yet written
+    QList<ChannelLogRecord> takePending();
+
+private slots:
+    void applySettings();
+
+};
+
+// Lives on the thread of the logger and writes the records to the files.
+
+class ChannelLoggerWriter : public QObject
+{
+    Q_OBJECT
+
+    struct LogFile
+    {
+        QFile *file;
+        QString day;
+        QByteArray batch;
+        bool isUnsynced;
+    };
+
+    ChannelLogger *_logger;
+    QString _directory;
+    int _format, _syncPolicy;
+    QHash<QString, LogFile> _files;
+    QTimer *_timer;
+    QElapsedTimer _syncClock;
+    // The formatted times of the last second, which most records share
+    qint64 _cachedSecond;
+    QString _cachedDay, _cachedTime, _cachedTimestamp;
+
+    void updateTimeCache(qint64 time);
+    LogFile &fileFor(const ChannelLogRecord &record);
+    void writeFile(LogFile &logFile, bool sync);
+    QString formatRecord(const ChannelLogRecord &record);
+
+public:
+    explicit ChannelLoggerWriter(ChannelLogger *logger);
+
+public slots:
+    bool open(const QString &directory, int format, int syncPolicy);
+    void close();
+
+private slots:
+    void flush();
+
+};
+
+#endif // CHANNELLOGGER_H
@@ -24,11 +24,21 @@
 #include "model/settings/appsettings.h"
 #include "model/channelmodel.h"
 #include "model/servermodel.h"
+#include "model/ignorefilter.h"
 
-CommandParser::CommandParser(ChannelModel *parent, AbstractIrcClient *ircClient, AppSettings *appSettings) :
+static QString escapeHtml(QString str)
+{
+    str.replace('&', "&amp;");
+    str.replace('<', "&lt;");
+    str.replace('>', "&gt;");
+    return str;
+}
+
+CommandParser::CommandParser(ChannelModel *parent, AbstractIrcClient *ircClient, AppSettings *appSettings, IgnoreFilter *ignoreFilter) :
     QObject(parent),
     _ircClient(ircClient),
-    _appSettings(appSettings)
+    _appSettings(appSettings),
+    _ignoreFilter(ignoreFilter)
 {
 }
 
@@ -169,6 +179,54 @@ void CommandParser::parseAndSendCommand(const QString &channelName, const QStrin
         else
             emit commandParseError("Invalid command. Correct usage: '/whois &lt;user name&gt;'");
     }
+    else if (commandParts[0] == "/ignore")
+    {
+        if (n == 1)
+        {
+            QStringList rules = _ignoreFilter->rules();
+            QString list;
+
+            for (int i = 0; i < rules.count(); i++)
+                list += "<br />" + escapeHtml(rules[i]) + " (" + QString::number(_ignoreFilter->hits(i)) + " hits)";
+
+            emit commandParseError(rules.count() ? "Ignore rules:" + list : "There are no ignore rules.");
+        }
+        else
+        {
+            QString rule = msg.mid(commandParts[0].length() + 1).trimmed();
+
+            if (IgnoreFilter().compile(QStringList(rule)).count())
+            {
+                emit commandParseError("Invalid ignore rule. Correct usage: '/ignore &lt;nick or hostmask or /regexp/&gt; [event types] [channels]'");
+            }
+            else
+            {
+                // The model compiles the rules again when the setting changes
+                _appSettings->setIgnoreRules(_appSettings->ignoreRules() << rule);
+                emit commandParseError("Ignoring " + escapeHtml(rule));
+            }
+        }
+    }
+    else if (commandParts[0] == "/unignore")
+    {
+        if (n > 1)
+        {
+            QString rule = msg.mid(commandParts[0].length() + 1).trimmed();
+            QStringList rules = _appSettings->ignoreRules();
+
+            if (rules.removeAll(rule))
+            {
+                _appSettings->setIgnoreRules(rules);
+                emit commandParseError("Not ignoring " + escapeHtml(rule) + " any more");
+            }
+            else
+            {
+                emit commandParseError("There is no such ignore rule.");
+            }
+        }
+        else
+            emit commandParseError("Invalid command. Correct usage: '/unignore &lt;rule&gt;'");
+    }
     else if (commandParts[0] == "/dumphtml")
     {
         if (n > 1)
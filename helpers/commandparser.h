@@ -24,16 +24,19 @@
 class AbstractIrcClient;
 class AppSettings;
 class ChannelModel;
+class IgnoreFilter;
 
 class CommandParser : public QObject
 {
     Q_OBJECT
     AbstractIrcClient *_ircClient;
     AppSettings *_appSettings;
+    IgnoreFilter *_ignoreFilter;
 
 public:
-    explicit CommandParser(ChannelModel *parent, AbstractIrcClient *ircClient, AppSettings *appSettings);
+    explicit CommandParser(ChannelModel *parent, AbstractIrcClient *ircClient, AppSettings *appSettings, IgnoreFilter *ignoreFilter);
     void parseAndSendCommand(const QString &channelName, const QString &command);
+    void setIrcClient(AbstractIrcClient *ircClient) { _ircClient = ircClient; }
 
 signals:
     void commandParseError(const QString &error);
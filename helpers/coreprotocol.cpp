@@ -0,0 +1,321 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QSharedMemory>
+
+#include <cstddef>
+#include <cstring>
+
+#include "coreprotocol.h"
+
+#define EVENTRING_MAGIC 0x49524345
+#define EVENTRING_SLOT_COUNT 2048
+// Enough for a whole IRC line, longer events continue in the following slots
+#define EVENTRING_SLOT_SIZE 1024
+// Slots of one event at most, longer events are not published
+#define EVENTRING_MAX_EVENT_SLOTS 16
+// Type of the slots which continue the text of the event before them
+#define EVENTRING_CONTINUATION 0xffff
+// The writer may be filling this many slots after the newest one, the readers stay behind them
+#define EVENTRING_READABLE_SLOTS (EVENTRING_SLOT_COUNT - EVENTRING_MAX_EVENT_SLOTS)
+
+struct EventRing::Header
+{
+    quint32 magic, version, slotCount, slotSize;
+    // Sequence of the next event, only the core writes it
+    int writeSequence;
+    // Number of slots that were ever written, up to the slot count. Only the core uses it.
+    quint32 writtenSlots;
+};
+
+struct EventRing::Slot
+{
+    quint16 type, serverId;
+    quint16 lengths[CoreProtocol::FieldCount];
+    // Number of slots the event takes, this one included
+    quint16 slotCount;
+    qint64 time;
+    ushort text[1];
+};
+
+#define EVENTRING_TEXT_CAPACITY ((EVENTRING_SLOT_SIZE - offsetof(EventRing::Slot, text)) / sizeof(ushort))
+#define EVENTRING_HEADER_SIZE 64
+
+static QAtomicInt *atomicSequence(void *address)
+{
+    // QAtomicInt has the layout of an int
+    return reinterpret_cast<QAtomicInt*>(address);
+}
+
+static quint32 loadSequence(QAtomicInt *sequence)
+{
+    return (quint32)sequence->fetchAndAddAcquire(0);
+}
+
+QByteArray CoreProtocol::encode(const QStringList &fields)
+{
+    QStringList escaped;
+    foreach (QString field, fields)
+    {
+        field.replace('\\', "\\\\");
+        field.replace('\t', "\\t");
+        field.replace('\n', "\\n");
+        escaped.append(field);
+    }
+
+    return escaped.join("\t").toUtf8() + '\n';
+}
+
+QStringList CoreProtocol::decode(const QByteArray &line)
+{
+    QStringList fields;
+    foreach (const QString &field, QString::fromUtf8(line).remove('\n').split('\t'))
+    {
+        QString unescaped;
+        unescaped.reserve(field.length());
+
+        for (int i = 0; i < field.length(); i++)
+        {
+            if (field[i] == '\\' && i + 1 < field.length())
+            {
+                i++;
+                unescaped += field[i] == 't' ? QChar('\t') : field[i] == 'n' ? QChar('\n') : field[i];
+            }
+            else
+            {
+                unescaped += field[i];
+            }
+        }
+
+        fields.append(unescaped);
+    }
+
+    return fields;
+}
+
+QString CoreProtocol::socketName()
+{
+    QString user = QString::fromLocal8Bit(qgetenv("USER"));
+    return user.length() ? QString(COREPROTOCOL_SOCKET_NAME) + "-" + user : QString(COREPROTOCOL_SOCKET_NAME);
+}
+
+EventRing::EventRing() :
+    _memory(new QSharedMemory()),
+    _readSequence(0)
+{
+}
+
+EventRing::~EventRing()
+{
+    delete _memory;
+}
+
+EventRing::Header *EventRing::header() const
+{
+    return reinterpret_cast<Header*>(_memory->data());
+}
+
+EventRing::Slot *EventRing::slot(quint32 sequence) const
+{
+    char *slots = reinterpret_cast<char*>(_memory->data()) + EVENTRING_HEADER_SIZE;
+    return reinterpret_cast<Slot*>(slots + sequence % EVENTRING_SLOT_COUNT * EVENTRING_SLOT_SIZE);
+}
+
+bool EventRing::create(const QString &key)
+{
+    _memory->setKey(key);
+
+    // A segment left behind by a core that crashed goes away when the last process detaches from it
+    if (_memory->attach())
+        _memory->detach();
+
+    if (!_memory->create(EVENTRING_HEADER_SIZE + EVENTRING_SLOT_COUNT * EVENTRING_SLOT_SIZE))
+    {
+        qWarning() << Q_FUNC_INFO << "can't create the event ring:" << _memory->errorString();
+        return false;
+    }
+
+    memset(_memory->data(), 0, _memory->size());
+    header()->magic = EVENTRING_MAGIC;
+    header()->version = COREPROTOCOL_VERSION;
+    header()->slotCount = EVENTRING_SLOT_COUNT;
+    header()->slotSize = EVENTRING_SLOT_SIZE;
+    return true;
+}
+
+bool EventRing::attach(const QString &key)
+{
+    _memory->setKey(key);
+
+    // Read-write, because reading the sequence is an atomic operation
+    if (!_memory->attach())
+    {
+        qWarning() << Q_FUNC_INFO << "can't attach to the event ring:" << _memory->errorString();
+        return false;
+    }
+
+    if (header()->magic != EVENTRING_MAGIC || header()->version != COREPROTOCOL_VERSION
+            || header()->slotCount != EVENTRING_SLOT_COUNT || header()->slotSize != EVENTRING_SLOT_SIZE)
+    {
+        qWarning() << Q_FUNC_INFO << "the event ring of the core is not compatible";
+        _memory->detach();
+        return false;
+    }
+
+    return true;
+}
+
+QString EventRing::key() const
+{
+    return _memory->key();
+}
+
+quint32 EventRing::writeSequence() const
+{
+    return loadSequence(atomicSequence(&header()->writeSequence));
+}
+
+ushort *EventRing::slotText(quint32 sequence, uint position) const
+{
+    // The text of an event goes on in the text of the slots after its first one
+    return slot(sequence + position / EVENTRING_TEXT_CAPACITY)->text + position % EVENTRING_TEXT_CAPACITY;
+}
+
+void EventRing::publish(int type, int serverId, const QString &channel, const QString &nick, const QString &text, const QString &extra, const QString &hostmask)
+{
+    const QString *fields[CoreProtocol::FieldCount] = { &channel, &nick, &text, &extra, &hostmask };
+    uint textLength = 0;
+    for (int i = 0; i < CoreProtocol::FieldCount; i++)
+        textLength += fields[i]->length();
+
+    // Rather dropped than cut, a cut could split a surrogate pair
+    uint slotCount = qMax((uint)1, (textLength + EVENTRING_TEXT_CAPACITY - 1) / EVENTRING_TEXT_CAPACITY);
+    if (slotCount > EVENTRING_MAX_EVENT_SLOTS)
+    {
+        qWarning() << Q_FUNC_INFO << "the event of type" << type << "is too long for the ring:" << textLength << "characters";
+        return;
+    }
+
+    QAtomicInt *sequence = atomicSequence(&header()->writeSequence);
+    quint32 first = sequence->fetchAndAddRelaxed(0);
+    Slot *s = slot(first);
+
+    s->type = type;
+    s->serverId = serverId;
+    s->slotCount = slotCount;
+    s->time = QDateTime::currentMSecsSinceEpoch();
+    for (uint i = 1; i < slotCount; i++)
+        slot(first + i)->type = EVENTRING_CONTINUATION;
+
+    // The fields are copied straight into the slots, one after the other
+    uint position = 0;
+    for (int i = 0; i < CoreProtocol::FieldCount; i++)
+    {
+        const ushort *source = fields[i]->utf16();
+        uint length = fields[i]->length();
+        s->lengths[i] = length;
+
+        while (length)
+        {
+            uint chunk = qMin(length, (uint)(EVENTRING_TEXT_CAPACITY - position % EVENTRING_TEXT_CAPACITY));
+            memcpy(slotText(first, position), source, chunk * sizeof(ushort));
+            source += chunk;
+            position += chunk;
+            length -= chunk;
+        }
+    }
+
+    header()->writtenSlots = qMin((quint32)EVENTRING_SLOT_COUNT, header()->writtenSlots + slotCount);
+
+    // Publishes the slots to the readers
+    sequence->fetchAndAddRelease(slotCount);
+}
+
+quint32 EventRing::historyLength() const
+{
+    // The slots that were never written are not history, a fresh ring is all zeros
+    return qMin(header()->writtenSlots, (quint32)EVENTRING_READABLE_SLOTS);
+}
+
+void EventRing::seek(quint32 sequence)
+{
+    _readSequence = sequence;
+}
+
+bool EventRing::read(CoreProtocol::Event *event, int *lostEvents)
+{
+    QAtomicInt *sequence = atomicSequence(&header()->writeSequence);
+
+    forever
+    {
+        int behind = (int)(loadSequence(sequence) - _readSequence);
+        if (behind <= 0)
+            return false;
+
+        // The slots after the newest one may be written at any moment
+        if (behind > EVENTRING_READABLE_SLOTS)
+        {
+            *lostEvents += behind - EVENTRING_READABLE_SLOTS;
+            _readSequence += behind - EVENTRING_READABLE_SLOTS;
+        }
+
+        // The rest of an event whose beginning was lost, or was before the history
+        Slot *s = slot(_readSequence);
+        if (s->type == EVENTRING_CONTINUATION)
+        {
+            _readSequence++;
+            continue;
+        }
+
+        event->type = s->type;
+        event->serverId = s->serverId;
+        event->time = s->time;
+
+        // A slot that is being overwritten may have anything in it, the reads stay inside the ring
+        uint slotCount = qBound((uint)1, (uint)s->slotCount, (uint)EVENTRING_MAX_EVENT_SLOTS);
+        uint capacity = slotCount * EVENTRING_TEXT_CAPACITY;
+        uint position = 0;
+        for (int i = 0; i < CoreProtocol::FieldCount; i++)
+        {
+            uint length = qMin((uint)s->lengths[i], capacity - position);
+            event->fields[i].resize(length);
+            ushort *target = reinterpret_cast<ushort*>(event->fields[i].data());
+
+            while (length)
+            {
+                uint chunk = qMin(length, (uint)(EVENTRING_TEXT_CAPACITY - position % EVENTRING_TEXT_CAPACITY));
+                memcpy(target, slotText(_readSequence, position), chunk * sizeof(ushort));
+                target += chunk;
+                position += chunk;
+                length -= chunk;
+            }
+        }
+
+        // If the writer got around to these slots while they were read, the event is lost
+        if ((int)((quint32)sequence->fetchAndAddOrdered(0) - _readSequence) <= EVENTRING_READABLE_SLOTS)
+        {
+            _readSequence += slotCount;
+            return true;
+        }
+
+        (*lostEvents)++;
+        _readSequence++;
+    }
+}
@@ -0,0 +1,140 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef COREPROTOCOL_H
+#define COREPROTOCOL_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+class QSharedMemory;
+
+// The core process (irc-chatter --headless --core) owns the connections and
+// publishes what its clients emit into an event ring in shared memory. Any
+// number of UI processes (irc-chatter --attach) read the ring without
+// locking it, and send their commands to the core through a local socket.
+//
+// Every event has a fixed-size slot, the fields are written into the slot
+// as UTF-16 and read from it by the UIs, without any serialization buffer
+// in between. The text of a long event continues in the following slots.
+// The writer never waits for the readers: a reader which falls behind by
+// more than the ring loses the oldest events, and notices it.
+//
+// The local socket carries tab separated lines, see CoreProtocol::encode.
+//   core -> UI: hello <key> <sequence> <history>,
+//               server <id> <url> <nick> <connected>,
+//               channel <id> <name> <users> <topic>, ready, wake
+//   UI -> core: call <server id> <method> <arguments...>
+
+#define COREPROTOCOL_SOCKET_NAME "irc-chatter-core"
+#define COREPROTOCOL_VERSION 2
+
+namespace CoreProtocol
+{
+    enum EventType
+    {
+        ServerAdded = 0,
+        ServerRemoved,
+        Connected,
+        Disconnected,
+        OwnNick,
+        UserNames,
+        Message,
+        CtcpRequest,
+        CtcpReply,
+        CtcpAction,
+        Part,
+        Join,
+        Topic,
+        Kick,
+        ModeChange,
+        Quit,
+        NickChange,
+        Motd,
+        Error,
+        JoinedChannel,
+        QueriedUser,
+        PartedChannel,
+        ClosedUser
+    };
+
+    // Fields of an event, their meaning depends on the type. The Extra of a
+    // Message or CtcpAction that was played back is its time, in milliseconds
+    // since the epoch. The Hostmask is the prefix of the message the event
+    // came from, the UIs match their ignore rules against it.
+    enum Field
+    {
+        Channel = 0,
+        Nick,
+        Text,
+        Extra,
+        Hostmask,
+        FieldCount
+    };
+
+    struct Event
+    {
+        int type, serverId;
+        qint64 time;
+        QString fields[FieldCount];
+    };
+
+    QByteArray encode(const QStringList &fields);
+    QStringList decode(const QByteArray &line);
+    // Unique for the user, so that the processes of different users don't meet
+    QString socketName();
+}
+
+// A ring of events in shared memory, created by the core and attached to by the UIs
+
+class EventRing
+{
+    QSharedMemory *_memory;
+    // Next sequence to read, only used by readers. The sequences wrap around,
+    // compare them by their difference.
+    quint32 _readSequence;
+
+    struct Header;
+    struct Slot;
+    Header *header() const;
+    Slot *slot(quint32 sequence) const;
+    ushort *slotText(quint32 sequence, uint position) const;
+
+public:
+    EventRing();
+    ~EventRing();
+
+    bool create(const QString &key);
+    bool attach(const QString &key);
+    QString key() const;
+    quint32 writeSequence() const;
+
+    // Writer side
+    void publish(int type, int serverId, const QString &channel = QString(), const QString &nick = QString(),
+                 const QString &text = QString(), const QString &extra = QString(), const QString &hostmask = QString());
+    // Number of slots before the write sequence that hold events a new reader may read
+    quint32 historyLength() const;
+
+    // Reader side
+    void seek(quint32 sequence);
+    quint32 readSequence() const { return _readSequence; }
+    // Returns false when there are no more events, lostEvents is increased when the reader fell behind
+    bool read(CoreProtocol::Event *event, int *lostEvents);
+};
+
+#endif // COREPROTOCOL_H
@@ -0,0 +1,89 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#if defined(HAVE_MNOTIFICATION)
+#include <MNotification>
+#endif
+
+#include <QtCore/QDebug>
+#include "notificationsink.h"
+
+void DebugNotificationSink::publish(const QString &summary, const QString &body)
+{
+    qDebug() << "notification:" << summary << body;
+}
+
+void DebugNotificationSink::unpublishAll()
+{
+    qDebug() << "notifications removed";
+}
+
+#if defined(HAVE_MNOTIFICATION)
+
+MNotificationSink::MNotificationSink() :
+    _isCleanedUp(false)
+{
+}
+
+MNotificationSink::~MNotificationSink()
+{
+    qDeleteAll(_notifications);
+}
+
+void MNotificationSink::removeLeftovers()
+{
+    // Notifications of an earlier run of the application, only listed once
+    QList<MNotification*> notifications = MNotification::notifications();
+    foreach (MNotification *n, notifications)
+        n->remove();
+
+    qDeleteAll(notifications);
+    _isCleanedUp = true;
+}
+
+void MNotificationSink::publish(const QString &summary, const QString &body)
+{
+    if (!_isCleanedUp)
+        removeLeftovers();
+
+    // Removing instead of updating, because the user may have dismissed it already
+    if (MNotification *old = _notifications.take(summary))
+    {
+        old->remove();
+        delete old;
+    }
+
+    MNotification *notification = new MNotification("irc-chatter.irc", summary, body);
+    notification->setIdentifier("irc");
+    notification->setAction(MRemoteAction("net.venemo.ircchatter", "/", "net.venemo.ircchatter", "activateApplication"));
+    notification->publish();
+    _notifications.insert(summary, notification);
+}
+
+void MNotificationSink::unpublishAll()
+{
+    if (!_isCleanedUp)
+        removeLeftovers();
+
+    foreach (MNotification *n, _notifications)
+        n->remove();
+
+    qDeleteAll(_notifications);
+    _notifications.clear();
+}
+
+#endif
@@ -0,0 +1,73 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef NOTIFICATIONSINK_H
+#define NOTIFICATIONSINK_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+// Where the notifications of the Notifier end up. The sink is only used
+// from the worker thread of the Notifier, so it may block. Publishing with
+// the summary of a notification that is already shown replaces it.
+
+class NotificationSink
+{
+public:
+    virtual ~NotificationSink() {}
+    virtual void publish(const QString &summary, const QString &body) = 0;
+    virtual void unpublishAll() = 0;
+
+};
+
+// Only writes the notifications to the debug output, used where the
+// platform has no notifications and as a stand-in for testing.
+
+class DebugNotificationSink : public NotificationSink
+{
+public:
+    virtual void publish(const QString &summary, const QString &body);
+    virtual void unpublishAll();
+
+};
+
+#if defined(HAVE_MNOTIFICATION)
+
+class MNotification;
+
+// Publishes to the notification area of MeeGo. The published notifications
+// are remembered, so they can be replaced without listing every
+// notification of the application over DBus.
+
+class MNotificationSink : public NotificationSink
+{
+    QHash<QString, MNotification*> _notifications;
+    bool _isCleanedUp;
+
+    void removeLeftovers();
+
+public:
+    MNotificationSink();
+    virtual ~MNotificationSink();
+    virtual void publish(const QString &summary, const QString &body);
+    virtual void unpublishAll();
+
+};
+
+#endif
+
+#endif // NOTIFICATIONSINK_H
@@ -16,44 +16,145 @@
 //
 // Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
 
-#if defined(HAVE_MNOTIFICATION)
-#include <MNotification>
-#endif
-
+#include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
 #include "notifier.h"
+#include "notificationsink.h"
 
-void Notifier::notify(const QString &summary, const QString &message)
+// Minimum time between two updates of the notifications
+#define NOTIFIER_INTERVAL 3000
+
+Notifier *Notifier::_instance = 0;
+NotificationSink *Notifier::_sink = 0;
+
+Notifier::Notifier(NotificationSink *sink) :
+    QObject(QCoreApplication::instance()),
+    _thread(new QThread(this)),
+    _worker(new NotifierWorker(sink)),
+    _timer(new QTimer(this))
 {
+    _timer->setInterval(NOTIFIER_INTERVAL);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    _worker->moveToThread(_thread);
+    connect(this, SIGNAL(publishRequested(QString,QString)), _worker, SLOT(publish(QString,QString)));
+    connect(this, SIGNAL(unpublishRequested()), _worker, SLOT(unpublishAll()));
+    _thread->start(QThread::LowPriority);
+}
+
+Notifier::~Notifier()
+{
+    _thread->quit();
+    _thread->wait();
+    delete _worker;
+    _instance = 0;
+}
+
+Notifier *Notifier::instance()
+{
+    if (!_instance)
+    {
+        if (!_sink)
+        {
 #if defined(HAVE_MNOTIFICATION)
-    QList<MNotification*> notifications = MNotification::notifications();
-    foreach (MNotification *n, notifications)
+            _sink = new MNotificationSink();
+#else
+            _sink = new DebugNotificationSink();
+#endif
+        }
+
+        // From now on the worker owns the sink, nothing else may delete it
+        NotificationSink *sink = _sink;
+        _sink = 0;
+        _instance = new Notifier(sink);
+    }
+
+    return _instance;
+}
+
+void Notifier::setSink(NotificationSink *sink)
+{
+    if (_instance)
     {
-        if (n->summary() == summary)
-            n->remove();
+        qWarning() << Q_FUNC_INFO << "the notifier is already running, ignoring the new sink";
+        delete sink;
+        return;
     }
 
-    MNotification *notification = new MNotification("irc-chatter.irc", summary, message);
-    notification->setIdentifier("irc");
-    notification->setAction(MRemoteAction("net.venemo.ircchatter", "/", "net.venemo.ircchatter", "activateApplication"));
+    delete _sink;
+    _sink = sink;
+}
 
-    notification->publish();
-#else
-    Q_UNUSED(summary)
-    Q_UNUSED(message)
-    qDebug() << Q_FUNC_INFO << "Sending notifications is not supported by the current build.";
-#endif
+void Notifier::notify(const QString &summary, const QString &message)
+{
+    instance()->enqueue(summary, message);
 }
 
 void Notifier::unpublish()
 {
-#if defined(HAVE_MNOTIFICATION)
-    QList<MNotification*> notifications = MNotification::notifications();
-    foreach (MNotification *n, notifications)
+    instance()->clear();
+}
+
+void Notifier::enqueue(const QString &summary, const QString &message)
+{
+    _unseenCounts[summary]++;
+    _lastMessages[summary] = message;
+
+    // The first notification goes out right away, the ones after it wait for the interval
+    if (!_timer->isActive())
     {
-        n->remove();
+        flush();
+        _timer->start();
     }
-#else
-    qDebug() << Q_FUNC_INFO << "Unpublishing notifications is not supported by the current build.";
-#endif
+}
+
+void Notifier::flush()
+{
+    if (_lastMessages.isEmpty())
+    {
+        _timer->stop();
+        return;
+    }
+
+    foreach (const QString &summary, _lastMessages.keys())
+    {
+        int count = _unseenCounts.value(summary);
+        QString body = count == 1
+                ? _lastMessages[summary]
+                : QString::number(count) + " new messages, the last one: " + _lastMessages[summary];
+        emit publishRequested(summary, body);
+    }
+
+    _lastMessages.clear();
+}
+
+void Notifier::clear()
+{
+    _timer->stop();
+    _unseenCounts.clear();
+    _lastMessages.clear();
+    emit unpublishRequested();
+}
+
+NotifierWorker::NotifierWorker(NotificationSink *sink) :
+    _sink(sink)
+{
+}
+
+NotifierWorker::~NotifierWorker()
+{
+    delete _sink;
+}
+
+void NotifierWorker::publish(const QString &summary, const QString &body)
+{
+    _sink->publish(summary, body);
+}
+
+void NotifierWorker::unpublishAll()
+{
+    _sink->unpublishAll();
 }
@@ -20,13 +20,70 @@
 #define NOTIFIER_H
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 
-class Notifier
+class QThread;
+class QTimer;
+class NotificationSink;
+class NotifierWorker;
+
+// Publishes notifications through a NotificationSink on a worker thread.
+// Messages with the same summary (ie. from the same channel or user) are
+// aggregated, and updates are published at most once per interval, so a
+// flood of highlights doesn't keep the UI thread busy with DBus calls.
+
+class Notifier : public QObject
 {
+    Q_OBJECT
+    QThread *_thread;
+    NotifierWorker *_worker;
+    QTimer *_timer;
+    // Unseen messages for each summary since the last unpublish
+    QHash<QString, int> _unseenCounts;
+    // Last message for each summary that changed since the last publish
+    QHash<QString, QString> _lastMessages;
+
+    static Notifier *_instance;
+    // The sink given to setSink(), until the notifier starts and the worker takes it over
+    static NotificationSink *_sink;
+
+    explicit Notifier(NotificationSink *sink);
+    void enqueue(const QString &summary, const QString &message);
+    void clear();
+
 public:
+    ~Notifier();
+    static Notifier *instance();
+    // Takes ownership of the sink, must be called before the first notification
+    static void setSink(NotificationSink *sink);
+
     static void notify(const QString &summary, const QString &message);
     static void unpublish();
-    
+
+signals:
+    void publishRequested(const QString &summary, const QString &body);
+    void unpublishRequested();
+
+private slots:
+    void flush();
+
+};
+
+// Lives on the thread of the Notifier and does the actual work with the sink.
+
+class NotifierWorker : public QObject
+{
+    Q_OBJECT
+    NotificationSink *_sink;
+
+public:
+    explicit NotifierWorker(NotificationSink *sink);
+    ~NotifierWorker();
+
+public slots:
+    void publish(const QString &summary, const QString &body);
+    void unpublishAll();
+
 };
 
 #endif // NOTIFIER_H
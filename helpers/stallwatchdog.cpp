@@ -0,0 +1,227 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QMetaObject>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QtAlgorithms>
+
+#include "stallwatchdog.h"
+#include "tracer.h"
+
+// Interval of the heartbeat of the main thread, and of the checks of the worker
+#define STALLWATCHDOG_INTERVAL 50
+// Default for the latency above which the event loop is considered stalled
+#define STALLWATCHDOG_THRESHOLD 200
+// Number of stalling spans listed in the report
+#define STALLWATCHDOG_REPORTED_SPANS 5
+
+// Upper bounds of the buckets of the latency histogram in milliseconds, the last one is open
+static const int _bucketBounds[] = { 16, 33, 50, 100, 200, 500, 1000, 2000 };
+static const int _bucketCount = sizeof(_bucketBounds) / sizeof(int) + 1;
+static const char *_noSpan = "(outside of the trace spans)";
+
+StallWatchdog *StallWatchdog::_instance = 0;
+
+StallWatchdog::StallWatchdog() :
+    QObject(QCoreApplication::instance()),
+    _thread(new QThread(this)),
+    _worker(new StallWatchdogWorker(this)),
+    _heartbeat(new QTimer(this)),
+    _stallSpan(0),
+    _threshold(STALLWATCHDOG_THRESHOLD)
+{
+    _clock.start();
+    _heartbeat->setInterval(STALLWATCHDOG_INTERVAL);
+#if QT_VERSION >= 0x050000
+    _heartbeat->setTimerType(Qt::PreciseTimer);
+#endif
+    connect(_heartbeat, SIGNAL(timeout()), this, SLOT(heartbeat()));
+
+    _worker->moveToThread(_thread);
+    reset();
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stop();
+    delete _worker;
+    _instance = 0;
+}
+
+StallWatchdog *StallWatchdog::instance()
+{
+    if (!_instance)
+        _instance = new StallWatchdog();
+
+    return _instance;
+}
+
+bool StallWatchdog::isRunning() const
+{
+    return _heartbeat->isActive();
+}
+
+void StallWatchdog::setThreshold(int value)
+{
+    _threshold = qMax(STALLWATCHDOG_INTERVAL, value);
+}
+
+void StallWatchdog::start()
+{
+    if (isRunning())
+        return;
+
+    Tracer::setAttributing(true);
+    _expectedBeat = _clock.elapsed() + STALLWATCHDOG_INTERVAL;
+    _lastBeat.fetchAndStoreRelaxed((int)_clock.elapsed());
+    _heartbeat->start();
+
+    // The thread gets the highest priority, it has to run while the main thread is busy
+    _thread->start(QThread::HighestPriority);
+    QMetaObject::invokeMethod(_worker, "start", Qt::QueuedConnection);
+    qDebug() << Q_FUNC_INFO << "watching the event loop, threshold:" << _threshold << "ms";
+}
+
+void StallWatchdog::stop()
+{
+    if (!isRunning())
+        return;
+
+    _heartbeat->stop();
+    QMetaObject::invokeMethod(_worker, "stop", Qt::BlockingQueuedConnection);
+    _thread->quit();
+    _thread->wait();
+    Tracer::setAttributing(false);
+}
+
+void StallWatchdog::reset()
+{
+    _histogram.fill(0, _bucketCount);
+    _stallsBySpan.clear();
+    _stalls = 0;
+    _worstStall = 0;
+    _worstStallSpan.clear();
+}
+
+void StallWatchdog::heartbeat()
+{
+    qint64 now = _clock.elapsed();
+    qint64 latency = qMax((qint64)0, now - _expectedBeat);
+    _expectedBeat = now + STALLWATCHDOG_INTERVAL;
+    _lastBeat.fetchAndStoreRelaxed((int)now);
+
+    int bucket = 0;
+    while (bucket < _bucketCount - 1 && latency >= _bucketBounds[bucket])
+        bucket++;
+    _histogram[bucket]++;
+
+    // Taken in any case, so that a span seen during a short delay is not blamed for the next stall
+    const char *span = _stallSpan.fetchAndStoreRelaxed(0);
+    if (latency < _threshold)
+        return;
+
+    QString spanName = QString::fromLatin1(span ? span : _noSpan);
+    _stalls++;
+    _stallsBySpan[spanName]++;
+    if (latency > _worstStall)
+    {
+        _worstStall = latency;
+        _worstStallSpan = spanName;
+    }
+
+    qWarning() << "event loop stalled for" << latency << "ms in" << spanName;
+}
+
+void StallWatchdog::checkForStall()
+{
+    // Only the low 32 bits of the clock are kept, and the difference is taken
+    // modulo 2^32, so that it stays right when the clock passes 2^31 ms (~24.8 days)
+    int sinceLastBeat = (int)((quint32)_clock.elapsed() - (quint32)_lastBeat.fetchAndAddRelaxed(0));
+
+    // Only the first look at a stall is kept, that's the closest to where it began
+    if (sinceLastBeat >= STALLWATCHDOG_INTERVAL + _threshold && !_stallSpan.fetchAndAddRelaxed(0))
+    {
+        const char *span = Tracer::currentSpan();
+        _stallSpan.testAndSetRelaxed(0, span ? span : _noSpan);
+    }
+}
+
+QString StallWatchdog::report() const
+{
+    int beats = 0;
+    foreach (int count, _histogram)
+        beats += count;
+
+    QString result = QString("event loop latency of %1 heartbeats:").arg(beats);
+    for (int i = 0; i < _bucketCount; i++)
+    {
+        if (i < _bucketCount - 1)
+            result += QString(" <%1 ms: %2,").arg(_bucketBounds[i]).arg(_histogram[i]);
+        else
+            result += QString(" %1+ ms: %2").arg(_bucketBounds[i - 1]).arg(_histogram[i]);
+    }
+
+    result += QString("\nstalls over %1 ms: %2").arg(_threshold).arg(_stalls);
+    if (_stalls)
+        result += QString(", worst: %1 ms in %2").arg(_worstStall).arg(_worstStallSpan);
+
+    // The spans which stalled most often come first
+    QStringList spans = _stallsBySpan.keys();
+    QList<QPair<int, QString> > sorted;
+    foreach (const QString &span, spans)
+        sorted.append(qMakePair(-_stallsBySpan[span], span));
+    qSort(sorted);
+
+    for (int i = 0; i < sorted.count() && i < STALLWATCHDOG_REPORTED_SPANS; i++)
+        result += QString("\n  %1x %2").arg(-sorted[i].first).arg(sorted[i].second);
+
+    return result;
+}
+
+void StallWatchdog::logReport()
+{
+    foreach (const QString &line, report().split('\n'))
+        qDebug() << qPrintable(line);
+}
+
+StallWatchdogWorker::StallWatchdogWorker(StallWatchdog *watchdog) :
+    _watchdog(watchdog),
+    _timer(new QTimer(this))
+{
+    _timer->setInterval(STALLWATCHDOG_INTERVAL);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(check()));
+}
+
+void StallWatchdogWorker::start()
+{
+    _timer->start();
+}
+
+void StallWatchdogWorker::stop()
+{
+    _timer->stop();
+}
+
+void StallWatchdogWorker::check()
+{
+    _watchdog->checkForStall();
+}
@@ -0,0 +1,103 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QtCore/QObject>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+class QThread;
+class QTimer;
+class StallWatchdogWorker;
+
+// Measures the latency of the main event loop with a heartbeat timer, and
+// logs the stalls that are longer than the threshold. A worker thread
+// notices the stall while it's going on, and takes the trace span that is
+// running on the main thread at that moment (see Tracer::currentSpan), so
+// that the stall can be attributed to a handler.
+
+class StallWatchdog : public QObject
+{
+    Q_OBJECT
+    QThread *_thread;
+    StallWatchdogWorker *_worker;
+    QTimer *_heartbeat;
+    QElapsedTimer _clock;
+    // Low 32 bits of the clock at the last heartbeat, see checkForStall
+    QAtomicInt _lastBeat;
+    QAtomicPointer<const char> _stallSpan;
+    int _threshold;
+    qint64 _expectedBeat;
+    QVector<int> _histogram;
+    QHash<QString, int> _stallsBySpan;
+    int _stalls;
+    qint64 _worstStall;
+    QString _worstStallSpan;
+
+    static StallWatchdog *_instance;
+
+    explicit StallWatchdog();
+
+public:
+    ~StallWatchdog();
+    static StallWatchdog *instance();
+
+    bool isRunning() const;
+    int threshold() const { return _threshold; }
+    void setThreshold(int value);
+    QString report() const;
+
+    // Called by the worker
+    void checkForStall();
+
+public slots:
+    void start();
+    void stop();
+    void reset();
+    void logReport();
+
+private slots:
+    void heartbeat();
+
+};
+
+// Lives on the thread of the watchdog and looks at the heartbeat.
+
+class StallWatchdogWorker : public QObject
+{
+    Q_OBJECT
+    StallWatchdog *_watchdog;
+    QTimer *_timer;
+
+public:
+    explicit StallWatchdogWorker(StallWatchdog *watchdog);
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void check();
+
+};
+
+#endif // STALLWATCHDOG_H
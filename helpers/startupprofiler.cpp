@@ -0,0 +1,185 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QEvent>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QTimer>
+
+#include "helpers/startupprofiler.h"
+
+#define STARTUP_PHASE_FIRST_FRAME "first frame"
+#define STARTUP_PHASE_FIRST_CONNECT "first connect"
+
+StartupProfiler *StartupProfiler::_instance = 0;
+
+StartupProfiler::StartupProfiler() :
+    QObject(0),
+    _isFirstFrameShown(false),
+    _isFirstConnectDone(false),
+    _isBenchmark(false)
+{
+    _timer.start();
+}
+
+StartupProfiler *StartupProfiler::instance()
+{
+    if (!_instance)
+        _instance = new StartupProfiler();
+
+    return _instance;
+}
+
+void StartupProfiler::mark(const QString &phase)
+{
+    StartupProfiler *profiler = instance();
+    profiler->_phases.append(qMakePair(phase, profiler->elapsed()));
+}
+
+qint64 StartupProfiler::elapsed() const
+{
+    return _timer.elapsed();
+}
+
+qint64 StartupProfiler::phaseTime(const QString &phase) const
+{
+    for (int i = 0; i < _phases.count(); i++)
+    {
+        if (_phases[i].first == phase)
+            return _phases[i].second;
+    }
+
+    return -1;
+}
+
+QString StartupProfiler::report() const
+{
+    QString result;
+    QTextStream stream(&result);
+    qint64 previous = 0;
+
+    for (int i = 0; i < _phases.count(); i++)
+    {
+        stream << _phases[i].first << ": " << _phases[i].second << " ms (+" << (_phases[i].second - previous) << " ms)\n";
+        previous = _phases[i].second;
+    }
+
+    return result;
+}
+
+bool StartupProfiler::exportTo(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    qint64 previous = 0;
+    stream << "phase,elapsed_ms,delta_ms\n";
+
+    for (int i = 0; i < _phases.count(); i++)
+    {
+        stream << '"' << _phases[i].first << "\"," << _phases[i].second << ',' << (_phases[i].second - previous) << '\n';
+        previous = _phases[i].second;
+    }
+
+    return true;
+}
+
+void StartupProfiler::setExportPath(const QString &path)
+{
+    _exportPath = path;
+}
+
+void StartupProfiler::setBenchmark(bool value)
+{
+    _isBenchmark = value;
+}
+
+bool StartupProfiler::isBenchmark() const
+{
+    return _isBenchmark;
+}
+
+bool StartupProfiler::eventFilter(QObject *obj, QEvent *event)
+{
+    // Used for views which don't tell when they have shown a frame
+    if (event->type() == QEvent::Paint && !_isFirstFrameShown)
+    {
+        obj->removeEventFilter(this);
+        // Marking it after the paint event is processed
+        QTimer::singleShot(0, this, SLOT(markFirstFrame()));
+    }
+
+    return false;
+}
+
+void StartupProfiler::markFirstFrame()
+{
+    if (_isFirstFrameShown)
+        return;
+
+    _isFirstFrameShown = true;
+    mark(STARTUP_PHASE_FIRST_FRAME);
+    emit firstFrameShown();
+
+    qDebug() << "Startup phases until the first frame:\n" << qPrintable(report());
+
+    if (_exportPath.length())
+        exportTo(_exportPath);
+}
+
+void StartupProfiler::markFirstConnect()
+{
+    if (_isFirstConnectDone)
+        return;
+
+    _isFirstConnectDone = true;
+    mark(STARTUP_PHASE_FIRST_CONNECT);
+    emit firstConnectDone();
+
+    if (_exportPath.length())
+        exportTo(_exportPath);
+
+    if (_isBenchmark)
+        finishBenchmark();
+}
+
+void StartupProfiler::finishBenchmark()
+{
+    if (!_isBenchmark)
+        return;
+
+    _isBenchmark = false;
+    print();
+
+    if (_exportPath.length())
+        exportTo(_exportPath);
+
+    // A negative value means that the milestone was not reached
+    QTextStream(stdout) << "time-to-first-frame: " << phaseTime(STARTUP_PHASE_FIRST_FRAME) << " ms\n"
+                        << "time-to-first-connect: " << phaseTime(STARTUP_PHASE_FIRST_CONNECT) << " ms\n";
+
+    QCoreApplication::instance()->exit(_isFirstConnectDone ? 0 : 1);
+}
+
+void StartupProfiler::print() const
+{
+    QTextStream(stdout) << report();
+}
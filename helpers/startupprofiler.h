@@ -0,0 +1,71 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+
+// Measures how long the phases of the application startup take.
+// Phases are marked from main() and the models, the time of each mark is
+// counted from the start of the process. The milestones (first frame and
+// first connection) are also emitted as signals, so that the deferred
+// parts of the initialization can be started from them.
+
+class StartupProfiler : public QObject
+{
+    Q_OBJECT
+    QElapsedTimer _timer;
+    QList<QPair<QString, qint64> > _phases;
+    QString _exportPath;
+    bool _isFirstFrameShown, _isFirstConnectDone, _isBenchmark;
+
+    static StartupProfiler *_instance;
+
+    explicit StartupProfiler();
+
+public:
+    static StartupProfiler *instance();
+    static void mark(const QString &phase);
+
+    qint64 elapsed() const;
+    qint64 phaseTime(const QString &phase) const;
+    QString report() const;
+    bool exportTo(const QString &path) const;
+
+    void setExportPath(const QString &path);
+    void setBenchmark(bool value);
+    bool isBenchmark() const;
+    bool eventFilter(QObject *obj, QEvent *event);
+
+public slots:
+    void markFirstFrame();
+    void markFirstConnect();
+    void finishBenchmark();
+    void print() const;
+
+signals:
+    void firstFrameShown();
+    void firstConnectDone();
+
+};
+
+#endif // STARTUPPROFILER_H
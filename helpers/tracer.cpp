@@ -0,0 +1,232 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+
+#include "tracer.h"
+
+// Number of events kept for every thread
+#define TRACER_BUFFER_EVENTS 32768
+
+// QThreadStorage deletes its data when the thread finishes, but the events
+// of finished threads are still exported, so the buffers belong to the tracer
+struct TraceBufferRef
+{
+    TraceBuffer *buffer;
+};
+
+static QThreadStorage<TraceBufferRef*> _currentBuffer;
+
+QAtomicInt Tracer::_isEnabled(0);
+QAtomicInt Tracer::_isAttributing(0);
+Qt::HANDLE Tracer::_mainThreadId = 0;
+QAtomicPointer<const char> Tracer::_currentSpan(0);
+Tracer *Tracer::_instance = 0;
+
+QString Tracer::escapeJson(const QString &str)
+{
+    QString result;
+    result.reserve(str.length() + 2);
+
+    foreach (const QChar &c, str)
+    {
+        if (c == '"' || c == '\\')
+            result += QChar('\\') + c;
+        else if (c.unicode() < 0x20)
+            result += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        else
+            result += c;
+    }
+
+    return result;
+}
+
+Tracer::Tracer() :
+    QObject(QCoreApplication::instance())
+{
+    _clock.start();
+}
+
+Tracer::~Tracer()
+{
+    _isEnabled.fetchAndStoreRelaxed(0);
+    _instance = 0;
+    // Threads that are still running may hold on to their buffers
+}
+
+Tracer *Tracer::instance()
+{
+    if (!_instance)
+        _instance = new Tracer();
+
+    return _instance;
+}
+
+void Tracer::setAttributing(bool value)
+{
+    _mainThreadId = QThread::currentThreadId();
+    _currentSpan.fetchAndStoreRelaxed(0);
+    _isAttributing.fetchAndStoreRelaxed(value ? 1 : 0);
+}
+
+bool Tracer::isMainThread()
+{
+    return QThread::currentThreadId() == _mainThreadId;
+}
+
+const char *Tracer::currentSpan()
+{
+    return _currentSpan.fetchAndAddRelaxed(0);
+}
+
+const char *Tracer::swapCurrentSpan(const char *name)
+{
+    return _currentSpan.fetchAndStoreRelease(name);
+}
+
+qint64 Tracer::now() const
+{
+#if QT_VERSION >= 0x040800
+    return _clock.nsecsElapsed() / 1000;
+#else
+    return _clock.elapsed() * 1000;
+#endif
+}
+
+TraceBuffer *Tracer::currentBuffer()
+{
+    if (_currentBuffer.hasLocalData())
+        return _currentBuffer.localData()->buffer;
+
+    TraceBuffer *buffer = new TraceBuffer();
+    buffer->events.resize(TRACER_BUFFER_EVENTS);
+    buffer->next = 0;
+    buffer->isFull = false;
+
+    QThread *thread = QThread::currentThread();
+    if (thread == QCoreApplication::instance()->thread())
+        buffer->threadName = "main";
+    else if (thread->objectName().length())
+        buffer->threadName = thread->objectName();
+    else
+        buffer->threadName = thread->metaObject()->className();
+
+    {
+        QMutexLocker locker(&_buffersMutex);
+        buffer->threadId = _buffers.count() + 1;
+        _buffers.append(buffer);
+    }
+
+    TraceBufferRef *ref = new TraceBufferRef();
+    ref->buffer = buffer;
+    _currentBuffer.setLocalData(ref);
+    return buffer;
+}
+
+void Tracer::record(const char *name, qint64 start, qint64 duration)
+{
+    TraceBuffer *buffer = currentBuffer();
+    // Only contended while the trace is exported
+    QMutexLocker locker(&buffer->mutex);
+    TraceEvent &event = buffer->events[buffer->next];
+    event.name = name;
+    event.start = start;
+    event.duration = duration;
+
+    if (++buffer->next == TRACER_BUFFER_EVENTS)
+    {
+        buffer->next = 0;
+        buffer->isFull = true;
+    }
+}
+
+void Tracer::setEnabled(bool value)
+{
+    _isEnabled.fetchAndStoreRelaxed(value ? 1 : 0);
+    qDebug() << Q_FUNC_INFO << "tracing" << (value ? "enabled" : "disabled");
+}
+
+void Tracer::setExportPath(const QString &path)
+{
+    _exportPath = path;
+}
+
+void Tracer::clear()
+{
+    QMutexLocker locker(&_buffersMutex);
+    foreach (TraceBuffer *buffer, _buffers)
+    {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        buffer->next = 0;
+        buffer->isFull = false;
+    }
+}
+
+bool Tracer::exportTo(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        qWarning() << Q_FUNC_INFO << "can't open" << path << "for writing:" << file.errorString();
+        return false;
+    }
+
+    QTextStream stream(&file);
+    qint64 pid = QCoreApplication::applicationPid();
+    bool first = true;
+    int count = 0;
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    QMutexLocker locker(&_buffersMutex);
+    foreach (TraceBuffer *buffer, _buffers)
+    {
+        QMutexLocker bufferLocker(&buffer->mutex);
+
+        stream << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+               << ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"" << escapeJson(buffer->threadName) << "\"}}";
+        first = false;
+
+        // Oldest event first
+        int begin = buffer->isFull ? buffer->next : 0;
+        int length = buffer->isFull ? TRACER_BUFFER_EVENTS : buffer->next;
+        for (int i = 0; i < length; i++)
+        {
+            const TraceEvent &event = buffer->events[(begin + i) % TRACER_BUFFER_EVENTS];
+            stream << ",\n{\"name\":\"" << escapeJson(QString::fromLatin1(event.name))
+                   << "\",\"cat\":\"irc-chatter\",\"ph\":\"X\",\"ts\":" << event.start
+                   << ",\"dur\":" << event.duration << ",\"pid\":" << pid << ",\"tid\":" << buffer->threadId << "}";
+            count++;
+        }
+    }
+
+    stream << "\n]}\n";
+    stream.flush();
+    qDebug() << Q_FUNC_INFO << "exported" << count << "events to" << path;
+    return file.error() == QFile::NoError;
+}
+
+void Tracer::exportToExportPath()
+{
+    if (_exportPath.length())
+        exportTo(_exportPath);
+}
@@ -0,0 +1,142 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+// Scoped spans in the hot paths, recorded into a ring buffer of every thread
+// and exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// While tracing is off a span costs a single check of a static flag.
+// Building with DEFINES+=NO_TRACING removes the spans altogether.
+// While attribution is on, the innermost span of the main thread is kept
+// up to date, so that the stall watchdog can tell what blocked the UI.
+
+#if defined(NO_TRACING)
+#define TRACE_SPAN(name)
+#define TRACE_FUNCTION()
+#else
+// The name must outlive the trace, use string literals
+#define TRACE_SPAN(name) TraceSpan traceSpan(name)
+#define TRACE_FUNCTION() TraceSpan traceSpan(Q_FUNC_INFO)
+#endif
+
+struct TraceEvent
+{
+    const char *name;
+    qint64 start, duration;
+};
+
+// The events of one thread, the oldest ones are overwritten when it's full
+struct TraceBuffer
+{
+    QMutex mutex;
+    QVector<TraceEvent> events;
+    int next, threadId;
+    bool isFull;
+    QString threadName;
+};
+
+class Tracer : public QObject
+{
+    Q_OBJECT
+    QElapsedTimer _clock;
+    QMutex _buffersMutex;
+    QList<TraceBuffer*> _buffers;
+    QString _exportPath;
+
+    // Read by the spans of every thread
+    static QAtomicInt _isEnabled, _isAttributing;
+    static Qt::HANDLE _mainThreadId;
+    static QAtomicPointer<const char> _currentSpan;
+    static Tracer *_instance;
+
+    explicit Tracer();
+    TraceBuffer *currentBuffer();
+
+public:
+    ~Tracer();
+    static Tracer *instance();
+#if QT_VERSION >= 0x050000
+    static bool isEnabled() { return _isEnabled.load(); }
+    static bool isAttributing() { return _isAttributing.load(); }
+#else
+    static bool isEnabled() { return _isEnabled; }
+    static bool isAttributing() { return _isAttributing; }
+#endif
+    // Must be called from the main thread
+    static void setAttributing(bool value);
+    static bool isMainThread();
+    // The innermost span of the main thread, may be called from any thread
+    static const char *currentSpan();
+    // Makes the given span the current one, returns the previous one
+    static const char *swapCurrentSpan(const char *name);
+    // Microseconds since the tracer was created
+    qint64 now() const;
+    void record(const char *name, qint64 start, qint64 duration);
+    void setExportPath(const QString &path);
+    // Escapes a string for a JSON string literal, control characters included
+    static QString escapeJson(const QString &str);
+
+public slots:
+    void setEnabled(bool value);
+    void clear();
+    bool exportTo(const QString &path);
+    void exportToExportPath();
+
+};
+
+class TraceSpan
+{
+    const char *_name, *_previous;
+    qint64 _start;
+    bool _isAttributed;
+
+public:
+    explicit TraceSpan(const char *name) :
+        _name(name),
+        _previous(0),
+        _start(Tracer::isEnabled() ? Tracer::instance()->now() : -1),
+        _isAttributed(Tracer::isAttributing() && Tracer::isMainThread())
+    {
+        if (_isAttributed)
+            _previous = Tracer::swapCurrentSpan(name);
+    }
+
+    ~TraceSpan()
+    {
+        if (_isAttributed)
+            Tracer::swapCurrentSpan(_previous);
+
+        if (_start >= 0 && Tracer::isEnabled())
+        {
+            Tracer *tracer = Tracer::instance();
+            tracer->record(_name, _start, tracer->now() - _start);
+        }
+    }
+
+};
+
+#endif // TRACER_H
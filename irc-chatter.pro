@@ -19,6 +19,11 @@ DEFINES += \
     APP_VERSION=\\\"$$VERSION\\\" \
     IRC_STATIC
 
+# Build with CONFIG+=no_tracing to compile the trace spans out, see helpers/tracer.h
+no_tracing {
+    DEFINES += NO_TRACING
+}
+
 HEADERS += \
     helpers/util.h \
     helpers/appeventlistener.h \
@@ -28,11 +33,30 @@ HEADERS += \
     helpers/qobjectlistmodel.h \
     model/settings/appsettings.h \
     model/settings/serversettings.h \
+    model/settings/serversettingsstore.h \
     clients/abstractircclient.h \
     clients/communiircclient.h \
+    clients/sendqueue.h \
+    clients/reconnectengine.h \
+    clients/lagmeter.h \
+    clients/connectionracer.h \
+    clients/trafficcapture.h \
+    clients/encodingdetector.h \
+    clients/playbacktracker.h \
+    clients/remoteircclient.h \
     helpers/commandparser.h \
     helpers/channelhelper.h \
     helpers/notifier.h \
+    helpers/notificationsink.h \
+    helpers/startupprofiler.h \
+    helpers/tracer.h \
+    helpers/stallwatchdog.h \
+    helpers/channellogger.h \
+    helpers/coreprotocol.h \
+    model/metrics.h \
+    model/coreserver.h \
+    model/coreconnection.h \
+    model/ignorefilter.h \
     model/channelmodelcollection.h
 
 SOURCES += \
@@ -43,11 +67,30 @@ SOURCES += \
     model/servermodel.cpp \
     model/settings/appsettings.cpp \
     model/settings/serversettings.cpp \
+    model/settings/serversettingsstore.cpp \
     clients/abstractircclient.cpp \
     clients/communiircclient.cpp \
+    clients/sendqueue.cpp \
+    clients/reconnectengine.cpp \
+    clients/lagmeter.cpp \
+    clients/connectionracer.cpp \
+    clients/trafficcapture.cpp \
+    clients/encodingdetector.cpp \
+    clients/playbacktracker.cpp \
+    clients/remoteircclient.cpp \
     helpers/commandparser.cpp \
     helpers/channelhelper.cpp \
     helpers/notifier.cpp \
+    helpers/notificationsink.cpp \
+    helpers/startupprofiler.cpp \
+    helpers/tracer.cpp \
+    helpers/stallwatchdog.cpp \
+    helpers/channellogger.cpp \
+    helpers/coreprotocol.cpp \
+    model/metrics.cpp \
+    model/coreserver.cpp \
+    model/coreconnection.cpp \
+    model/ignorefilter.cpp \
     helpers/qobjectlistmodel.cpp \
     model/channelmodelcollection.cpp
 
@@ -72,6 +115,7 @@ OTHER_FILES += \
     qml/desktop/pages/SettingsPage.qml \
     qml/desktop/misc/TitleLabel.qml \
     qml/desktop/components/ComboBox.qml \
+    qml/desktop/misc/MetricsOverlay.qml \
     qtc_packaging/debian_harmattan/rules \
     qtc_packaging/debian_harmattan/README \
     qtc_packaging/debian_harmattan/manifest.aegis \
@@ -87,6 +131,7 @@ OTHER_FILES += \
     qml/meego/components/WorkingSelectionDialog.qml \
     qml/meego/components/CommonDialog.qml \
     qml/meego/components/ServerSettingsList.qml \
+    qml/meego/components/MetricsOverlay.qml \
     qml/meego/pages/StartPage.qml \
     qml/meego/pages/ChatPage.qml \
     qml/meego/pages/SettingsPage.qml \
@@ -172,4 +217,71 @@ contains(MEEGO_EDITION, harmattan) {
     }
 }
 
-QMAKE_CLEAN += Makefile build-stamp configure-stamp irc-chatter
+# Cold start benchmark, run it with 'make coldstart-benchmark'
+coldstart-benchmark.commands = $$PWD/tools/coldstart-benchmark.sh ./$$TARGET
+coldstart-benchmark.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += coldstart-benchmark
+OTHER_FILES += tools/coldstart-benchmark.sh
+
+# Time-to-registered against a local server with injected latency, needs root
+OTHER_FILES += tools/registration-latency.sh
+
+# Replay benchmark of the message pipeline, run it with 'make replay-benchmark'
+# It is a separate build of the client and the models which is driven by recorded traffic instead of the UI.
+# The decoding alone is measured with ./irc-chatter-replay --decode tools/replay/traces/mixed-encodings.irc
+replay_benchmark {
+    TARGET = irc-chatter-replay
+    SOURCES -= main.cpp
+    SOURCES += tools/replay/replaybenchmark.cpp
+}
+replay-benchmark.commands = \
+    $(QMAKE) CONFIG+=replay_benchmark -o Makefile.replay $$PWD/irc-chatter.pro && \
+    $(MAKE) -f Makefile.replay && \
+    ./irc-chatter-replay --iterations=5 $$PWD/tools/replay/traces/*.irc
+QMAKE_EXTRA_TARGETS += replay-benchmark
+OTHER_FILES += \
+    tools/replay/traces/busy-channel.irc \
+    tools/replay/traces/netsplit.irc \
+    tools/replay/traces/names-burst.irc \
+    tools/replay/traces/mixed-encodings.irc
+
+# End-to-end throughput test against a synthetic server on loopback, run it with 'make load-test'
+# Pass options to it with LOADTEST_ARGS, eg. make load-test LOADTEST_ARGS="--channels=50 --netsplit=30"
+load_test {
+    TARGET = irc-chatter-loadtest
+    SOURCES -= main.cpp
+    DEFINES += SCENARIO_CERTIFICATE_DIR=\\\"$$PWD/tools/loadtest/certs\\\"
+    HEADERS += \
+        tools/loadtest/syntheticircserver.h \
+        tools/loadtest/loadtestdriver.h \
+        tools/loadtest/scenariotest.h
+    SOURCES += \
+        tools/loadtest/syntheticircserver.cpp \
+        tools/loadtest/loadtestdriver.cpp \
+        tools/loadtest/scenariotest.cpp \
+        tools/loadtest/loadtest.cpp
+}
+load-test.commands = \
+    $(QMAKE) CONFIG+=load_test -o Makefile.loadtest $$PWD/irc-chatter.pro && \
+    $(MAKE) -f Makefile.loadtest && \
+    ./irc-chatter-loadtest $(LOADTEST_ARGS)
+QMAKE_EXTRA_TARGETS += load-test
+
+# Scenario tests of the client against the synthetic server, run them with 'make scenario-test'
+scenario-test.commands = \
+    $(QMAKE) CONFIG+=load_test -o Makefile.loadtest $$PWD/irc-chatter.pro && \
+    $(MAKE) -f Makefile.loadtest && \
+    ./irc-chatter-loadtest --scenario=reconnect && \
+    ./irc-chatter-loadtest --scenario=migrate && \
+    ./irc-chatter-loadtest --scenario=tls && \
+    ./irc-chatter-loadtest --scenario=logging && \
+    ./irc-chatter-loadtest --scenario=playback
+QMAKE_EXTRA_TARGETS += scenario-test
+# Self-signed certificates of the tls scenario
+OTHER_FILES += \
+    tools/loadtest/certs/scenario.crt \
+    tools/loadtest/certs/scenario.key \
+    tools/loadtest/certs/scenario-other.crt \
+    tools/loadtest/certs/scenario-other.key
+
+QMAKE_CLEAN += Makefile build-stamp configure-stamp irc-chatter Makefile.replay irc-chatter-replay Makefile.loadtest irc-chatter-loadtest
@@ -16,7 +16,8 @@
 // Copyright (C) 2011-2012, Timur Kristóf <venemo@fedoraproject.org>
 // Copyright (C) 2011, Hiemanshu Sharma <mail@theindiangeek.in>
 
-#include <QtCore/QSettings>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QTimer>
 
 #if QT_VERSION >= 0x050000
 #include <QtGui/QGuiApplication>
@@ -35,16 +36,97 @@
 #include <QtDeclarative/QDeclarativeEngine>
 #endif
 
+#include "clients/trafficcapture.h"
 #include "helpers/appeventlistener.h"
+#include "helpers/channellogger.h"
+#include "helpers/startupprofiler.h"
+#include "helpers/stallwatchdog.h"
+#include "helpers/tracer.h"
+#include "model/coreconnection.h"
+#include "model/coreserver.h"
 #include "model/ircmodel.h"
+#include "model/metrics.h"
 #include "model/settings/appsettings.h"
 
 #if defined(HAVE_APPLAUNCHERD)
 #include <MDeclarativeCache>
 #endif
 
+#if defined(Q_OS_UNIX)
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+// Time after which the startup benchmark gives up waiting for a connection
+#define STARTUP_BENCHMARK_TIMEOUT 60000
+
+#if defined(Q_OS_UNIX)
+static int _terminationSockets[2];
+
+static void handleTerminationSignal(int)
+{
+    // Only async-signal-safe calls here, the event loop picks it up from the socket
+    char c = 1;
+    ssize_t written = ::write(_terminationSockets[0], &c, 1);
+    Q_UNUSED(written);
+}
+#endif
+
+// Runs the models and the clients without any GUI objects, and without
+// building the HTML of the channels. Every channel is logged instead.
+// With --core, UIs started with --attach can show the servers of this process.
+// Usage: irc-chatter --headless [--log-dir=<directory>] [--core]
+static int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication *app = new QCoreApplication(argc, argv);
+    QString logDirectory = ChannelLogger::defaultDirectory();
+
+    foreach (const QString &arg, app->arguments())
+    {
+        if (arg.startsWith("--log-dir="))
+            logDirectory = arg.mid(10);
+    }
+
+#if defined(Q_OS_UNIX)
+    // SIGTERM and SIGINT quit cleanly, so that the logs and the settings are written
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, _terminationSockets) == 0)
+    {
+        QSocketNotifier *notifier = new QSocketNotifier(_terminationSockets[1], QSocketNotifier::Read, app);
+        QObject::connect(notifier, SIGNAL(activated(int)), app, SLOT(quit()));
+        ::signal(SIGTERM, handleTerminationSignal);
+        ::signal(SIGINT, handleTerminationSignal);
+    }
+#endif
+
+    ChannelModel::setRendering(false);
+    AppSettings *appSettings = new AppSettings(app);
+    IrcModel *model = new IrcModel(app, appSettings);
+
+    if (!ChannelLogger::instance()->start(logDirectory, appSettings->logFormat(), appSettings->logSyncPolicy()))
+    {
+        delete app;
+        return 1;
+    }
+
+    if (app->arguments().contains("--core") && !(new CoreServer(model))->start())
+    {
+        delete app;
+        return 1;
+    }
+
+    QObject::connect(app, SIGNAL(aboutToQuit()), appSettings, SLOT(saveServerSettings()));
+    QTimer::singleShot(0, model, SLOT(connectToServers()));
+    qDebug() << "IRC Chatter is running headless, logging to" << logDirectory;
+
+    int result = app->exec();
+    delete app;
+    return result;
+}
+
 Q_DECL_EXPORT int main(int argc, char *argv[])
 {
+    StartupProfiler *profiler = StartupProfiler::instance();
     QString appVersion(APP_VERSION);
     bool isPreRelease = false;
 
@@ -57,6 +139,12 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     QCoreApplication::setOrganizationName("irc-chatter");
     QCoreApplication::setApplicationVersion(APP_VERSION);
 
+    for (int i = 1; i < argc; i++)
+    {
+        if (QByteArray(argv[i]) == "--headless")
+            return runHeadless(argc, argv);
+    }
+
 #if defined(HAVE_APPLAUNCHERD)
     qDebug() << "IRC Chatter is using applauncherd";
     QApplication *app = MDeclarativeCache::qApplication(argc, argv);
@@ -72,17 +160,53 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     QDeclarativeView *view = new QDeclarativeView();
 #endif
     QCoreApplication::addLibraryPath("./plugins");
+    StartupProfiler::mark("application and view created");
+
+    foreach (const QString &arg, app->arguments())
+    {
+        // --startup-benchmark: connect right away, print the startup times and quit after the first connection
+        // --startup-profile=<file>: export the startup phase times as CSV
+        // --capture-traffic=<file>: write the raw traffic of every server to a capture for tools/replay
+        // --trace=<file>: trace the hot paths from the start and export the trace as JSON when quitting
+        // --stall-watchdog[=<ms>]: log the event loop stalls longer than the threshold, and their histogram when quitting
+        if (arg == "--startup-benchmark")
+            profiler->setBenchmark(true);
+        else if (arg.startsWith("--startup-profile="))
+            profiler->setExportPath(arg.mid(18));
+        else if (arg.startsWith("--capture-traffic="))
+            TrafficCapture::instance()->start(arg.mid(18));
+        else if (arg.startsWith("--trace="))
+        {
+            Tracer::instance()->setExportPath(arg.mid(8));
+            Tracer::instance()->setEnabled(true);
+            QObject::connect(app, SIGNAL(aboutToQuit()), Tracer::instance(), SLOT(exportToExportPath()));
+        }
+        else if (arg == "--stall-watchdog" || arg.startsWith("--stall-watchdog="))
+        {
+            if (arg.length() > 16)
+                StallWatchdog::instance()->setThreshold(arg.mid(17).toInt());
+            StallWatchdog::instance()->start();
+            QObject::connect(app, SIGNAL(aboutToQuit()), StallWatchdog::instance(), SLOT(logReport()));
+        }
+    }
 
+    // The server settings are not deserialized here, see below
     AppSettings *appSettings = new AppSettings(app);
     IrcModel *model = new IrcModel(app, appSettings);
     AppEventListener *eventListener = new AppEventListener(model);
+    ChannelLogger::instance()->followSettings(appSettings);
+    // --metrics-overlay: show the metrics of the servers and channels over the UI
+    if (app->arguments().contains("--metrics-overlay"))
+        eventListener->metrics()->showOverlay();
     app->installEventFilter(eventListener);
+    StartupProfiler::mark("models created");
     qDebug() << "QApplication, QDeclarativeView, IrcModel, AppEventListener instances created";
 
     qmlRegisterType<ServerSettings>("net.venemo.ircchatter", 1, 0, "ServerSettings");
     qmlRegisterType<AppSettings>("net.venemo.ircchatter", 1, 0, "AppSettings");
     qmlRegisterUncreatableType<ChannelModel>("net.venemo.ircchatter", 1, 0, "ChannelModel", "This object is created in the model.");
     qmlRegisterUncreatableType<IrcModel>("net.venemo.ircchatter", 1, 0, "IrcModel", "This object is created in the model.");
+    StartupProfiler::mark("QML types registered");
     qDebug() << "QML types registered";
 
     QObject::connect(eventListener, SIGNAL(applicationActivated()), view, SLOT(raise()));
@@ -101,8 +225,33 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
     view->rootContext()->setContextProperty("appVersion", appVersion);
     view->rootContext()->setContextProperty("appSettings", appSettings);
     view->rootContext()->setContextProperty("isPreRelease", isPreRelease);
+    view->rootContext()->setContextProperty("metrics", eventListener->metrics());
+    StartupProfiler::mark("view set up");
     qDebug() << "View set up";
 
+    // Everything that the first frame doesn't need is done after it is shown
+#if QT_VERSION >= 0x050000
+    QObject::connect(view, SIGNAL(frameSwapped()), profiler, SLOT(markFirstFrame()));
+#else
+    view->viewport()->installEventFilter(profiler);
+#endif
+    QObject::connect(profiler, SIGNAL(firstFrameShown()), appSettings, SLOT(loadServerSettings()));
+    QObject::connect(profiler, SIGNAL(firstFrameShown()), eventListener, SLOT(registerOnSessionBus()));
+
+    // --attach: show the servers of a running core (irc-chatter --headless --core) instead of connecting to them
+    if (app->arguments().contains("--attach"))
+    {
+        CoreConnection *coreConnection = new CoreConnection(model);
+        QObject::connect(profiler, SIGNAL(firstFrameShown()), coreConnection, SLOT(open()));
+        QObject::connect(app, SIGNAL(aboutToQuit()), coreConnection, SLOT(close()));
+    }
+
+    if (profiler->isBenchmark())
+    {
+        QObject::connect(profiler, SIGNAL(firstFrameShown()), model, SLOT(connectToServers()));
+        QTimer::singleShot(STARTUP_BENCHMARK_TIMEOUT, profiler, SLOT(finishBenchmark()));
+    }
+
 #if defined(USE_MEEGO_UI)
     view->setSource(QUrl("qrc:/qml/meego/AppWindow.qml"));
     view->showFullScreen();
@@ -121,6 +270,7 @@ Q_DECL_EXPORT int main(int argc, char *argv[])
 #error Please configure your build properly and select a UI.
 #endif
 
+    StartupProfiler::mark("QML loaded and view shown");
     qDebug() << "View shown";
 
     int result = app->exec();
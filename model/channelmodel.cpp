@@ -20,6 +20,8 @@
 // Copyright (C) 2010 Eike Hein <hein@kde.org>
 
 #include <QtCore/QTime>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 
 #include "model/channelmodel.h"
@@ -29,10 +31,13 @@
 #include "helpers/commandparser.h"
 #include "helpers/channelhelper.h"
 #include "helpers/notifier.h"
+#include "helpers/tracer.h"
+#include "helpers/channellogger.h"
 
 QString ChannelModel::_autoCompletionSuffix(", ");
 int ChannelModel::_maxLineNumber = 300;
 int ChannelModel::_deletableLines = 100;
+bool ChannelModel::_isRendering = true;
 
 // This code is copypasted from Konversation - I hereby thank its authors
 QRegExp ChannelModel::_urlRegexp(QString("\\b((?:(?:([a-z][\\w-]+:/{1,3})|www\\d{0,3}[.]|[a-z0-9.\\-]+[.][a-z]{2,4}/)(?:[^\\s()<>]+|\\(([^\\s()<>]+|(\\([^\\s()<>]+\\)))*\\))+(?:\\(([^\\s()<>]+|(\\([^\\s()<>]+\\)))*\\)|\\}\\]|[^\\s`!()\\[\\]{};:'\".,<>?%1%2%3%4%5%6])|[a-z0-9.\\-+_]+@[a-z0-9.\\-]+[.][a-z]{1,5}[^\\s/`!()\\[\\]{};:'\".,<>?%1%2%3%4%5%6]))").arg(QChar(0x00AB)).arg(QChar(0x00BB)).arg(QChar(0x201C)).arg(QChar(0x201D)).arg(QChar(0x2018)).arg(QChar(0x2019)));
@@ -42,7 +47,7 @@ ChannelModel::ChannelModel(ServerModel *parent, const QString &channelName, Abst
     _name(channelName),
     _users(new QStringListModel(this)),
     _ircClient(ircClient),
-    _commandParser(new CommandParser(this, _ircClient, this->appSettings())),
+    _commandParser(new CommandParser(this, _ircClient, this->appSettings(), parent->ignoreFilter())),
     _displayedLines(0),
     _sentMessagesIndex(-1)
 {
@@ -55,20 +60,40 @@ ChannelModel::~ChannelModel()
 {
 }
 
+void ChannelModel::setIrcClient(AbstractIrcClient *ircClient)
+{
+    _ircClient = ircClient;
+    _commandParser->setIrcClient(ircClient);
+}
+
 void ChannelModel::channelNameChanged(const QString &newName)
 {
     appendDeemphasisedInfo("Channel name is changed to " + newName);
     emit nameChanged();
 }
 
+void ChannelModel::log(const QString &type, const QString &nick, const QString &text, qint64 time)
+{
+    if (ChannelLogger::isEnabled())
+        ChannelLogger::log(static_cast<ServerModel*>(parent())->url(), _name, type, nick, text, time);
+}
+
 void ChannelModel::receiveMotd(QString motd)
 {
+    log("motd", QString(), motd);
+
+    if (!_isRendering)
+        return;
+
     appendDeemphasisedInfo("[MOTD] " + motd);
 }
 
-void ChannelModel::receiveJoined(const QString &userName)
+void ChannelModel::receiveJoined(const QString &userName, bool isIgnored)
 {
-    if (appSettings()->displayMiscEvents())
+    if (!isIgnored)
+        log("join", userName);
+
+    if (!isIgnored && _isRendering && appSettings()->displayMiscEvents())
     {
         if (userName != _ircClient->currentNick())
             appendDeemphasisedInfo("--> " + QTime::currentTime().toString("HH:mm") + " " + userName + " has joined this channel.");
@@ -78,9 +103,12 @@ void ChannelModel::receiveJoined(const QString &userName)
     updateUserList();
 }
 
-void ChannelModel::receiveParted(const QString &userName, QString reason)
+void ChannelModel::receiveParted(const QString &userName, QString reason, bool isIgnored)
 {
-    if (appSettings()->displayMiscEvents())
+    if (!isIgnored)
+        log("part", userName, reason);
+
+    if (!isIgnored && _isRendering && appSettings()->displayMiscEvents())
     {
         appendDeemphasisedInfo("<-- " + QTime::currentTime().toString("HH:mm") + " " + userName + " has parted this channel." + (reason.length() ? (" (Reason: " + reason + ")") : ""));
     }
@@ -89,9 +117,12 @@ void ChannelModel::receiveParted(const QString &userName, QString reason)
     updateUserList();
 }
 
-void ChannelModel::receiveQuit(const QString &userName, QString reason)
+void ChannelModel::receiveQuit(const QString &userName, QString reason, bool isIgnored)
 {
-    if (appSettings()->displayMiscEvents())
+    if (!isIgnored)
+        log("quit", userName, reason);
+
+    if (!isIgnored && _isRendering && appSettings()->displayMiscEvents())
     {
         appendDeemphasisedInfo("<-- " + QTime::currentTime().toString("HH:mm") + " " + userName + " has left this server." + (reason.length() ? (" (Reason: " + reason + ")") : ""));
     }
@@ -100,9 +131,12 @@ void ChannelModel::receiveQuit(const QString &userName, QString reason)
     updateUserList();
 }
 
-void ChannelModel::receiveNickChange(const QString &oldNick, const QString &newNick)
+void ChannelModel::receiveNickChange(const QString &oldNick, const QString &newNick, bool isIgnored)
 {
-    if (appSettings()->displayMiscEvents())
+    if (!isIgnored)
+        log("nick", oldNick, newNick);
+
+    if (!isIgnored && _isRendering && appSettings()->displayMiscEvents())
     {
         appendDeemphasisedInfo("*** " + QTime::currentTime().toString("HH:mm") + " " + oldNick + " has changed nick to " + newNick + ".");
     }
@@ -114,16 +148,27 @@ void ChannelModel::receiveNickChange(const QString &oldNick, const QString &newN
 
 void ChannelModel::receiveInvite(const QString &origin, const QString &receiver)
 {
+    log("invite", origin, receiver);
+
+    if (!_isRendering)
+        return;
+
     appendEmphasisedInfo("*** " + origin + " has invited " + receiver + " to " + _name + ".");
 }
 
 void ChannelModel::receiveKicked(const QString &origin, const QString &nick, QString message)
 {
+    log("kick", origin, nick + " " + message);
+
+    if (!_isRendering)
+        return;
+
     appendEmphasisedInfo("*** " + origin + " has kicked " + nick + " with message '" + message + "'.");
 }
 
 QString ChannelModel::processMessage(QString msg, bool *hasUserNick)
 {
+    TRACE_FUNCTION();
     msg.replace('&', "&amp;");
     msg.replace('<', "&lt;");
     msg.replace('>', "&gt;");
@@ -142,23 +187,86 @@ QString ChannelModel::processMessage(QString msg, bool *hasUserNick)
 
 void ChannelModel::appendLine(const QString &line)
 {
+    TRACE_FUNCTION();
+    if (!_isRendering)
+        return;
+
     if (_channelText.length())
         _channelText += "<br />";
 
     if (_displayedLines > _maxLineNumber)
+        removeOldestLines();
+
+    // The view updates synchronously from the change signal of the text
+    QElapsedTimer updateClock;
+    updateClock.start();
+    setChannelText(_channelText += line);
+#if QT_VERSION >= 0x040800
+    qint64 latency = updateClock.nsecsElapsed() / 1000;
+#else
+    qint64 latency = updateClock.elapsed() * 1000;
+#endif
+
+    _displayedLines++;
+    channelTextAppended(1, line.size() * sizeof(QChar), latency);
+}
+
+void ChannelModel::appendLines(const QStringList &lines)
+{
+    TRACE_FUNCTION();
+    if (!_isRendering || lines.isEmpty())
+        return;
+
+    int bytes = 0;
+    foreach (const QString &line, lines)
     {
-        int position = 0;
+        if (_channelText.length())
+            _channelText += "<br />";
+        _channelText += line;
+        bytes += line.size() * sizeof(QChar);
+    }
 
-        // Find the Nth line
-        for (int i = 0; i < _deletableLines; i++)
-            position = _channelText.indexOf("<br />", position);
+    _displayedLines += lines.count();
+    while (_displayedLines > _maxLineNumber)
+        removeOldestLines();
+
+    // All the lines reach the view in a single update
+    QElapsedTimer updateClock;
+    updateClock.start();
+    setChannelText(_channelText);
+#if QT_VERSION >= 0x040800
+    qint64 latency = updateClock.nsecsElapsed() / 1000;
+#else
+    qint64 latency = updateClock.elapsed() * 1000;
+#endif
+
+    channelTextAppended(lines.count(), bytes, latency);
+}
+
+void ChannelModel::removeOldestLines()
+{
+    int position = 0;
 
-        _channelText = _channelText.remove(0, position + 6);
-        _displayedLines -= _deletableLines;
+    // Find the end of the Nth line
+    for (int i = 0; i < _deletableLines; i++)
+    {
+        int next = _channelText.indexOf("<br />", position);
+        if (next == -1)
+            break;
+        position = next + 6;
     }
 
-    setChannelText(_channelText += line);
-    _displayedLines++;
+    _channelText.remove(0, position);
+    _displayedLines -= _deletableLines;
+}
+
+void ChannelModel::channelTextAppended(int lines, int bytes, qint64 latency)
+{
+    _counters.linesAppended += lines;
+    _counters.bytesAppended += bytes;
+    _counters.lastUpdateLatency = latency;
+    _counters.maxUpdateLatency = qMax(_counters.maxUpdateLatency, latency);
+    _counters.totalUpdateLatency += latency;
 }
 
 void ChannelModel::appendEmphasisedInfo(QString msg)
@@ -181,13 +289,18 @@ void ChannelModel::appendError(QString msg)
 
 void ChannelModel::receiveMessage(const QString &userName, QString message)
 {
+    log("message", userName, message);
+
+    if (!_isRendering)
+        return;
+
     bool hasUserNick = false;
     QString line;
 
     if (appSettings()->displayTimestamps())
         line += QTime::currentTime().toString("HH:mm") + " ";
 
-    line += "<a href='user://" + userName +"' style='text-decoration: none; color: " + ChannelHelper::colorForNick(userName, _ircClient->currentNick()) + "'>" + userName + "</a>: " + processMessage(message, &hasUserNick);
+    line += static_cast<ServerModel*>(parent())->nickStyles()->style(userName, _ircClient->currentNick()).link + ": " + processMessage(message, &hasUserNick);
 
     appendLine(line);
 
@@ -212,13 +325,18 @@ void ChannelModel::receiveMessage(const QString &userName, QString message)
 
 void ChannelModel::receiveCtcpAction(const QString &userName, QString message)
 {
+    log("action", userName, message);
+
+    if (!_isRendering)
+        return;
+
     bool hasUserNick = false;
     QString line;
 
     if (appSettings()->displayTimestamps())
         line += QTime::currentTime().toString("HH:mm") + " ";
 
-    line += "* <span style='color: " + ChannelHelper::colorForNick(userName, _ircClient->currentNick()) + "'>" + userName + "</span> " + processMessage(message, &hasUserNick);
+    line += "* " + static_cast<ServerModel*>(parent())->nickStyles()->style(userName, _ircClient->currentNick()).span + " " + processMessage(message, &hasUserNick);
 
     appendLine(line);
 
@@ -241,8 +359,52 @@ void ChannelModel::receiveCtcpAction(const QString &userName, QString message)
         emit newMessageReceived();
 }
 
+void ChannelModel::receiveHistory(const QList<IrcHistoryLine> &lines)
+{
+    TRACE_FUNCTION();
+    foreach (const IrcHistoryLine &line, lines)
+        log(line.isAction ? "action" : "message", line.userName, line.message, line.time);
+
+    if (!_isRendering)
+        return;
+
+    // Nobody is notified about the past, but the channel is marked like for new messages
+    bool hasUserNick = false;
+    bool displayTimestamps = appSettings()->displayTimestamps();
+    NickStyleCache *nickStyles = static_cast<ServerModel*>(parent())->nickStyles();
+    QStringList rendered;
+    QDate today = QDate::currentDate();
+
+    foreach (const IrcHistoryLine &line, lines)
+    {
+        QString html;
+
+        if (displayTimestamps)
+        {
+            // The playback may be days old, the lines that are not from today show their date
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(line.time);
+            html += time.toString(time.date() == today ? "HH:mm" : "yyyy-MM-dd HH:mm") + " ";
+        }
+
+        if (line.isAction)
+            html += "* " + nickStyles->style(line.userName, _ircClient->currentNick()).span + " " + processMessage(line.message, &hasUserNick);
+        else
+            html += nickStyles->style(line.userName, _ircClient->currentNick()).link + ": " + processMessage(line.message, &hasUserNick);
+
+        rendered.append(html);
+    }
+
+    appendLines(rendered);
+
+    if (hasUserNick || !name().startsWith('#'))
+        emit newMessageWithUserNickReceived();
+    else
+        emit newMessageReceived();
+}
+
 void ChannelModel::receiveTopic(const QString &value)
 {
+    log("topic", QString(), value);
     _topic = value;
     appendEmphasisedInfo("[TOPIC] " + _topic);
     emit topicChanged();
@@ -250,6 +412,7 @@ void ChannelModel::receiveTopic(const QString &value)
 
 void ChannelModel::receiveModeChange(const QString &mode, const QString &argument)
 {
+    log("mode", QString(), mode + " " + argument);
     appendEmphasisedInfo(QString("Channel mode is ") + mode + QString(", argument is ") + argument);
 }
 
@@ -261,6 +424,7 @@ void ChannelModel::receiveUserList(const QStringList &userList)
 
 void ChannelModel::updateUserList()
 {
+    TRACE_FUNCTION();
     // Alphabetic order for nick names
 
     QMap<QString, QString> strMap;
@@ -270,7 +434,12 @@ void ChannelModel::updateUserList()
     }
 
     _userNames = strMap.values();
+    // Nothing shows the list without rendering
+    if (!_isRendering)
+        return;
+
     _users->setStringList(_userNames);
+    _counters.userListResets++;
     emit usersChanged();
 }
 
@@ -401,6 +570,7 @@ AppSettings *ChannelModel::appSettings()
 
 void ChannelModel::dumpHtml(const QString &path)
 {
+    TRACE_FUNCTION();
     qDebug() << "dumping html to" << path;
     QFile *file;
     if (!QFile::exists(path))
@@ -421,6 +591,7 @@ void ChannelModel::dumpHtml(const QString &path)
 
 void ChannelModel::loadHtml(const QString &path)
 {
+    TRACE_FUNCTION();
     QFile file(path);
     file.open(QFile::ReadOnly);
     setChannelText(QString::fromUtf8(file.readAll()));
@@ -27,9 +27,24 @@
 
 class CommandParser;
 class AbstractIrcClient;
+struct IrcHistoryLine;
 class ServerModel;
 class AppSettings;
 
+// Counters of a channel, reported by Metrics
+struct ChannelCounters
+{
+    quint64 linesAppended, bytesAppended, userListResets;
+    // Time spent in the bindings of channelText, in microseconds
+    qint64 lastUpdateLatency, maxUpdateLatency, totalUpdateLatency;
+
+    ChannelCounters() :
+        linesAppended(0), bytesAppended(0), userListResets(0),
+        lastUpdateLatency(0), maxUpdateLatency(0), totalUpdateLatency(0)
+    {
+    }
+};
+
 class ChannelModel : public QObject
 {
 private:
@@ -58,17 +73,30 @@ private:
     QStringList _sentMessages;
     QList<const QString*> _possibleNickNames;
     int _currentCompletionIndex, _currentCompletionPosition, _displayedLines, _sentMessagesIndex;
+    ChannelCounters _counters;
 
     static QString _autoCompletionSuffix;
     static QRegExp _urlRegexp;
     static int _maxLineNumber, _deletableLines;
+    static bool _isRendering;
+
+    void log(const QString &type, const QString &nick, const QString &text = QString(), qint64 time = -1);
+    void removeOldestLines();
+    void channelTextAppended(int lines, int bytes, qint64 latency);
 
 public:
     explicit ChannelModel(ServerModel *parent, const QString &channelName, AbstractIrcClient *ircClient);
     ~ChannelModel();
 
+    // Without rendering, the events only keep the user lists up to date and go to the log, no HTML is built
+    static bool isRendering() { return _isRendering; }
+    static void setRendering(bool value) { _isRendering = value; }
+
     int userCount() { return _users->rowCount(); }
+    const ChannelCounters &counters() const { return _counters; }
+    int scrollbackBytes() const { return _channelText.size() * sizeof(QChar); }
     AppSettings *appSettings();
+    void setIrcClient(AbstractIrcClient *ircClient);
 
     void setCurrentMessage(const QString &value);
 
@@ -78,10 +106,13 @@ public:
 
     void receiveMessage(const QString &userName, QString message);
     void receiveCtcpAction(const QString &userName, QString message);
-    void receiveJoined(const QString &userName);
-    void receiveParted(const QString &userName, QString reason);
-    void receiveQuit(const QString &userName, QString reason);
-    void receiveNickChange(const QString &oldNick, const QString &newNick);
+    // Played back history, rendered with its own timestamps and shown in one update
+    void receiveHistory(const QList<IrcHistoryLine> &lines);
+    // Ignored events only update the user list, see IgnoreFilter
+    void receiveJoined(const QString &userName, bool isIgnored = false);
+    void receiveParted(const QString &userName, QString reason, bool isIgnored = false);
+    void receiveQuit(const QString &userName, QString reason, bool isIgnored = false);
+    void receiveNickChange(const QString &oldNick, const QString &newNick, bool isIgnored = false);
     void receiveMotd(QString motd);
     void receiveInvite(const QString &origin, const QString &receiver);
     void receiveKicked(const QString &origin, const QString &nick, QString message);
@@ -119,6 +150,7 @@ public slots:
     void updateUserList();
 
     void appendLine(const QString &line);
+    void appendLines(const QStringList &lines);
     void appendEmphasisedInfo(QString msg);
     void appendDeemphasisedInfo(QString msg);
     void appendError(QString msg);
@@ -0,0 +1,232 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDebug>
+
+#include "model/coreconnection.h"
+#include "model/ircmodel.h"
+#include "model/servermodel.h"
+#include "model/settings/appsettings.h"
+#include "model/settings/serversettings.h"
+#include "clients/remoteircclient.h"
+
+CoreConnection::CoreConnection(IrcModel *model) :
+    QObject(model),
+    _model(model),
+    _socket(new QLocalSocket(this)),
+    _liveSequence(0),
+    _isReady(false),
+    _lostEvents(0)
+{
+    connect(_socket, SIGNAL(readyRead()), this, SLOT(readSocket()));
+    connect(_socket, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(socketError(QLocalSocket::LocalSocketError)));
+    connect(_socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+
+    // From now on the model doesn't connect to the servers by itself
+    _model->setIsAttachedToCore(true);
+}
+
+void CoreConnection::open()
+{
+    // The servers of the core are matched with the settings by their URL
+    _model->appSettings()->loadServerSettings();
+
+    qDebug() << Q_FUNC_INFO << "attaching to the core at" << CoreProtocol::socketName();
+    _socket->connectToServer(CoreProtocol::socketName());
+}
+
+void CoreConnection::close()
+{
+    // The models send a QUIT when they are destroyed, which must not reach the core
+    detachClients();
+    _socket->disconnectFromServer();
+}
+
+void CoreConnection::detachClients()
+{
+    foreach (RemoteIrcClient *ircClient, _clients.values())
+        ircClient->detach();
+}
+
+void CoreConnection::call(int serverId, const QString &method, const QStringList &arguments)
+{
+    if (_socket->state() != QLocalSocket::ConnectedState)
+    {
+        qWarning() << Q_FUNC_INFO << "not attached to the core, can't call" << method;
+        return;
+    }
+
+    _socket->write(CoreProtocol::encode(QStringList() << "call" << QString::number(serverId) << method << arguments));
+}
+
+void CoreConnection::socketError(QLocalSocket::LocalSocketError error)
+{
+    qWarning() << Q_FUNC_INFO << error << _socket->errorString() << "- is the core running? (irc-chatter --headless --core)";
+}
+
+void CoreConnection::socketDisconnected()
+{
+    qWarning() << Q_FUNC_INFO << "detached from the core";
+    _isReady = false;
+    detachClients();
+
+    foreach (ServerModel *serverModel, _servers.values())
+        serverModel->serverSettings()->setIsConnected(false);
+}
+
+void CoreConnection::readSocket()
+{
+    while (_socket->canReadLine())
+        processLine(CoreProtocol::decode(_socket->readLine()));
+}
+
+void CoreConnection::processLine(const QStringList &fields)
+{
+    QString command = fields.value(0);
+
+    if (command == "hello")
+    {
+        // hello <key> <sequence> <history>
+        if (!_ring.attach(fields.value(1)))
+        {
+            _socket->disconnectFromServer();
+            return;
+        }
+
+        // The messages still in the ring are shown as the history of the channels
+        _liveSequence = fields.value(2).toUInt();
+        _ring.seek(_liveSequence - fields.value(3).toUInt());
+    }
+    else if (command == "server")
+    {
+        // server <id> <url> <nick> <connected>
+        addServer(fields.value(1).toInt(), fields.value(2), fields.value(3), fields.value(4) == "1");
+    }
+    else if (command == "channel")
+    {
+        // channel <id> <name> <topic> <users>
+        RemoteIrcClient *ircClient = _clients.value(fields.value(1).toInt());
+        if (ircClient)
+            ircClient->restoreChannel(fields.value(2), fields.value(3), fields.value(4).split(' ', QString::SkipEmptyParts));
+    }
+    else if (command == "ready")
+    {
+        qDebug() << Q_FUNC_INFO << "attached to the core with" << _clients.count() << "servers";
+        _isReady = true;
+        readEvents();
+    }
+    else if (command == "wake")
+    {
+        if (_isReady)
+            readEvents();
+    }
+    else
+    {
+        qWarning() << Q_FUNC_INFO << "unknown command from the core:" << command;
+    }
+}
+
+void CoreConnection::readEvents()
+{
+    CoreProtocol::Event event;
+    int lostEvents = 0;
+
+    forever
+    {
+        bool isHistory = (int)(_liveSequence - _ring.readSequence()) > 0;
+        if (!_ring.read(&event, &lostEvents))
+            break;
+
+        processEvent(event, isHistory);
+    }
+
+    if (lostEvents)
+    {
+        _lostEvents += lostEvents;
+        qWarning() << Q_FUNC_INFO << "fell behind the core and lost" << lostEvents << "events";
+    }
+}
+
+void CoreConnection::processEvent(const CoreProtocol::Event &event, bool isHistory)
+{
+    if (event.type == CoreProtocol::ServerAdded)
+    {
+        if (!isHistory)
+            addServer(event.serverId, event.fields[CoreProtocol::Text], event.fields[CoreProtocol::Nick], false);
+        return;
+    }
+
+    if (event.type == CoreProtocol::ServerRemoved)
+    {
+        if (!isHistory)
+            removeServer(event.serverId);
+        return;
+    }
+
+    RemoteIrcClient *ircClient = _clients.value(event.serverId);
+    if (!ircClient)
+        return;
+
+    if (isHistory)
+    {
+        // Everything else is already in the snapshot, and the history mustn't bring back parted channels
+        if (event.type != CoreProtocol::Message && event.type != CoreProtocol::CtcpAction)
+            return;
+        if (!_servers[event.serverId]->channels().contains(event.fields[CoreProtocol::Channel]))
+            return;
+    }
+
+    ircClient->dispatch(event);
+}
+
+void CoreConnection::addServer(int serverId, const QString &url, const QString &nick, bool isConnected)
+{
+    if (_clients.contains(serverId))
+        return;
+
+    ServerSettings *serverSettings = 0;
+    foreach (ServerSettings *settings, *(_model->appSettings()->serverSettings()->getList<ServerSettings>()))
+    {
+        if (settings->serverUrl() == url)
+        {
+            serverSettings = settings;
+            break;
+        }
+    }
+
+    // The core has its own settings, this is only for showing the server
+    if (!serverSettings)
+        serverSettings = new ServerSettings(this, url);
+
+    RemoteIrcClient *ircClient = new RemoteIrcClient(_model, serverSettings, this, serverId, nick);
+    _clients.insert(serverId, ircClient);
+    _servers.insert(serverId, _model->attachServer(serverSettings, ircClient));
+
+    serverSettings->setIsConnecting(false);
+    serverSettings->setIsConnected(isConnected);
+}
+
+void CoreConnection::removeServer(int serverId)
+{
+    RemoteIrcClient *ircClient = _clients.take(serverId);
+    ServerModel *serverModel = _servers.take(serverId);
+    if (!ircClient || !serverModel)
+        return;
+
+    ircClient->detach();
+    _model->disconnectFromServer(serverModel->serverSettings());
+}
@@ -0,0 +1,74 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef CORECONNECTION_H
+#define CORECONNECTION_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtNetwork/QLocalSocket>
+
+#include "helpers/coreprotocol.h"
+
+class IrcModel;
+class ServerModel;
+class RemoteIrcClient;
+
+// Runs in a UI process which is attached to a core (irc-chatter --attach).
+// The servers of the core get a model with a RemoteIrcClient here, the
+// channels are restored from the snapshot that the core sends, and the
+// recent messages of the channels from the event ring. The UI can quit
+// and attach again any time, the core stays connected to the servers.
+
+class CoreConnection : public QObject
+{
+    Q_OBJECT
+    IrcModel *_model;
+    QLocalSocket *_socket;
+    EventRing _ring;
+    QHash<int, RemoteIrcClient*> _clients;
+    QHash<int, ServerModel*> _servers;
+    // Events before this sequence happened before attaching, the snapshot covers them
+    quint32 _liveSequence;
+    bool _isReady;
+    int _lostEvents;
+
+    void processLine(const QStringList &fields);
+    void processEvent(const CoreProtocol::Event &event, bool isHistory);
+    void addServer(int serverId, const QString &url, const QString &nick, bool isConnected);
+    void removeServer(int serverId);
+    void detachClients();
+
+public:
+    explicit CoreConnection(IrcModel *model);
+    void call(int serverId, const QString &method, const QStringList &arguments);
+    int lostEvents() const { return _lostEvents; }
+
+public slots:
+    void open();
+    void close();
+
+private slots:
+    void readSocket();
+    void readEvents();
+    void socketError(QLocalSocket::LocalSocketError error);
+    void socketDisconnected();
+
+};
+
+#endif // CORECONNECTION_H
@@ -0,0 +1,441 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include "model/coreserver.h"
+#include "model/ircmodel.h"
+#include "model/servermodel.h"
+#include "model/settings/serversettings.h"
+#include "clients/abstractircclient.h"
+
+// Key of the shared memory of the event ring, after the name of the socket
+#define CORESERVER_RING_KEY_SUFFIX "-events"
+// Names of a user list in one event, the rest goes in the following ones
+#define CORESERVER_USERNAMES_CHUNK 400
+
+// The methods of the clients that the UIs may call, with their number of arguments.
+// sendRaw is left out, any process which can connect to the socket could send anything with it.
+static const struct
+{
+    const char *name;
+    int argumentCount;
+} _callableMethods[] = {
+    { "quit", 1 },
+    { "joinChannel", 2 },
+    { "partChannel", 2 },
+    { "queryUser", 1 },
+    { "closeUser", 1 },
+    { "sendCtcpAction", 2 },
+    { "sendCtcpRequest", 2 },
+    { "sendMessage", 2 },
+    { "requestTopic", 1 },
+    { "setTopic", 2 },
+    { "changeNick", 1 },
+    { "kick", 3 },
+    { "sendWhois", 1 }
+};
+
+CoreServer::CoreServer(IrcModel *model) :
+    QObject(model),
+    _model(model),
+    _server(new QLocalServer(this)),
+    _nextServerId(1),
+    _isWakePending(false)
+{
+    connect(_server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+CoreServer::~CoreServer()
+{
+    _server->close();
+}
+
+bool CoreServer::start()
+{
+    if (!_ring.create(CoreProtocol::socketName() + CORESERVER_RING_KEY_SUFFIX))
+    {
+        qWarning() << Q_FUNC_INFO << "is another core running already?";
+        return false;
+    }
+
+    // The ring could be created, so the socket is left behind by a core that crashed
+    QLocalServer::removeServer(CoreProtocol::socketName());
+#if QT_VERSION >= 0x050000
+    // Only the processes of the same user may attach
+    _server->setSocketOptions(QLocalServer::UserAccessOption);
+#endif
+    if (!_server->listen(CoreProtocol::socketName()))
+    {
+        qWarning() << Q_FUNC_INFO << "can't listen:" << _server->errorString();
+        return false;
+    }
+
+    foreach (ServerModel *serverModel, _model->servers())
+        serverAttached(serverModel);
+    connect(_model, SIGNAL(serverAttached(ServerModel*)), this, SLOT(serverAttached(ServerModel*)));
+
+    qDebug() << "the core is listening on" << _server->fullServerName();
+    return true;
+}
+
+int CoreServer::senderId()
+{
+    return _clientIds.value(sender(), 0);
+}
+
+void CoreServer::publish(int type, int serverId, const QString &channel, const QString &nick, const QString &text, const QString &extra, const QString &hostmask)
+{
+    if (!serverId)
+        return;
+
+    // Unless it's given, the prefix of the message that the client is emitting
+    if (hostmask.isEmpty() && _clientIds.contains(sender()))
+        _ring.publish(type, serverId, channel, nick, text, extra, static_cast<AbstractIrcClient*>(sender())->senderHostmask());
+    else
+        _ring.publish(type, serverId, channel, nick, text, extra, hostmask);
+
+    // One wake for everything that is published in this iteration of the event loop
+    if (!_isWakePending && _sockets.count())
+    {
+        _isWakePending = true;
+        QTimer::singleShot(0, this, SLOT(wakeSockets()));
+    }
+}
+
+void CoreServer::wakeSockets()
+{
+    _isWakePending = false;
+    QByteArray line = CoreProtocol::encode(QStringList("wake"));
+
+    foreach (QLocalSocket *socket, _sockets)
+    {
+        // A UI which is still asleep from the last wake doesn't need another one
+        if (socket->bytesToWrite() == 0)
+            socket->write(line);
+    }
+}
+
+void CoreServer::serverAttached(ServerModel *serverModel)
+{
+    int serverId = _nextServerId++;
+    _serverIds.insert(serverModel, serverId);
+    _servers.insert(serverId, serverModel);
+
+    connect(serverModel, SIGNAL(destroyed(QObject*)), this, SLOT(serverDestroyed(QObject*)));
+    connect(serverModel, SIGNAL(ircClientChanged()), this, SLOT(ircClientChanged()));
+    tapClient(serverModel->ircClient(), serverId);
+
+    publish(CoreProtocol::ServerAdded, serverId, QString(), serverModel->ircClient()->currentNick(), serverModel->url());
+}
+
+void CoreServer::serverDestroyed(QObject *serverModel)
+{
+    int serverId = _serverIds.take(serverModel);
+    _servers.remove(serverId);
+    publish(CoreProtocol::ServerRemoved, serverId);
+}
+
+void CoreServer::ircClientChanged()
+{
+    ServerModel *serverModel = static_cast<ServerModel*>(sender());
+    int serverId = _serverIds.value(serverModel);
+
+    // The events of the old client are not published while it's draining
+    foreach (QObject *ircClient, _clientIds.keys(serverId))
+    {
+        disconnect(ircClient, 0, this, 0);
+        _clientIds.remove(ircClient);
+    }
+
+    tapClient(serverModel->ircClient(), serverId);
+    publish(CoreProtocol::OwnNick, serverId, QString(), serverModel->ircClient()->currentNick());
+}
+
+void CoreServer::clientDestroyed(QObject *ircClient)
+{
+    _clientIds.remove(ircClient);
+}
+
+void CoreServer::tapClient(AbstractIrcClient *ircClient, int serverId)
+{
+    _clientIds.insert(ircClient, serverId);
+    connect(ircClient, SIGNAL(destroyed(QObject*)), this, SLOT(clientDestroyed(QObject*)));
+
+    connect(ircClient, SIGNAL(connectedToServer()), this, SLOT(connectedToServer()));
+    connect(ircClient, SIGNAL(disconnectedFromServer()), this, SLOT(disconnectedFromServer()));
+    connect(ircClient, SIGNAL(receiveCtcpAction(QString,QString,QString)), this, SLOT(receiveCtcpAction(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveCtcpReply(QString,QString)), this, SLOT(receiveCtcpReply(QString,QString)));
+    connect(ircClient, SIGNAL(receiveCtcpRequest(QString,QString)), this, SLOT(receiveCtcpRequest(QString,QString)));
+    connect(ircClient, SIGNAL(receiveError(QString)), this, SLOT(receiveError(QString)));
+    connect(ircClient, SIGNAL(receiveJoin(QString,QString)), this, SLOT(receiveJoin(QString,QString)));
+    connect(ircClient, SIGNAL(receiveKick(QString,QString,QString,QString)), this, SLOT(receiveKick(QString,QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveMessage(QString,QString,QString)), this, SLOT(receiveMessage(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveHistory(QString,QList<IrcHistoryLine>)), this, SLOT(receiveHistory(QString,QList<IrcHistoryLine>)));
+    connect(ircClient, SIGNAL(receiveModeChange(QString,QString,QString)), this, SLOT(receiveModeChange(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveMotd(QString)), this, SLOT(receiveMotd(QString)));
+    connect(ircClient, SIGNAL(receiveNickChange(QString,QString)), this, SLOT(receiveNickChange(QString,QString)));
+    connect(ircClient, SIGNAL(receivePart(QString,QString,QString)), this, SLOT(receivePart(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveQuit(QString,QString)), this, SLOT(receiveQuit(QString,QString)));
+    connect(ircClient, SIGNAL(receiveTopic(QString,QString)), this, SLOT(receiveTopic(QString,QString)));
+    connect(ircClient, SIGNAL(receiveUserNames(QString,QStringList)), this, SLOT(receiveUserNames(QString,QStringList)));
+    connect(ircClient, SIGNAL(joinedChannel(QString)), this, SLOT(joinedChannel(QString)));
+    connect(ircClient, SIGNAL(joinedChannels(QStringList)), this, SLOT(joinedChannels(QStringList)));
+    connect(ircClient, SIGNAL(queriedUser(QString)), this, SLOT(queriedUser(QString)));
+    connect(ircClient, SIGNAL(partedChannel(QString)), this, SLOT(partedChannel(QString)));
+    connect(ircClient, SIGNAL(closedUser(QString)), this, SLOT(closedUser(QString)));
+}
+
+void CoreServer::newConnection()
+{
+    while (_server->hasPendingConnections())
+    {
+        QLocalSocket *socket = _server->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readSocket()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+
+        qDebug() << Q_FUNC_INFO << "a UI attached to the core";
+        sendSnapshot(socket);
+        _sockets.append(socket);
+    }
+}
+
+void CoreServer::socketDisconnected()
+{
+    QLocalSocket *socket = static_cast<QLocalSocket*>(sender());
+    qDebug() << Q_FUNC_INFO << "a UI detached from the core";
+
+    _sockets.removeAll(socket);
+    socket->deleteLater();
+}
+
+void CoreServer::sendSnapshot(QLocalSocket *socket)
+{
+    // The UI follows the ring from this sequence, everything before it is in the snapshot
+    socket->write(CoreProtocol::encode(QStringList() << "hello" << _ring.key() << QString::number(_ring.writeSequence())
+                                       << QString::number(_ring.historyLength())));
+
+    foreach (int serverId, _servers.keys())
+    {
+        ServerModel *serverModel = _servers[serverId];
+        socket->write(CoreProtocol::encode(QStringList() << "server" << QString::number(serverId) << serverModel->url()
+                                           << serverModel->ircClient()->currentNick()
+                                           << (serverModel->serverSettings()->isConnected() ? "1" : "0")));
+
+        // The default channel first, the UI makes the first channel of a server its default one
+        QList<ChannelModel*> channels = serverModel->channels().values();
+        int defaultIndex = channels.indexOf(serverModel->defaultChannel());
+        if (defaultIndex > 0)
+            channels.move(defaultIndex, 0);
+
+        foreach (ChannelModel *channel, channels)
+        {
+            socket->write(CoreProtocol::encode(QStringList() << "channel" << QString::number(serverId) << channel->name()
+                                               << channel->topic() << channel->userNames().join(" ")));
+        }
+    }
+
+    socket->write(CoreProtocol::encode(QStringList("ready")));
+}
+
+void CoreServer::readSocket()
+{
+    QLocalSocket *socket = static_cast<QLocalSocket*>(sender());
+
+    while (socket->canReadLine())
+    {
+        QStringList fields = CoreProtocol::decode(socket->readLine());
+
+        if (fields.value(0) == "call")
+            processCall(fields);
+        else
+            qWarning() << Q_FUNC_INFO << "unknown command from a UI:" << fields.value(0);
+    }
+}
+
+void CoreServer::processCall(const QStringList &fields)
+{
+    // call <server id> <method> <arguments...>
+    ServerModel *serverModel = _servers.value(fields.value(1).toInt());
+    QString method = fields.value(2);
+    QStringList arguments = fields.mid(3);
+
+    if (!serverModel)
+    {
+        qDebug() << Q_FUNC_INFO << "the server of" << method << "is gone";
+        return;
+    }
+
+    for (unsigned i = 0; i < sizeof(_callableMethods) / sizeof(_callableMethods[0]); i++)
+    {
+        if (method != _callableMethods[i].name)
+            continue;
+
+        if (arguments.count() != _callableMethods[i].argumentCount)
+            break;
+
+        AbstractIrcClient *ircClient = serverModel->ircClient();
+        const char *name = _callableMethods[i].name;
+
+        if (arguments.count() == 1)
+            QMetaObject::invokeMethod(ircClient, name, Q_ARG(QString, arguments[0]));
+        else if (arguments.count() == 2)
+            QMetaObject::invokeMethod(ircClient, name, Q_ARG(QString, arguments[0]), Q_ARG(QString, arguments[1]));
+        else
+            QMetaObject::invokeMethod(ircClient, name, Q_ARG(QString, arguments[0]), Q_ARG(QString, arguments[1]), Q_ARG(QString, arguments[2]));
+
+        return;
+    }
+
+    qWarning() << Q_FUNC_INFO << "a UI can't call" << method << "with" << arguments.count() << "arguments";
+}
+
+void CoreServer::connectedToServer()
+{
+    int serverId = senderId();
+    publish(CoreProtocol::OwnNick, serverId, QString(), static_cast<AbstractIrcClient*>(sender())->currentNick());
+    publish(CoreProtocol::Connected, serverId);
+}
+
+void CoreServer::disconnectedFromServer()
+{
+    publish(CoreProtocol::Disconnected, senderId());
+}
+
+void CoreServer::receiveUserNames(const QString &channelName, const QStringList &userNames)
+{
+    // A slot holds a few hundred characters, so long lists are split
+    int serverId = senderId();
+    QString chunk;
+
+    foreach (const QString &userName, userNames)
+    {
+        if (chunk.length() + userName.length() >= CORESERVER_USERNAMES_CHUNK)
+        {
+            publish(CoreProtocol::UserNames, serverId, channelName, QString(), chunk, "more");
+            chunk.clear();
+        }
+
+        if (chunk.length())
+            chunk += ' ';
+        chunk += userName;
+    }
+
+    publish(CoreProtocol::UserNames, serverId, channelName, QString(), chunk);
+}
+
+void CoreServer::receiveMessage(const QString &channelName, const QString &userName, const QString &message)
+{
+    publish(CoreProtocol::Message, senderId(), channelName, userName, message);
+}
+
+void CoreServer::receiveCtcpRequest(const QString &userName, const QString &message)
+{
+    publish(CoreProtocol::CtcpRequest, senderId(), QString(), userName, message);
+}
+
+void CoreServer::receiveCtcpReply(const QString &userName, const QString &message)
+{
+    publish(CoreProtocol::CtcpReply, senderId(), QString(), userName, message);
+}
+
+void CoreServer::receiveCtcpAction(const QString &channelName, const QString &userName, const QString &message)
+{
+    publish(CoreProtocol::CtcpAction, senderId(), channelName, userName, message);
+}
+
+void CoreServer::receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines)
+{
+    int serverId = senderId();
+    foreach (const IrcHistoryLine &line, lines)
+        publish(line.isAction ? CoreProtocol::CtcpAction : CoreProtocol::Message, serverId, channelName, line.userName, line.message, QString::number(line.time), line.hostmask);
+}
+
+void CoreServer::receivePart(const QString &channelName, const QString &userName, const QString &message)
+{
+    publish(CoreProtocol::Part, senderId(), channelName, userName, message);
+}
+
+void CoreServer::receiveJoin(const QString &channelName, const QString &userName)
+{
+    publish(CoreProtocol::Join, senderId(), channelName, userName);
+}
+
+void CoreServer::receiveTopic(const QString &channelName, const QString &topic)
+{
+    publish(CoreProtocol::Topic, senderId(), channelName, QString(), topic);
+}
+
+void CoreServer::receiveKick(const QString &channelName, const QString &userName, const QString &kickedUserName, const QString &message)
+{
+    publish(CoreProtocol::Kick, senderId(), channelName, userName, message, kickedUserName);
+}
+
+void CoreServer::receiveModeChange(const QString &channelName, const QString &mode, const QString &arguments)
+{
+    publish(CoreProtocol::ModeChange, senderId(), channelName, QString(), mode, arguments);
+}
+
+void CoreServer::receiveQuit(const QString &userName, const QString &message)
+{
+    publish(CoreProtocol::Quit, senderId(), QString(), userName, message);
+}
+
+void CoreServer::receiveNickChange(const QString &oldNick, const QString &newNick)
+{
+    publish(CoreProtocol::NickChange, senderId(), QString(), oldNick, QString(), newNick);
+}
+
+void CoreServer::receiveMotd(const QString &motd)
+{
+    publish(CoreProtocol::Motd, senderId(), QString(), QString(), motd);
+}
+
+void CoreServer::receiveError(const QString &error)
+{
+    publish(CoreProtocol::Error, senderId(), QString(), QString(), error);
+}
+
+void CoreServer::joinedChannel(const QString &channelName)
+{
+    publish(CoreProtocol::JoinedChannel, senderId(), channelName);
+}
+
+void CoreServer::joinedChannels(const QStringList &channelNames)
+{
+    int serverId = senderId();
+    foreach (const QString &channelName, channelNames)
+        publish(CoreProtocol::JoinedChannel, serverId, channelName);
+}
+
+void CoreServer::queriedUser(const QString &channelName)
+{
+    publish(CoreProtocol::QueriedUser, senderId(), channelName);
+}
+
+void CoreServer::partedChannel(const QString &channelName)
+{
+    publish(CoreProtocol::PartedChannel, senderId(), channelName);
+}
+
+void CoreServer::closedUser(const QString &channelName)
+{
+    publish(CoreProtocol::ClosedUser, senderId(), channelName);
+}
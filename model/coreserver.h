@@ -0,0 +1,100 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef CORESERVER_H
+#define CORESERVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+
+#include "helpers/coreprotocol.h"
+#include "clients/abstractircclient.h"
+
+class QLocalServer;
+class QLocalSocket;
+class IrcModel;
+class ServerModel;
+
+// Runs in the core process (irc-chatter --headless --core). Publishes what
+// the clients of the servers emit into the event ring, and serves the UIs
+// which attach to it: a UI gets a snapshot of the servers and channels when
+// it attaches, then follows the ring. The commands of the UIs are passed on
+// to the clients. See helpers/coreprotocol.h for the protocol.
+
+class CoreServer : public QObject
+{
+    Q_OBJECT
+    IrcModel *_model;
+    QLocalServer *_server;
+    QList<QLocalSocket*> _sockets;
+    EventRing _ring;
+    QHash<QObject*, int> _serverIds, _clientIds;
+    QHash<int, ServerModel*> _servers;
+    int _nextServerId;
+    bool _isWakePending;
+
+    int senderId();
+    void publish(int type, int serverId, const QString &channel = QString(), const QString &nick = QString(),
+                 const QString &text = QString(), const QString &extra = QString(), const QString &hostmask = QString());
+    void tapClient(AbstractIrcClient *ircClient, int serverId);
+    void sendSnapshot(QLocalSocket *socket);
+    void processCall(const QStringList &fields);
+
+public:
+    explicit CoreServer(IrcModel *model);
+    ~CoreServer();
+    bool start();
+
+private slots:
+    void serverAttached(ServerModel *serverModel);
+    void serverDestroyed(QObject *serverModel);
+    void ircClientChanged();
+    void clientDestroyed(QObject *ircClient);
+    void newConnection();
+    void readSocket();
+    void socketDisconnected();
+    void wakeSockets();
+
+    // Same signatures as the signals of AbstractIrcClient
+    void connectedToServer();
+    void disconnectedFromServer();
+    void receiveUserNames(const QString &channelName, const QStringList &userNames);
+    void receiveMessage(const QString &channelName, const QString &userName, const QString &message);
+    void receiveCtcpRequest(const QString &userName, const QString &message);
+    void receiveCtcpReply(const QString &userName, const QString &message);
+    void receiveCtcpAction(const QString &channelName, const QString &userName, const QString &message);
+    void receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines);
+    void receivePart(const QString &channelName, const QString &userName, const QString &message);
+    void receiveJoin(const QString &channelName, const QString &userName);
+    void receiveTopic(const QString &channelName, const QString &topic);
+    void receiveKick(const QString &channelName, const QString &userName, const QString &kickedUserName, const QString &message);
+    void receiveModeChange(const QString &channelName, const QString &mode, const QString &arguments);
+    void receiveQuit(const QString &userName, const QString &message);
+    void receiveNickChange(const QString &oldNick, const QString &newNick);
+    void receiveMotd(const QString &motd);
+    void receiveError(const QString &error);
+    void joinedChannel(const QString &channelName);
+    void joinedChannels(const QStringList &channelNames);
+    void queriedUser(const QString &channelName);
+    void partedChannel(const QString &channelName);
+    void closedUser(const QString &channelName);
+
+};
+
+#endif // CORESERVER_H
@@ -0,0 +1,280 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QHash>
+
+#include "model/ignorefilter.h"
+
+// The rules are the same for every server, so a channel starts with any of the prefixes of RFC 2811
+#define IGNOREFILTER_CHANNEL_PREFIXES "#&!+"
+
+static bool isLiteral(const QString &pattern)
+{
+    return !pattern.contains('*') && !pattern.contains('?');
+}
+
+IgnoreFilter::IgnoreFilter() :
+    _events(0)
+{
+}
+
+int IgnoreFilter::parseEventType(const QString &name)
+{
+    QString lowerName = name.toLower();
+
+    if (lowerName == "message")
+        return Message;
+    if (lowerName == "action")
+        return Action;
+    if (lowerName == "ctcp")
+        return Ctcp;
+    if (lowerName == "join")
+        return Join;
+    if (lowerName == "part")
+        return Part;
+    if (lowerName == "quit")
+        return Quit;
+    if (lowerName == "nick")
+        return NickChange;
+    if (lowerName == "kick")
+        return Kick;
+
+    return 0;
+}
+
+QStringList IgnoreFilter::compile(const QStringList &rules)
+{
+    // Rules which stay keep their hits
+    QHash<QString, quint64> oldHits;
+    foreach (const Rule &rule, _rules)
+        oldHits.insert(rule.text, rule.hits);
+
+    _rules.clear();
+    _rulesByHost.clear();
+    _rulesByNick.clear();
+    _wildcardRules.clear();
+    _textRules.clear();
+    _events = 0;
+
+    QStringList invalidRules;
+
+    foreach (const QString &ruleText, rules)
+    {
+        Rule rule;
+        rule.text = ruleText.trimmed();
+        rule.isRegExp = false;
+        rule.events = 0;
+        rule.hits = oldHits.value(rule.text);
+
+        if (rule.text.isEmpty())
+            continue;
+
+        // A regular expression may contain spaces, the options start after its last slash
+        QString pattern, options;
+        int patternEnd = rule.text.startsWith('/') ? rule.text.lastIndexOf('/') : -1;
+        if (patternEnd > 1)
+        {
+            pattern = rule.text.left(patternEnd + 1);
+            options = rule.text.mid(patternEnd + 1);
+        }
+        else
+        {
+            pattern = rule.text.section(' ', 0, 0);
+            options = rule.text.section(' ', 1);
+        }
+
+        bool isValid = true;
+        foreach (const QString &option, options.split(' ', QString::SkipEmptyParts))
+        {
+            if (QString(IGNOREFILTER_CHANNEL_PREFIXES).contains(option.at(0)))
+            {
+                rule.channels.append(option.toLower());
+            }
+            else
+            {
+                int eventType = parseEventType(option);
+                isValid = isValid && eventType;
+                rule.events |= eventType;
+            }
+        }
+
+        if (!rule.events)
+            rule.events = AllEvents;
+
+        if (patternEnd > 1)
+        {
+            rule.isRegExp = true;
+            rule.regExp = QRegExp(pattern.mid(1, pattern.length() - 2), Qt::CaseInsensitive);
+            isValid = isValid && rule.regExp.isValid();
+        }
+        else
+        {
+            // nick, nick!user, user@host or nick!user@host, the missing parts match anything
+            QString lowerPattern = pattern.toLower();
+            int bang = lowerPattern.indexOf('!'), at = lowerPattern.indexOf('@');
+
+            if (at != -1 && at < bang)
+                isValid = false;
+
+            rule.nick = bang != -1 ? lowerPattern.left(bang) : (at != -1 ? QString() : lowerPattern);
+            rule.user = bang != -1 ? lowerPattern.mid(bang + 1, at == -1 ? -1 : at - bang - 1) : (at != -1 ? lowerPattern.left(at) : QString());
+            rule.host = at != -1 ? lowerPattern.mid(at + 1) : QString();
+
+            if (rule.nick.isEmpty())
+                rule.nick = "*";
+            if (rule.user.isEmpty())
+                rule.user = "*";
+            if (rule.host.isEmpty())
+                rule.host = "*";
+        }
+
+        if (!isValid)
+        {
+            invalidRules.append(ruleText);
+            continue;
+        }
+
+        int index = _rules.count();
+        _rules.append(rule);
+        _events |= rule.events;
+
+        if (rule.isRegExp)
+            _textRules.append(index);
+        else if (isLiteral(rule.host))
+            _rulesByHost.insert(rule.host, index);
+        else if (isLiteral(rule.nick))
+            _rulesByNick.insert(rule.nick, index);
+        else
+            _wildcardRules.append(index);
+    }
+
+    return invalidRules;
+}
+
+bool IgnoreFilter::isIgnored(int eventType, const QString &channelName, const QString &nick, const QString &hostmask, const QString &text)
+{
+    // Most events are let through here, when there are no rules for them
+    if (!(_events & eventType))
+        return false;
+
+    QString lowerNick = nick.toLower(), lowerChannel = channelName.toLower(), user, host;
+
+    // The hostmask is only used if it's the one of this nick
+    int bang = hostmask.indexOf('!'), at = hostmask.indexOf('@', bang + 1);
+    if (bang == nick.length() && at != -1 && hostmask.startsWith(nick, Qt::CaseInsensitive))
+    {
+        user = hostmask.mid(bang + 1, at - bang - 1).toLower();
+        host = hostmask.mid(at + 1).toLower();
+    }
+
+    if (host.length())
+    {
+        for (QMultiHash<QString, int>::const_iterator i = _rulesByHost.constFind(host); i != _rulesByHost.constEnd() && i.key() == host; ++i)
+        {
+            if (matches(_rules[i.value()], eventType, lowerChannel, lowerNick, user, host, text))
+                return true;
+        }
+    }
+
+    for (QMultiHash<QString, int>::const_iterator i = _rulesByNick.constFind(lowerNick); i != _rulesByNick.constEnd() && i.key() == lowerNick; ++i)
+    {
+        if (matches(_rules[i.value()], eventType, lowerChannel, lowerNick, user, host, text))
+            return true;
+    }
+
+    foreach (int index, _wildcardRules)
+    {
+        if (matches(_rules[index], eventType, lowerChannel, lowerNick, user, host, text))
+            return true;
+    }
+
+    if (text.length())
+    {
+        foreach (int index, _textRules)
+        {
+            if (matches(_rules[index], eventType, lowerChannel, lowerNick, user, host, text))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+bool IgnoreFilter::matches(Rule &rule, int eventType, const QString &channel, const QString &nick, const QString &user, const QString &host, const QString &text)
+{
+    if (!(rule.events & eventType))
+        return false;
+    if (rule.channels.count() && !rule.channels.contains(channel))
+        return false;
+
+    bool isMatch = rule.isRegExp
+            ? rule.regExp.indexIn(text) != -1
+            : wildcardMatch(rule.nick, nick) && wildcardMatch(rule.user, user) && wildcardMatch(rule.host, host);
+
+    if (isMatch)
+        rule.hits++;
+
+    return isMatch;
+}
+
+QStringList IgnoreFilter::rules() const
+{
+    QStringList result;
+    foreach (const Rule &rule, _rules)
+        result.append(rule.text);
+
+    return result;
+}
+
+bool IgnoreFilter::wildcardMatch(const QString &pattern, const QString &str)
+{
+    if (pattern.length() == 1 && pattern[0] == '*')
+        return true;
+
+    // Backtracks only to the last star, so it's linear for the usual masks
+    const QChar *p = pattern.constData(), *pEnd = p + pattern.length();
+    const QChar *s = str.constData(), *sEnd = s + str.length();
+    const QChar *star = 0, *starMatch = 0;
+
+    while (s < sEnd)
+    {
+        if (p < pEnd && (*p == '?' || *p == *s))
+        {
+            p++;
+            s++;
+        }
+        else if (p < pEnd && *p == '*')
+        {
+            star = p++;
+            starMatch = s;
+        }
+        else if (star)
+        {
+            p = star + 1;
+            s = ++starMatch;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (p < pEnd && *p == '*')
+        p++;
+
+    return p == pEnd;
+}
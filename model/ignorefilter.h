@@ -0,0 +1,95 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef IGNOREFILTER_H
+#define IGNOREFILTER_H
+
+#include <QtCore/QMultiHash>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+// Decides which events of the servers are dropped before any channel sees
+// them. A rule is a pattern, optionally followed by event types and
+// channels, separated by spaces:
+//
+//   spammer                         every event of a nick
+//   *!*@*.example.com message       a hostmask, with * and ? as wildcards
+//   /buy .* now/ message #channel   a regular expression for the text
+//
+// The event types are message, action, ctcp, join, part, quit, nick and kick,
+// the channels start with #, &, ! or +.
+// The rules are compiled into lookup tables: the hostmasks with a literal
+// host are looked up by the host, the ones with a literal nick by the nick,
+// and only the rest are matched one by one. Every rule counts its hits.
+
+class IgnoreFilter
+{
+public:
+    enum EventType
+    {
+        Message = 0x01,
+        Action = 0x02,
+        Ctcp = 0x04,
+        Join = 0x08,
+        Part = 0x10,
+        Quit = 0x20,
+        NickChange = 0x40,
+        Kick = 0x80,
+        AllEvents = 0xff
+    };
+
+private:
+    struct Rule
+    {
+        QString text;
+        // Lowercased parts of the hostmask
+        QString nick, user, host;
+        QRegExp regExp;
+        bool isRegExp;
+        int events;
+        // Lowercased, empty means every channel
+        QStringList channels;
+        quint64 hits;
+    };
+
+    QVector<Rule> _rules;
+    QMultiHash<QString, int> _rulesByHost, _rulesByNick;
+    QList<int> _wildcardRules, _textRules;
+    // The events that any of the rules are about, the rest is let through right away
+    int _events;
+
+    bool matches(Rule &rule, int eventType, const QString &channel, const QString &nick, const QString &user, const QString &host, const QString &text);
+    static int parseEventType(const QString &name);
+
+public:
+    IgnoreFilter();
+
+    // Replaces the rules, returns the ones that are not valid
+    QStringList compile(const QStringList &rules);
+    bool isEmpty() const { return _rules.isEmpty(); }
+    // The hostmask is nick!user@host of the sender if it is known
+    bool isIgnored(int eventType, const QString &channelName, const QString &nick, const QString &hostmask, const QString &text = QString());
+
+    QStringList rules() const;
+    quint64 hits(int rule) const { return _rules[rule].hits; }
+
+    static bool wildcardMatch(const QString &pattern, const QString &str);
+
+};
+
+#endif // IGNOREFILTER_H
@@ -22,6 +22,11 @@
 #include "model/ircmodel.h"
 #include "settings/appsettings.h"
 #include "clients/communiircclient.h"
+#include "clients/connectionracer.h"
+#include "helpers/tracer.h"
+
+// Number of servers that may be connecting at the same time
+#define MAX_CONNECTS_IN_FLIGHT 4
 
 static bool channelLessThan(ChannelModel * m1, ChannelModel *m2)
 {
@@ -40,9 +45,13 @@ IrcModel::IrcModel(QObject *parent, AppSettings *appSettings) :
     _isAppInFocus(true),
     _appSettings(appSettings),
     _isOnline(false),
-    _networkConfigurationManager(new QNetworkConfigurationManager(this))
+    _isAttachedToCore(false),
+    _networkConfigurationManager(new QNetworkConfigurationManager(this)),
+    _channelListResets(0)
 {
     _isOnline = _networkConfigurationManager->isOnline();
+    compileIgnoreRules();
+    connect(_appSettings, SIGNAL(ignoreRulesChanged()), this, SLOT(compileIgnoreRules()));
 
     connect(_networkConfigurationManager, SIGNAL(onlineStateChanged(bool)), this, SLOT(onlineStateChanged(bool)));
     connect(_networkConfigurationManager, SIGNAL(configurationChanged(QNetworkConfiguration)), this, SLOT(networkConfigurationChanged(QNetworkConfiguration)));
@@ -52,13 +61,46 @@ void IrcModel::networkConfigurationChanged(QNetworkConfiguration config)
 {
     qDebug() << Q_FUNC_INFO << "config details" << config.name() << config.identifier() << config.state();
 
+    if (_isAttachedToCore)
+        return;
+
     if (config.identifier() != _lastNetConfigId && config.state() == QNetworkConfiguration::Active)
     {
-        onlineStateChanged(false);
-        QTimer::singleShot(2000, this, SLOT(attemptReconnect()));
+        if (!_isOnline)
+        {
+            // Coming online, connecting the queued servers too
+            attemptReconnect();
+            return;
+        }
+
+        _lastNetConfigId = config.identifier();
+        // The addresses that worked best on the old network may not on the new one
+        ConnectionRacer::clearCache();
+
+        foreach (ServerModel *serverModel, _servers)
+        {
+            if (serverModel->serverSettings()->isConnected())
+            {
+                // Opening a new connection on the new network before closing the old one
+                serverModel->migrateConnection(new CommuniIrcClient(this, serverModel->serverSettings()));
+            }
+            else
+            {
+                // Reconnecting right away, if the new network isn't usable yet,
+                // the reconnect engine of the client retries with backoff
+                serverModel->connectToServer();
+            }
+        }
     }
 }
 
+void IrcModel::compileIgnoreRules()
+{
+    QStringList invalidRules = _ignoreFilter.compile(_appSettings->ignoreRules());
+    if (invalidRules.count())
+        qWarning() << Q_FUNC_INFO << "these ignore rules are not valid:" << invalidRules;
+}
+
 void IrcModel::attemptReconnect()
 {
     onlineStateChanged(true);
@@ -66,11 +108,41 @@ void IrcModel::attemptReconnect()
 
 void IrcModel::connectToServers()
 {
+    if (_isAttachedToCore)
+        return;
+
+    _appSettings->loadServerSettings();
+    _connectClock.start();
+
     foreach (ServerSettings *serverSettings, *(_appSettings->serverSettings()->getList<ServerSettings>()))
     {
-        if (serverSettings->shouldConnect())
-            connectToServer(serverSettings);
+        if (serverSettings->shouldConnect() && !_pendingConnects.contains(serverSettings))
+            _pendingConnects.append(serverSettings);
+    }
+
+    startPendingConnects();
+}
+
+void IrcModel::startPendingConnects()
+{
+    // The servers connect concurrently, but not too many at once
+    while (_pendingConnects.count() && _connectsInFlight.count() < MAX_CONNECTS_IN_FLIGHT)
+        connectToServer(_pendingConnects.takeFirst());
+}
+
+void IrcModel::connectAttemptFinished()
+{
+    // The first attempt of the client either registered or failed, the reconnect engine takes it from here
+    if (!_connectsInFlight.remove(sender()))
+        return;
+
+    if (_pendingConnects.isEmpty() && _connectsInFlight.isEmpty() && _connectClock.isValid())
+    {
+        qDebug() << "connecting to every server took" << _connectClock.elapsed() << "ms";
+        _connectClock.invalidate();
     }
+
+    startPendingConnects();
 }
 
 void IrcModel::disconnectFromServers()
@@ -84,6 +156,7 @@ void IrcModel::disconnectFromServers()
 
     setCurrentChannelIndex(-1);
     _queue.clear();
+    _pendingConnects.clear();
     _servers.clear();
 
     refreshChannelList();
@@ -92,6 +165,7 @@ void IrcModel::disconnectFromServers()
 bool IrcModel::anyServersToConnect()
 {
     int i = 0;
+    _appSettings->loadServerSettings();
 
     foreach (ServerSettings *serverSettings, *(_appSettings->serverSettings()->getList<ServerSettings>()))
     {
@@ -106,15 +180,23 @@ void IrcModel::connectToServer(ServerSettings *serverSettings)
 {
     qDebug() << "trying to connect to" << serverSettings->serverUrl();
 
+    if (_isAttachedToCore)
+    {
+        qDebug() << "the core connects to the servers, not this process";
+        return;
+    }
+
     if (isOnline())
     {
         serverSettings->setIsConnecting(true);
 
         AbstractIrcClient *ircClient = new CommuniIrcClient(this, serverSettings);
-        ServerModel *serverModel = new ServerModel(this, serverSettings, ircClient);
+        attachServer(serverSettings, ircClient);
 
-        _servers.append(serverModel);
-        connect(serverModel, SIGNAL(channelsChanged()), this, SLOT(refreshChannelList()));
+        _connectsInFlight.insert(ircClient);
+        connect(ircClient, SIGNAL(connectedToServer()), this, SLOT(connectAttemptFinished()));
+        connect(ircClient, SIGNAL(socketErrorHappened(QAbstractSocket::SocketError)), this, SLOT(connectAttemptFinished()));
+        connect(ircClient, SIGNAL(destroyed()), this, SLOT(connectAttemptFinished()));
         ircClient->connectToServer();
     }
     else
@@ -125,6 +207,17 @@ void IrcModel::connectToServer(ServerSettings *serverSettings)
     }
 }
 
+ServerModel *IrcModel::attachServer(ServerSettings *serverSettings, AbstractIrcClient *ircClient)
+{
+    ServerModel *serverModel = new ServerModel(this, serverSettings, ircClient);
+
+    _servers.append(serverModel);
+    connect(serverModel, SIGNAL(channelsChanged()), this, SLOT(refreshChannelList()));
+    emit serverAttached(serverModel);
+
+    return serverModel;
+}
+
 void IrcModel::disconnectFromServer(ServerSettings *serverSettings)
 {
     serverSettings->setIsConnected(false);
@@ -147,6 +240,7 @@ void IrcModel::disconnectFromServer(ServerSettings *serverSettings)
         serverModel->disconnectFromServer();
 
         _queue.removeAll(serverSettings);
+        _pendingConnects.removeAll(serverSettings);
         _servers.removeAll(serverModel);
 
         _currentChannelIndex = -1;
@@ -158,6 +252,7 @@ void IrcModel::disconnectFromServer(ServerSettings *serverSettings)
 
 void IrcModel::refreshChannelList()
 {
+    TRACE_FUNCTION();
     QString currentChannelName;
     QString currentServerName;
 
@@ -188,23 +283,47 @@ void IrcModel::refreshChannelList()
     setCurrentChannelIndex(-1);
     // The QObjectListModel automatically deletes the old list, so this is not a memory leak
     _allChannels.setList(allChannelsList);
+    rebuildChannelIndex();
+    _channelListResets++;
 
     if (currentServerName.length() && currentChannelName.length())
         setCurrentChannel(currentChannelName, currentServerName);
 }
 
-int IrcModel::getChannelIndex(const QString &currentChannelName, const QString &currentServerName)
+QPair<QString, QString> IrcModel::channelIndexKey(const QString &channelName, const QString &serverName)
+{
+    // Channel names are folded the same way as in ChannelModelCollection
+    return qMakePair(serverName, channelName.toLower());
+}
+
+void IrcModel::rebuildChannelIndex()
 {
+    _channelIndexByName.clear();
+    _channelIndexByModel.clear();
+
     int i = 0;
     foreach (ChannelModel *channelModel, *(_allChannels.getList<ChannelModel>()))
     {
-        if (static_cast<ServerModel*>(channelModel->parent())->url() == currentServerName && channelModel->name().toLower() == currentChannelName.toLower())
-        {
-            return i;
-        }
+        _channelIndexByName.insert(channelIndexKey(channelModel->name(), static_cast<ServerModel*>(channelModel->parent())->url()), i);
+        _channelIndexByModel.insert(channelModel, i);
         i++;
     }
-    return -1;
+}
+
+int IrcModel::getChannelIndex(const QString &currentChannelName, const QString &currentServerName)
+{
+    QPair<QString, QString> key = channelIndexKey(currentChannelName, currentServerName);
+    int index = _channelIndexByName.value(key, -1);
+    ChannelModel *channelModel = static_cast<ChannelModel*>(_allChannels.getItem(index));
+
+    if (index != -1 && (!channelModel || _channelIndexByModel.value(channelModel, -1) != index))
+    {
+        // The list was changed behind our back (eg. an item was destroyed), so the index is stale
+        rebuildChannelIndex();
+        index = _channelIndexByName.value(key, -1);
+    }
+
+    return index;
 }
 
 void IrcModel::setCurrentChannel(const QString &currentChannelName, const QString &currentServerName)
@@ -219,6 +338,10 @@ void IrcModel::onlineStateChanged(bool online)
 
     setIsOnline(online);
 
+    // The core reconnects its servers by itself
+    if (_isAttachedToCore)
+        return;
+
     if (online)
     {
         _lastNetConfigId = _networkConfigurationManager->defaultConfiguration().identifier();
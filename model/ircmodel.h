@@ -21,15 +21,21 @@
 #define IRCMODEL_H
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QElapsedTimer>
 #include <QtNetwork/QNetworkConfigurationManager>
 #include <QtNetwork/QNetworkSession>
 
 #include "helpers/qobjectlistmodel.h"
 #include "model/channelmodel.h"
+#include "model/ignorefilter.h"
 #include "model/servermodel.h"
 
 class ServerSettings;
 class AppSettings;
+class AbstractIrcClient;
 
 class IrcModel : public QObject
 {
@@ -44,12 +50,27 @@ class IrcModel : public QObject
     GENPROPERTY_PTR_R(AppSettings*, _appSettings, appSettings)
     GENPROPERTY_F(bool, _isOnline, isOnline, setIsOnline, isOnlineChanged)
     Q_PROPERTY(bool isOnline READ isOnline NOTIFY isOnlineChanged)
+    // Set when the servers are owned by a core process, which connects them, see CoreConnection
+    GENPROPERTY_S(bool, _isAttachedToCore, isAttachedToCore, setIsAttachedToCore)
 
     QNetworkConfigurationManager *_networkConfigurationManager;
     QList<ServerSettings*> _queue;
     QList<ServerModel*> _servers;
+    // Servers waiting for connectToServers() to connect them, and the clients on their first attempt
+    QList<ServerSettings*> _pendingConnects;
+    QSet<QObject*> _connectsInFlight;
+    QElapsedTimer _connectClock;
     QObjectListModel _allChannels;
+    IgnoreFilter _ignoreFilter;
     QString _lastNetConfigId;
+    int _channelListResets;
+
+    // Lookup tables for the rows of _allChannels, rebuilt together with the list
+    QHash<QPair<QString, QString>, int> _channelIndexByName;
+    QHash<ChannelModel*, int> _channelIndexByModel;
+
+    static QPair<QString, QString> channelIndexKey(const QString &channelName, const QString &serverName);
+    void rebuildChannelIndex();
 
 public:
     explicit IrcModel(QObject *parent, AppSettings *appSettings);
@@ -58,20 +79,29 @@ public:
     inline ServerModel *currentServer() { return currentChannel() ? static_cast<ServerModel*>(currentChannel()->parent()) : 0; }
     int getChannelIndex(const QString &currentChannelName, const QString &currentServerName);
     void setCurrentChannel(const QString &currentChannelName, const QString &currentServerName);
+    const QList<ServerModel*> &servers() const { return _servers; }
+    int channelListResets() const { return _channelListResets; }
+    IgnoreFilter *ignoreFilter() { return &_ignoreFilter; }
+
+    // Creates the model of a server for a client that is already set up, without connecting it
+    ServerModel *attachServer(ServerSettings *serverSettings, AbstractIrcClient *ircClient);
 
     Q_INVOKABLE void connectToServer(ServerSettings *serverSettings);
     Q_INVOKABLE void disconnectFromServer(ServerSettings *serverSettings);
-    Q_INVOKABLE void connectToServers();
     Q_INVOKABLE void disconnectFromServers();
     Q_INVOKABLE bool anyServersToConnect();
 
 public slots:
+    void connectToServers();
     void refreshChannelList();
     void attemptReconnect();
 
 private slots:
     void onlineStateChanged(bool online);
     void networkConfigurationChanged(QNetworkConfiguration);
+    void startPendingConnects();
+    void connectAttemptFinished();
+    void compileIgnoreRules();
 
 signals:
     void allChannelsChanged();
@@ -79,6 +109,7 @@ signals:
     void currentChannelIndexChanged();
     void isAppInFocusChanged();
     void isOnlineChanged();
+    void serverAttached(ServerModel *serverModel);
 };
 
 #endif // IRCMODEL_H
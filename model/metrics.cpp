@@ -0,0 +1,224 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include "model/metrics.h"
+#include "model/ircmodel.h"
+#include "model/servermodel.h"
+#include "model/channelmodel.h"
+#include "model/settings/serversettings.h"
+#include "clients/abstractircclient.h"
+#include "clients/sendqueue.h"
+
+// The rate of lines is recomputed once this many milliseconds have passed since the last sample
+#define METRICS_RATE_INTERVAL 1000
+// Samples that were not read for this long are dropped, eg. the ones of closed channels
+#define METRICS_RATE_EXPIRY 60000
+
+Metrics::Metrics(IrcModel *model) :
+    QObject(model),
+    _isOverlayVisible(false),
+    _model(model),
+    _lastPrune(0)
+{
+    _clock.start();
+}
+
+ServerModel *Metrics::findServer(const QString &serverUrl)
+{
+    foreach (ServerModel *server, _model->servers())
+    {
+        if (server->url() == serverUrl)
+            return server;
+    }
+
+    return 0;
+}
+
+void Metrics::pruneRateSamples(qint64 now)
+{
+    _lastPrune = now;
+
+    QHash<QString, RateSample>::iterator i = _rateSamples.begin();
+    while (i != _rateSamples.end())
+    {
+        if (now - i.value().lastRead > METRICS_RATE_EXPIRY)
+            i = _rateSamples.erase(i);
+        else
+            ++i;
+    }
+}
+
+double Metrics::linesPerSecond(const QString &key, quint64 lines)
+{
+    qint64 now = _clock.elapsed();
+
+    if (now - _lastPrune > METRICS_RATE_EXPIRY)
+        pruneRateSamples(now);
+
+    // A sample that wasn't read for long would give the average of a long time, it starts over
+    if (!_rateSamples.contains(key) || now - _rateSamples[key].lastRead > METRICS_RATE_EXPIRY)
+    {
+        RateSample sample = { lines, now, now, 0 };
+        _rateSamples[key] = sample;
+        return 0;
+    }
+
+    // Several readers (the overlay and the bus) share the samples, so they are not
+    // replaced on every read, only after the interval has passed
+    RateSample &sample = _rateSamples[key];
+    sample.lastRead = now;
+    if (now - sample.time >= METRICS_RATE_INTERVAL)
+    {
+        sample.rate = (lines - sample.lines) * 1000.0 / (now - sample.time);
+        sample.lines = lines;
+        sample.time = now;
+    }
+
+    return sample.rate;
+}
+
+QVariantMap Metrics::collectServerMetrics(ServerModel *server)
+{
+    QVariantMap result;
+    AbstractIrcClient *client = server->ircClient();
+
+    result["linesReceived"] = client->linesReceived();
+    result["bytesReceived"] = client->bytesReceived();
+    result["linesPerSecond"] = linesPerSecond(server->url(), client->linesReceived());
+    result["sendQueueDepth"] = client->sendQueue()->queueDepth();
+    result["linesSent"] = client->sendQueue()->linesSent();
+    result["bytesSent"] = client->sendQueue()->bytesSent();
+    result["averageSendDelay"] = client->sendQueue()->averageDelay();
+    result["lag"] = server->serverSettings()->lag();
+    result["channels"] = server->channels().values().count();
+    return result;
+}
+
+QVariantMap Metrics::collectChannelMetrics(ServerModel *server, ChannelModel *channel)
+{
+    QVariantMap result;
+    const ChannelCounters &counters = channel->counters();
+
+    result["linesAppended"] = counters.linesAppended;
+    result["bytesAppended"] = counters.bytesAppended;
+    result["linesPerSecond"] = linesPerSecond(server->url() + " " + channel->name(), counters.linesAppended);
+    result["scrollbackBytes"] = channel->scrollbackBytes();
+    result["userCount"] = channel->userCount();
+    result["userListResets"] = counters.userListResets;
+    result["lastUpdateLatency"] = counters.lastUpdateLatency;
+    result["maxUpdateLatency"] = counters.maxUpdateLatency;
+    result["averageUpdateLatency"] = counters.linesAppended ? counters.totalUpdateLatency / (qint64)counters.linesAppended : 0;
+    return result;
+}
+
+QStringList Metrics::servers()
+{
+    QStringList result;
+    foreach (ServerModel *server, _model->servers())
+        result.append(server->url());
+    return result;
+}
+
+QStringList Metrics::channels(const QString &serverUrl)
+{
+    QStringList result;
+    ServerModel *server = findServer(serverUrl);
+    if (server)
+    {
+        foreach (ChannelModel *channel, server->channels().values())
+            result.append(channel->name());
+    }
+    return result;
+}
+
+QVariantMap Metrics::serverMetrics(const QString &serverUrl)
+{
+    ServerModel *server = findServer(serverUrl);
+    return server ? collectServerMetrics(server) : QVariantMap();
+}
+
+QVariantMap Metrics::channelMetrics(const QString &serverUrl, const QString &channelName)
+{
+    ServerModel *server = findServer(serverUrl);
+    if (!server || !server->channels().contains(channelName))
+        return QVariantMap();
+
+    return collectChannelMetrics(server, server->channels()[channelName]);
+}
+
+int Metrics::channelListResets()
+{
+    return _model->channelListResets();
+}
+
+QVariantMap Metrics::ignoreRuleHits()
+{
+    QVariantMap result;
+    IgnoreFilter *ignoreFilter = _model->ignoreFilter();
+    QStringList rules = ignoreFilter->rules();
+
+    for (int i = 0; i < rules.count(); i++)
+        result[rules[i]] = ignoreFilter->hits(i);
+
+    return result;
+}
+
+QString Metrics::report()
+{
+    QString result = QString("channel list resets: %1\n").arg(_model->channelListResets());
+
+    QVariantMap ruleHits = ignoreRuleHits();
+    foreach (const QString &rule, ruleHits.keys())
+        result += QString("ignore rule '%1': %2 hits\n").arg(rule).arg(ruleHits[rule].toULongLong());
+
+    foreach (ServerModel *server, _model->servers())
+    {
+        QVariantMap s = collectServerMetrics(server);
+        result += QString("%1: %2 lines, %3 B, %4 lines/s, send queue %5, lag %6 ms\n")
+                .arg(server->url())
+                .arg(s["linesReceived"].toULongLong())
+                .arg(s["bytesReceived"].toULongLong())
+                .arg(s["linesPerSecond"].toDouble(), 0, 'f', 1)
+                .arg(s["sendQueueDepth"].toInt())
+                .arg(s["lag"].toInt());
+
+        foreach (ChannelModel *channel, server->channels().values())
+        {
+            QVariantMap c = collectChannelMetrics(server, channel);
+            result += QString("  %1: %2 lines, %3 lines/s, scrollback %4 B, user list resets %5, update %6 us (max %7 us)\n")
+                    .arg(channel->name())
+                    .arg(c["linesAppended"].toULongLong())
+                    .arg(c["linesPerSecond"].toDouble(), 0, 'f', 1)
+                    .arg(c["scrollbackBytes"].toInt())
+                    .arg(c["userListResets"].toULongLong())
+                    .arg(c["averageUpdateLatency"].toLongLong())
+                    .arg(c["maxUpdateLatency"].toLongLong());
+        }
+    }
+
+    return result;
+}
+
+void Metrics::showOverlay()
+{
+    setIsOverlayVisible(true);
+}
+
+void Metrics::hideOverlay()
+{
+    setIsOverlayVisible(false);
+}
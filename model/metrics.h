@@ -0,0 +1,84 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QVariantMap>
+
+#include "helpers/util.h"
+
+class IrcModel;
+class ServerModel;
+class ChannelModel;
+
+// Runtime counters of the servers and channels, for diagnosing load
+// problems on a device. Exported on the session bus at /metrics and
+// given to QML as "metrics" for the debug overlay. Nothing is sampled in
+// the background, the rates are computed from the counters when asked.
+
+class Metrics : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "net.venemo.ircchatter.Metrics")
+    GENPROPERTY_F(bool, _isOverlayVisible, isOverlayVisible, setIsOverlayVisible, isOverlayVisibleChanged)
+    Q_PROPERTY(bool isOverlayVisible READ isOverlayVisible WRITE setIsOverlayVisible NOTIFY isOverlayVisibleChanged)
+
+    struct RateSample
+    {
+        quint64 lines;
+        qint64 time, lastRead;
+        double rate;
+    };
+
+    IrcModel *_model;
+    QElapsedTimer _clock;
+    QHash<QString, RateSample> _rateSamples;
+    qint64 _lastPrune;
+
+    ServerModel *findServer(const QString &serverUrl);
+    double linesPerSecond(const QString &key, quint64 lines);
+    void pruneRateSamples(qint64 now);
+    QVariantMap collectServerMetrics(ServerModel *server);
+    QVariantMap collectChannelMetrics(ServerModel *server, ChannelModel *channel);
+
+public:
+    explicit Metrics(IrcModel *model);
+
+public slots:
+    QStringList servers();
+    QStringList channels(const QString &serverUrl);
+    QVariantMap serverMetrics(const QString &serverUrl);
+    QVariantMap channelMetrics(const QString &serverUrl, const QString &channelName);
+    int channelListResets();
+    // Hits of every ignore rule since it was added
+    QVariantMap ignoreRuleHits();
+    // Everything above in a human readable form
+    QString report();
+    void showOverlay();
+    void hideOverlay();
+
+signals:
+    void isOverlayVisibleChanged();
+
+};
+
+#endif // METRICS_H
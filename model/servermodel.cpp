@@ -20,39 +20,40 @@
 #include "model/ircmodel.h"
 #include "settings/appsettings.h"
 #include "clients/abstractircclient.h"
+#include "clients/lagmeter.h"
+#include "helpers/startupprofiler.h"
+#include "helpers/tracer.h"
+
+#include <QtCore/QTimer>
+
+// Time after which the old connection is closed, even if the new one hasn't joined every channel
+#define MIGRATION_DRAIN_TIMEOUT 15000
 
 ServerModel::ServerModel(IrcModel *parent, ServerSettings *serverSettings, AbstractIrcClient *ircClient) :
     QObject((QObject*)parent),
     _ircClient(ircClient),
     _serverSettings(serverSettings),
-    _defaultChannel(0)
+    _defaultChannel(0),
+    _isDefaultChannelResumed(false),
+    _pendingIrcClient(0),
+    _drainingIrcClient(0),
+    _drainTimer(new QTimer(this))
 {
     _serverSettings->setIsConnected(false);
     _serverSettings->setIsConnecting(true);
 
-    connect(_ircClient->socket(), SIGNAL(connected()), this, SLOT(socketConnected()));
-    connect(_ircClient, SIGNAL(connectedToServer()), this, SLOT(connectedToServer()));
-    connect(_ircClient, SIGNAL(disconnectedFromServer()), this, SLOT(disconnectedFromServer()));
-
-    connect(_ircClient, SIGNAL(receiveCtcpAction(QString,QString,QString)), this, SLOT(receiveCtcpAction(QString,QString,QString)));
-    connect(_ircClient, SIGNAL(receiveCtcpReply(QString,QString)), this, SLOT(receiveCtcpReply(QString,QString)));
-    connect(_ircClient, SIGNAL(receiveCtcpRequest(QString,QString)), this, SLOT(receiveCtcpRequest(QString,QString)));
-    connect(_ircClient, SIGNAL(receiveError(QString)), this, SLOT(receiveError(QString)));
-    connect(_ircClient, SIGNAL(receiveJoin(QString,QString)), this, SLOT(receiveJoin(QString,QString)));
-    connect(_ircClient, SIGNAL(receiveKick(QString,QString,QString,QString)), this, SLOT(receiveKick(QString,QString,QString,QString)));
-    connect(_ircClient, SIGNAL(receiveMessage(QString,QString,QString)), this, SLOT(receiveMessage(QString,QString,QString)));
-    connect(_ircClient, SIGNAL(receiveModeChange(QString,QString,QString)), this, SLOT(receiveModeChange(QString,QString,QString)));
-    connect(_ircClient, SIGNAL(receiveMotd(QString)), this, SLOT(receiveMotd(QString)));
-    connect(_ircClient, SIGNAL(receiveNickChange(QString,QString)), this, SLOT(receiveNickChange(QString,QString)));
-    connect(_ircClient, SIGNAL(receivePart(QString,QString,QString)), this, SLOT(receivePart(QString,QString,QString)));
-    connect(_ircClient, SIGNAL(receiveQuit(QString,QString)), this, SLOT(receiveQuit(QString,QString)));
-    connect(_ircClient, SIGNAL(receiveTopic(QString,QString)), this, SLOT(receiveTopic(QString,QString)));
-    connect(_ircClient, SIGNAL(receiveUserNames(QString,QStringList)), this, SLOT(receiveUserNames(QString,QStringList)));
-
-    connect(_ircClient, SIGNAL(joinedChannel(QString)), this, SLOT(addModelForChannel(QString)));
-    connect(_ircClient, SIGNAL(queriedUser(QString)), this, SLOT(addModelForChannel(QString)));
-    connect(_ircClient, SIGNAL(partedChannel(QString)), this, SLOT(removeModelForChannel(QString)));
-    connect(_ircClient, SIGNAL(closedUser(QString)), this, SLOT(removeModelForChannel(QString)));
+    _drainTimer->setSingleShot(true);
+    _drainTimer->setInterval(MIGRATION_DRAIN_TIMEOUT);
+    connect(_drainTimer, SIGNAL(timeout()), this, SLOT(finishMigration()));
+
+    AppSettings *appSettings = static_cast<IrcModel*>(parent())->appSettings();
+    _nickStyles.setPalette(appSettings->nickColors());
+    connect(appSettings, SIGNAL(nickColorsChanged()), this, SLOT(updateNickColors()));
+    // The clients which are already connected follow the changes of the lag settings too
+    connect(appSettings, SIGNAL(lagProbeIntervalChanged()), this, SLOT(updateLagProbing()));
+    connect(appSettings, SIGNAL(lagProbeMaxMissedChanged()), this, SLOT(updateLagProbing()));
+
+    connectClient(_ircClient);
 }
 
 ServerModel::~ServerModel()
@@ -62,6 +63,64 @@ ServerModel::~ServerModel()
         _ircClient->quit("Quitting. (with IRC Chatter)");
         _ircClient->deleteLater();
     }
+    if (_drainingIrcClient)
+    {
+        _drainingIrcClient->quit("Quitting. (with IRC Chatter)");
+        _drainingIrcClient->deleteLater();
+    }
+    if (_pendingIrcClient)
+    {
+        _pendingIrcClient->disconnectFromServer();
+        _pendingIrcClient->deleteLater();
+    }
+}
+
+void ServerModel::connectClient(AbstractIrcClient *ircClient)
+{
+    connect(ircClient->socket(), SIGNAL(connected()), this, SLOT(socketConnected()));
+    connect(ircClient, SIGNAL(connectedToServer()), this, SLOT(connectedToServer()));
+    connect(ircClient, SIGNAL(disconnectedFromServer()), this, SLOT(disconnectedFromServer()));
+
+    applyLagProbing(ircClient);
+    connect(ircClient->lagMeter(), SIGNAL(lagChanged(int)), this, SLOT(updateLag(int)));
+
+    connect(ircClient, SIGNAL(receiveCtcpAction(QString,QString,QString)), this, SLOT(receiveCtcpAction(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveCtcpReply(QString,QString)), this, SLOT(receiveCtcpReply(QString,QString)));
+    connect(ircClient, SIGNAL(receiveCtcpRequest(QString,QString)), this, SLOT(receiveCtcpRequest(QString,QString)));
+    connect(ircClient, SIGNAL(receiveError(QString)), this, SLOT(receiveError(QString)));
+    connect(ircClient, SIGNAL(receiveJoin(QString,QString)), this, SLOT(receiveJoin(QString,QString)));
+    connect(ircClient, SIGNAL(receiveKick(QString,QString,QString,QString)), this, SLOT(receiveKick(QString,QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveMessage(QString,QString,QString)), this, SLOT(receiveMessage(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveHistory(QString,QList<IrcHistoryLine>)), this, SLOT(receiveHistory(QString,QList<IrcHistoryLine>)));
+    connect(ircClient, SIGNAL(receiveModeChange(QString,QString,QString)), this, SLOT(receiveModeChange(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveMotd(QString)), this, SLOT(receiveMotd(QString)));
+    connect(ircClient, SIGNAL(receiveNickChange(QString,QString)), this, SLOT(receiveNickChange(QString,QString)));
+    connect(ircClient, SIGNAL(receivePart(QString,QString,QString)), this, SLOT(receivePart(QString,QString,QString)));
+    connect(ircClient, SIGNAL(receiveQuit(QString,QString)), this, SLOT(receiveQuit(QString,QString)));
+    connect(ircClient, SIGNAL(receiveTopic(QString,QString)), this, SLOT(receiveTopic(QString,QString)));
+    connect(ircClient, SIGNAL(receiveUserNames(QString,QStringList)), this, SLOT(receiveUserNames(QString,QStringList)));
+
+    connect(ircClient, SIGNAL(joinedChannel(QString)), this, SLOT(addModelForChannel(QString)));
+    connect(ircClient, SIGNAL(joinedChannels(QStringList)), this, SLOT(addModelsForChannels(QStringList)));
+    connect(ircClient, SIGNAL(queriedUser(QString)), this, SLOT(addModelForChannel(QString)));
+    connect(ircClient, SIGNAL(partedChannel(QString)), this, SLOT(removeModelForChannel(QString)));
+    connect(ircClient, SIGNAL(closedUser(QString)), this, SLOT(removeModelForChannel(QString)));
+}
+
+void ServerModel::applyLagProbing(AbstractIrcClient *ircClient)
+{
+    AppSettings *appSettings = static_cast<IrcModel*>(parent())->appSettings();
+    ircClient->lagMeter()->setProbing(appSettings->lagProbeInterval() * 1000, appSettings->lagProbeMaxMissed());
+}
+
+void ServerModel::updateLagProbing()
+{
+    if (_ircClient)
+        applyLagProbing(_ircClient);
+    if (_pendingIrcClient)
+        applyLagProbing(_pendingIrcClient);
+    if (_drainingIrcClient)
+        applyLagProbing(_drainingIrcClient);
 }
 
 const QString &ServerModel::url() const
@@ -100,22 +159,17 @@ void ServerModel::disconnectFromServer()
 
 void ServerModel::socketConnected()
 {
+    // When resuming, every channel model is kept with its scrollback, the
+    // channels are joined again by autojoin and the default channel is
+    // reused for the first message that comes from the server.
     if (_defaultChannel)
-    {
-        IrcModel *ircModel = static_cast<IrcModel*>(parent());
-        ircModel->setCurrentChannelIndex(-1);
-
-        _channels.remove(_defaultChannel->name());
-        _defaultChannel->deleteLater();
-        ircModel->refreshChannelList();
-    }
-
-    _defaultChannel = 0;
+        _isDefaultChannelResumed = true;
 }
 
 void ServerModel::connectedToServer()
 {
     qDebug() << "backend of " << url() << " is now connected to server";
+    StartupProfiler::instance()->markFirstConnect();
 
     if (_serverSettings->autoJoinChannels().length() == 0)
     {
@@ -126,17 +180,177 @@ void ServerModel::connectedToServer()
         }
     }
 
-    foreach (QString channelName, _serverSettings->autoJoinChannels())
-    {
-        addModelForChannel(channelName);
-        // TODO: add possibility to store channel keys in the autojoin
-        _ircClient->joinChannel(channelName, QString());
-    }
+    joinAutoJoinChannels();
 
     _serverSettings->setIsConnecting(false);
     _serverSettings->setIsConnected(true);
 }
 
+void ServerModel::joinAutoJoinChannels()
+{
+    // Joining all the channels at once, the models are created when the client emits joinedChannels
+    QStringList channelNames = _serverSettings->autoJoinChannelNames(), channelKeys;
+    foreach (const QString &channelName, channelNames)
+        channelKeys.append(_serverSettings->autoJoinChannelKey(channelName));
+
+    _ircClient->joinChannels(channelNames, channelKeys);
+}
+
+bool ServerModel::isMigrating() const
+{
+    return _pendingIrcClient || _drainingIrcClient;
+}
+
+void ServerModel::migrateConnection(AbstractIrcClient *ircClient)
+{
+    // Make before break: the new connection is registered while the old one is still in use
+    if (_pendingIrcClient)
+    {
+        _pendingIrcClient->disconnectFromServer();
+        _pendingIrcClient->deleteLater();
+    }
+
+    qDebug() << "migrating the connection to" << url();
+    _pendingIrcClient = ircClient;
+    connect(_pendingIrcClient, SIGNAL(connectedToServer()), this, SLOT(migrationRegistered()));
+    connect(_pendingIrcClient, SIGNAL(socketErrorHappened(QAbstractSocket::SocketError)), this, SLOT(migrationFailed()));
+    _pendingIrcClient->connectToServer();
+}
+
+void ServerModel::migrationRegistered()
+{
+    if (!_pendingIrcClient)
+        return;
+
+    // Finishing an earlier migration, if it's still going on
+    finishMigration();
+
+    qDebug() << "new connection to" << url() << "is registered, switching over";
+    disconnect(_pendingIrcClient, 0, this, 0);
+
+    // The old client keeps serving the channels until the new one joins them
+    _drainingIrcClient = _ircClient;
+    disconnect(_drainingIrcClient, SIGNAL(connectedToServer()), this, 0);
+    disconnect(_drainingIrcClient->socket(), 0, this, 0);
+    connect(_drainingIrcClient, SIGNAL(disconnectedFromServer()), this, SLOT(finishMigration()));
+
+    _ircClient = _pendingIrcClient;
+    _pendingIrcClient = 0;
+    connectClient(_ircClient);
+
+    foreach (ChannelModel *channel, _channels.values())
+        channel->setIrcClient(_ircClient);
+    emit ircClientChanged();
+
+    _drainTimer->start();
+    joinAutoJoinChannels();
+
+    // Nothing to wait for if there are no channels
+    if (_serverSettings->autoJoinChannelNames().isEmpty())
+        finishMigration();
+}
+
+void ServerModel::migrationFailed()
+{
+    if (!_pendingIrcClient)
+        return;
+
+    // The old connection is still used, and reconnected by its engine if it's broken
+    qDebug() << "could not migrate the connection to" << url();
+    disconnect(_pendingIrcClient, 0, this, 0);
+    _pendingIrcClient->disconnectFromServer();
+    _pendingIrcClient->deleteLater();
+    _pendingIrcClient = 0;
+}
+
+void ServerModel::finishMigration()
+{
+    if (!_drainingIrcClient)
+        return;
+
+    qDebug() << "closing the old connection to" << url();
+    AbstractIrcClient *oldClient = _drainingIrcClient;
+    _drainingIrcClient = 0;
+    _migratedChannels.clear();
+    _drainTimer->stop();
+
+    disconnect(oldClient, 0, this, 0);
+    oldClient->quit("Changing network. (with IRC Chatter)");
+    oldClient->disconnectFromServer();
+
+    if (oldClient->socket()->state() == QAbstractSocket::UnconnectedState)
+    {
+        oldClient->deleteLater();
+        reclaimNick();
+    }
+    else
+    {
+        // The nick of the old connection is free when it's closed
+        connect(oldClient->socket(), SIGNAL(disconnected()), oldClient, SLOT(deleteLater()));
+        connect(oldClient->socket(), SIGNAL(disconnected()), this, SLOT(reclaimNick()));
+    }
+}
+
+void ServerModel::reclaimNick()
+{
+    if (_ircClient->currentNick() != _serverSettings->userNickname())
+        _ircClient->changeNick(_serverSettings->userNickname());
+}
+
+void ServerModel::updateLag(int lag)
+{
+    // Only the lag of the active connection is interesting
+    if (sender() == _ircClient->lagMeter())
+        _serverSettings->setLag(lag);
+}
+
+void ServerModel::updateNickColors()
+{
+    // Only the lines rendered from now on get the new colours
+    _nickStyles.setPalette(static_cast<IrcModel*>(parent())->appSettings()->nickColors());
+}
+
+AbstractIrcClient *ServerModel::senderClient()
+{
+    AbstractIrcClient *client = qobject_cast<AbstractIrcClient*>(sender());
+    return client ? client : _ircClient;
+}
+
+bool ServerModel::acceptsChannelEvent(const QString &channelName)
+{
+    if (!_drainingIrcClient || !senderClient()->isChannelName(channelName))
+        return true;
+
+    // Each channel is served by the old client until the new one has joined it
+    bool isMigrated = _migratedChannels.contains(channelName.toLower());
+    return senderClient() == _drainingIrcClient ? !isMigrated : isMigrated;
+}
+
+bool ServerModel::acceptsServerEvent()
+{
+    // The old client is still in every channel, the new one might not be
+    return senderClient() == (_drainingIrcClient ? _drainingIrcClient : _ircClient);
+}
+
+IgnoreFilter *ServerModel::ignoreFilter() const
+{
+    return static_cast<IrcModel*>(parent())->ignoreFilter();
+}
+
+bool ServerModel::isIgnored(int eventType, const QString &channelName, const QString &userName, const QString &text, const QString &hostmask)
+{
+    // Checked before any channel is involved, so that a flood costs next to nothing
+    IgnoreFilter *ignoreFilter = this->ignoreFilter();
+    if (ignoreFilter->isEmpty())
+        return false;
+
+    AbstractIrcClient *client = senderClient();
+    if (userName == client->currentNick())
+        return false;
+
+    return ignoreFilter->isIgnored(eventType, channelName, userName, hostmask.isEmpty() ? client->senderHostmask() : hostmask, text);
+}
+
 void ServerModel::disconnectedFromServer()
 {
     qDebug() << "backend for " << url() << " has been disconnected from the server";
@@ -145,6 +359,10 @@ void ServerModel::disconnectedFromServer()
 
 void ServerModel::receiveUserNames(const QString &channelName, const QStringList &userNames)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName))
+        return;
+
     if (_channels.contains(channelName))
     {
         _channels[channelName]->receiveUserList(userNames);
@@ -153,11 +371,36 @@ void ServerModel::receiveUserNames(const QString &channelName, const QStringList
 
 void ServerModel::receiveMessage(const QString &channelName, const QString &userName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName) || isIgnored(IgnoreFilter::Message, channelName, userName, message))
+        return;
+
     findOrCreateChannel(channelName)->receiveMessage(userName, message);
 }
 
+void ServerModel::receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines)
+{
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName))
+        return;
+
+    QList<IrcHistoryLine> accepted;
+    foreach (const IrcHistoryLine &line, lines)
+    {
+        if (!isIgnored(line.isAction ? IgnoreFilter::Action : IgnoreFilter::Message, channelName, line.userName, line.message, line.hostmask))
+            accepted.append(line);
+    }
+
+    if (accepted.count())
+        findOrCreateChannel(channelName)->receiveHistory(accepted);
+}
+
 void ServerModel::receiveCtcpRequest(const QString &userName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (isIgnored(IgnoreFilter::Ctcp, QString(), userName, message))
+        return;
+
     qDebug() << "CTCP request received " << userName << message;
 
     if (_defaultChannel)
@@ -172,6 +415,10 @@ void ServerModel::receiveCtcpRequest(const QString &userName, const QString &mes
 
 void ServerModel::receiveCtcpReply(const QString &userName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (isIgnored(IgnoreFilter::Ctcp, QString(), userName, message))
+        return;
+
     qDebug() << "CTCP reply received " << userName << message;
 
     if (_defaultChannel)
@@ -180,38 +427,70 @@ void ServerModel::receiveCtcpReply(const QString &userName, const QString &messa
 
 void ServerModel::receiveCtcpAction(const QString &channelName, const QString &userName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName) || isIgnored(IgnoreFilter::Action, channelName, userName, message))
+        return;
+
     findOrCreateChannel(channelName)->receiveCtcpAction(userName, message);
 }
 
 void ServerModel::receivePart(const QString &channelName, const QString &userName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName))
+        return;
+
     if (_channels.contains(channelName))
     {
-        _channels[channelName]->receiveParted(userName, message);
+        _channels[channelName]->receiveParted(userName, message, isIgnored(IgnoreFilter::Part, channelName, userName, message));
     }
 }
 
 void ServerModel::receiveQuit(const QString &userName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (!acceptsServerEvent())
+        return;
+
+    bool ignored = isIgnored(IgnoreFilter::Quit, QString(), userName, message);
     foreach (ChannelModel *channel, _channels.values())
     {
         if (channel->userNames().contains(userName))
         {
-            channel->receiveQuit(userName, message);
+            channel->receiveQuit(userName, message, ignored);
         }
     }
 }
 
 void ServerModel::receiveJoin(const QString &channelName, const QString &userName)
 {
+    TRACE_FUNCTION();
+    if (_drainingIrcClient && senderClient() == _ircClient && userName == _ircClient->currentNick())
+    {
+        // The new connection has joined this channel, from now on it serves it
+        _migratedChannels.insert(channelName.toLower());
+
+        if (_migratedChannels.count() >= _serverSettings->autoJoinChannelNames().count())
+            finishMigration();
+
+        return;
+    }
+
+    if (!acceptsChannelEvent(channelName))
+        return;
+
     if (_channels.contains(channelName))
     {
-        _channels[channelName]->receiveJoined(userName);
+        _channels[channelName]->receiveJoined(userName, isIgnored(IgnoreFilter::Join, channelName, userName));
     }
 }
 
 void ServerModel::receiveTopic(const QString &channelName, const QString &topic)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName))
+        return;
+
     if (_channels.contains(channelName))
     {
         _channels[channelName]->receiveTopic(topic);
@@ -220,14 +499,18 @@ void ServerModel::receiveTopic(const QString &channelName, const QString &topic)
 
 void ServerModel::receiveKick(const QString &channelName, const QString &userName, const QString &kickedUserName, const QString &message)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName))
+        return;
+
     if (_channels.contains(channelName))
     {
-        if (kickedUserName == _ircClient->currentNick())
+        if (kickedUserName == senderClient()->currentNick())
         {
             removeModelForChannel(channelName);
             emit kickReceived(channelName, message);
         }
-        else
+        else if (!isIgnored(IgnoreFilter::Kick, channelName, userName, message))
         {
             _channels[channelName]->receiveKicked(userName, kickedUserName, message);
         }
@@ -236,6 +519,10 @@ void ServerModel::receiveKick(const QString &channelName, const QString &userNam
 
 void ServerModel::receiveModeChange(const QString &channelName, const QString &mode, const QString &arguments)
 {
+    TRACE_FUNCTION();
+    if (!acceptsChannelEvent(channelName))
+        return;
+
     if (_channels.contains(channelName))
     {
         _channels[channelName]->receiveModeChange(mode, arguments);
@@ -244,23 +531,30 @@ void ServerModel::receiveModeChange(const QString &channelName, const QString &m
 
 void ServerModel::receiveNickChange(const QString &oldNick, const QString &newNick)
 {
+    TRACE_FUNCTION();
+    if (!acceptsServerEvent())
+        return;
+
+    bool ignored = isIgnored(IgnoreFilter::NickChange, QString(), oldNick);
     foreach (ChannelModel *channel, _channels.values())
     {
         if (channel->userNames().contains(oldNick))
         {
-            channel->receiveNickChange(oldNick, newNick);
+            channel->receiveNickChange(oldNick, newNick, ignored);
         }
     }
 }
 
 void ServerModel::receiveMotd(const QString &motd)
 {
+    TRACE_FUNCTION();
     if (_defaultChannel)
         _defaultChannel->receiveMotd(motd);
 }
 
 void ServerModel::receiveError(const QString &error)
 {
+    TRACE_FUNCTION();
     static_cast<IrcModel*>(parent())->currentChannel()->appendError(error);
 }
 
@@ -271,31 +565,65 @@ ChannelModel *ServerModel::findOrCreateChannel(const QString &channelName)
     return _channels[channelName];
 }
 
-void ServerModel::addModelForChannel(const QString &channelName)
+bool ServerModel::createModelForChannel(const QString &channelName)
 {
-    if (!_channels.contains(channelName))
+    if (_channels.contains(channelName))
     {
-        ChannelModel *channel = new ChannelModel(this, channelName, _ircClient);
-        if (_defaultChannel == 0)
-        {
-            _defaultChannel = channel;
-            channel->setChannelType(ChannelModel::Server);
-            emit defaultChannelChanged();
-        }
-        else if (channelName.startsWith('#'))
-        {
-            channel->setChannelType(ChannelModel::Channel);
+        if (_channels[channelName] == _defaultChannel)
+            _isDefaultChannelResumed = false;
 
-            // Add this channel to the autojoin list of the server
-            _serverSettings->addAutoJoinChannel(channelName);
-            _serverSettings->save();
-        }
-        else
-        {
-            channel->setChannelType(ChannelModel::Query);
-        }
+        return false;
+    }
+
+    if (_isDefaultChannelResumed && !_ircClient->isChannelName(channelName))
+    {
+        // The server has a different name this time, renaming the default channel
+        _isDefaultChannelResumed = false;
+        _channels.remove(_defaultChannel->name());
+        _defaultChannel->setName(channelName);
+        _channels.insert(channelName, _defaultChannel);
+        return true;
+    }
+
+    ChannelModel *channel = new ChannelModel(this, channelName, _ircClient);
+    if (_defaultChannel == 0)
+    {
+        _defaultChannel = channel;
+        channel->setChannelType(ChannelModel::Server);
+        emit defaultChannelChanged();
+    }
+    else if (_ircClient->isChannelName(channelName))
+    {
+        channel->setChannelType(ChannelModel::Channel);
+
+        // Add this channel to the autojoin list of the server
+        _serverSettings->addAutoJoinChannel(channelName);
+        _serverSettings->save();
+    }
+    else
+    {
+        channel->setChannelType(ChannelModel::Query);
+    }
 
-        _channels.insert(channelName, channel);
+    _channels.insert(channelName, channel);
+    return true;
+}
+
+void ServerModel::addModelForChannel(const QString &channelName)
+{
+    addModelsForChannels(QStringList(channelName));
+}
+
+void ServerModel::addModelsForChannels(const QStringList &channelNames)
+{
+    bool created = false;
+
+    foreach (const QString &channelName, channelNames)
+        created = createModelForChannel(channelName) || created;
+
+    if (created)
+    {
+        // Only one notification for the whole batch, as it rebuilds the channel list
         emit this->channelsChanged();
 
         IrcModel *ircModel = static_cast<IrcModel*>(parent());
@@ -333,7 +661,14 @@ void ServerModel::joinChannel(const QString &channelName, const QString &channel
         qDebug() << "setting current channel to" << channelName;
         static_cast<IrcModel*>(parent())->setCurrentChannel(channelName, this->url());
 
-        if (channelName.startsWith('#'))
+        if (_ircClient->isChannelName(channelName) && channelKey.length())
+        {
+            // Remember the key, so that autojoin can use it
+            _serverSettings->addAutoJoinChannel(channelName, channelKey);
+            _serverSettings->save();
+        }
+
+        if (_ircClient->isChannelName(channelName))
             _ircClient->joinChannel(channelName, channelKey);
         else
             _ircClient->queryUser(channelName);
@@ -348,7 +683,7 @@ void ServerModel::partChannel(const QString &channelName)
     {
         removeModelForChannel(channelName);
 
-        if (channelName.startsWith('#'))
+        if (_ircClient->isChannelName(channelName))
             _ircClient->partChannel(channelName, "Parting this channel. (with IRC Chatter)");
         else
             _ircClient->closeUser(channelName);
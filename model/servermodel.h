@@ -20,15 +20,19 @@
 #define SERVERMODEL_H
 
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 
 #include "helpers/util.h"
 #include "helpers/qobjectlistmodel.h"
+#include "helpers/channelhelper.h"
 #include "model/channelmodel.h"
 #include "model/channelmodelcollection.h"
 #include "model/settings/appsettings.h"
+#include "clients/abstractircclient.h"
 
-class AbstractIrcClient;
+class QTimer;
 class IrcModel;
+class IgnoreFilter;
 class ServerSettings;
 
 class ServerModel : public QObject
@@ -43,6 +47,27 @@ class ServerModel : public QObject
     AbstractIrcClient *_ircClient;
     ServerSettings *_serverSettings;
     ChannelModel *_defaultChannel;
+    // Set when the connection is resumed, the server may be called differently this time
+    bool _isDefaultChannelResumed;
+
+    // Connection migration: the pending client registers on the new network, then becomes
+    // the active one, while the draining (old) client still serves the channels which
+    // the new one hasn't joined yet.
+    AbstractIrcClient *_pendingIrcClient;
+    AbstractIrcClient *_drainingIrcClient;
+    QSet<QString> _migratedChannels;
+    QTimer *_drainTimer;
+    NickStyleCache _nickStyles;
+
+    bool createModelForChannel(const QString &channelName);
+    void connectClient(AbstractIrcClient *ircClient);
+    void applyLagProbing(AbstractIrcClient *ircClient);
+    void joinAutoJoinChannels();
+    AbstractIrcClient *senderClient();
+    bool acceptsChannelEvent(const QString &channelName);
+    bool acceptsServerEvent();
+    // The hostmask is the one of the client's current message unless given
+    bool isIgnored(int eventType, const QString &channelName, const QString &userName, const QString &text = QString(), const QString &hostmask = QString());
 
     friend class AppSettings;
 
@@ -55,9 +80,14 @@ public:
     const QString &url() const;
     ServerSettings *serverSettings() const;
     ChannelModel *defaultChannel() const;
+    AbstractIrcClient *ircClient() const { return _ircClient; }
+    NickStyleCache *nickStyles() { return &_nickStyles; }
+    IgnoreFilter *ignoreFilter() const;
 
     Q_INVOKABLE void connectToServer();
     Q_INVOKABLE void disconnectFromServer();
+    void migrateConnection(AbstractIrcClient *ircClient);
+    bool isMigrating() const;
     ChannelModel *findOrCreateChannel(const QString &channelName);
     ChannelModelCollection &channels();
 
@@ -70,10 +100,20 @@ signals:
     void serverSettingsChanged();
     void defaultChannelChanged();
     void kickReceived(const QString &channelName, const QString &reason);
+    // The active client was replaced by a migration
+    void ircClientChanged();
 
 private slots:
     void socketConnected();
+    void updateLagProbing();
+    void migrationRegistered();
+    void migrationFailed();
+    void finishMigration();
+    void reclaimNick();
+    void updateLag(int lag);
+    void updateNickColors();
     void addModelForChannel(const QString &channelName);
+    void addModelsForChannels(const QStringList &channelNames);
     void removeModelForChannel(const QString &channelName);
 
     // Messages corresponding to the server itself.
@@ -87,6 +127,7 @@ private slots:
     // Messages corresponding to a single channel.
     void receiveUserNames(const QString &channelName, const QStringList &userNames);
     void receiveMessage(const QString &channelName, const QString &userName, const QString &message);
+    void receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines);
     void receiveCtcpRequest(const QString &userName, const QString &message);
     void receiveCtcpReply(const QString &userName, const QString &message);
     void receiveCtcpAction(const QString &channelName, const QString &userName, const QString &message);
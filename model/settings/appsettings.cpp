@@ -18,17 +18,35 @@
 
 #include <QtCore/QBuffer>
 #include <QtCore/QDebug>
+#include <QtCore/QFileInfo>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
 #include <QtGui/QFont>
 
+#include "helpers/startupprofiler.h"
+#include "helpers/tracer.h"
 #include "model/settings/appsettings.h"
+#include "model/settings/serversettingsstore.h"
 
 #define APPSETTING_SETTINGSVERSION "SettingsVersion"
 #define APPSETTING_SERVERSETTINGS "ServerSettings"
 
+// Time to wait for more changes before writing a new server settings snapshot
+#define SERVERSETTINGS_SAVE_DELAY 2000
+
+// Operations recorded in the server settings journal
+#define JOURNAL_ADD_AUTOJOIN_CHANNEL 1
+#define JOURNAL_REMOVE_AUTOJOIN_CHANNEL 2
+
 AppSettings::AppSettings(QObject *parent) :
     QObject(parent),
     _areSettingsDeleted(false),
-    _serverSettings(new QObjectListModel(this))
+    _serverSettings(new QObjectListModel(this)),
+    _serverSettingsStore(new ServerSettingsStore(QFileInfo(_backend.fileName()).absolutePath())),
+    _serverSettingsThread(new QThread(this)),
+    _serverSettingsSaveTimer(new QTimer(this)),
+    _isLoadingServerSettings(false),
+    _isServerSettingsLoaded(false)
 {
     // Checking for settings version
 
@@ -40,36 +58,102 @@ AppSettings::AppSettings(QObject *parent) :
         // Clearing all settings if the saved version is different than current one
         _backend.clear();
         _backend.setValue(APPSETTING_SETTINGSVERSION, APPSETTINGS_VERSION);
+        _serverSettingsStore->removeAll();
 
         if (containedSettingsVersion)
         {
             _areSettingsDeleted = true;
             emit areSettingsDeletedChanged();
         }
+
+        // There are no server settings to load
+        _isServerSettingsLoaded = true;
     }
-    else
+
+    _serverSettingsSaveTimer->setSingleShot(true);
+    _serverSettingsSaveTimer->setInterval(SERVERSETTINGS_SAVE_DELAY);
+    connect(_serverSettingsSaveTimer, SIGNAL(timeout()), this, SLOT(saveServerSettings()));
+    connect(this, SIGNAL(serverSettingsSnapshotReady(QByteArray)), _serverSettingsStore, SLOT(writeSnapshot(QByteArray)), Qt::QueuedConnection);
+    connect(this, SIGNAL(serverSettingsJournalRecordReady(QByteArray)), _serverSettingsStore, SLOT(appendJournal(QByteArray)), Qt::QueuedConnection);
+
+    // The server settings are deserialized by loadServerSettings(), which
+    // is called after the first frame is shown, or earlier when they are needed.
+}
+
+void AppSettings::loadServerSettings()
+{
+    TRACE_FUNCTION();
+    if (_serverSettingsThread->isRunning())
+        return;
+
+    if (!_isServerSettingsLoaded)
     {
         // Deserializing server settings
 
-        QByteArray array = _backend.value(APPSETTING_SERVERSETTINGS).toByteArray();
-        QDataStream stream(array);
-        int n;
-        stream >> n;
-        for (int i = 0; i < n; i++)
+        QByteArray array;
+        bool isMigrating = false;
+        _isLoadingServerSettings = true;
+
+        if (_serverSettingsStore->readSnapshot(&array))
+        {
+            deserializeServerSettings(array);
+        }
+        else if (_backend.contains(APPSETTING_SERVERSETTINGS))
+        {
+            // Older versions stored the server settings in QSettings
+            deserializeServerSettings(_backend.value(APPSETTING_SERVERSETTINGS).toByteArray());
+            isMigrating = true;
+        }
+
+        QList<QByteArray> journal = _serverSettingsStore->readJournal();
+        replayServerSettingsJournal(journal);
+        _isLoadingServerSettings = false;
+        _isServerSettingsLoaded = true;
+
+        if (isMigrating || journal.count())
         {
-            ServerSettings *server = new ServerSettings((QObject*)this);
-            stream >> (*server);
-            _serverSettings->addItem(server);
+            // The store is still on this thread, so this is written synchronously.
+            // The old settings are only removed once they are safe in the snapshot.
+            if (_serverSettingsStore->writeSnapshot(serializeServerSettings()))
+                _backend.remove(APPSETTING_SERVERSETTINGS);
+            else
+                qWarning() << Q_FUNC_INFO << "keeping the server settings in QSettings, the snapshot couldn't be written";
         }
+
+        StartupProfiler::mark("server settings loaded");
+    }
+
+    // From now on, the server settings are written on a worker thread
+    _serverSettingsStore->moveToThread(_serverSettingsThread);
+    connect(_serverSettingsThread, SIGNAL(finished()), _serverSettingsStore, SLOT(deleteLater()));
+    _serverSettingsThread->start(QThread::LowPriority);
+}
+
+AppSettings::~AppSettings()
+{
+    if (!_serverSettingsThread->isRunning())
+    {
+        // The server settings were never loaded, so there is nothing to write
+        delete _serverSettingsStore;
+        return;
     }
+
+    if (_serverSettingsSaveTimer->isActive())
+        saveServerSettings();
+
+    // Wait until every queued write is finished
+    QMetaObject::invokeMethod(_serverSettingsStore, "sync", Qt::BlockingQueuedConnection);
+    _serverSettingsThread->quit();
+    _serverSettingsThread->wait();
 }
 
 QObjectListModel *AppSettings::serverSettings()
 {
+    // Not loading here, the view binds to this before the settings are loaded
     return _serverSettings;
 }
 
-void AppSettings::saveServerSettings()
+QByteArray AppSettings::serializeServerSettings()
 {
     QByteArray array;
     QBuffer buffer(&array);
@@ -78,12 +162,105 @@ void AppSettings::saveServerSettings()
     stream << _serverSettings->rowCount();
     foreach (ServerSettings *server, *(_serverSettings->getList<ServerSettings>()))
         stream << (*server);
+    // Settings added later follow the list, so that older versions can still read it
+    foreach (ServerSettings *server, *(_serverSettings->getList<ServerSettings>()))
+        stream << (qint32) server->sslVerification() << server->sslPinnedDigest();
+    foreach (ServerSettings *server, *(_serverSettings->getList<ServerSettings>()))
+        stream << server->autoJoinChannelKeys();
     buffer.close();
-    _backend.setValue(APPSETTING_SERVERSETTINGS, array);
+    return array;
+}
+
+void AppSettings::deserializeServerSettings(const QByteArray &array)
+{
+    QDataStream stream(array);
+    QList<ServerSettings*> servers;
+    int n;
+    stream >> n;
+    for (int i = 0; i < n; i++)
+    {
+        ServerSettings *server = new ServerSettings((QObject*)this);
+        stream >> (*server);
+        _serverSettings->addItem(server);
+        servers.append(server);
+    }
+
+    if (stream.atEnd())
+        return;
+
+    foreach (ServerSettings *server, servers)
+    {
+        qint32 sslVerification;
+        QByteArray sslPinnedDigest;
+        stream >> sslVerification >> sslPinnedDigest;
+        server->setSslVerification(sslVerification);
+        server->setSslPinnedDigest(sslPinnedDigest);
+    }
+
+    if (stream.atEnd())
+        return;
+
+    foreach (ServerSettings *server, servers)
+    {
+        QHash<QString, QString> autoJoinChannelKeys;
+        stream >> autoJoinChannelKeys;
+        server->setAutoJoinChannelKeys(autoJoinChannelKeys);
+    }
+}
+
+void AppSettings::replayServerSettingsJournal(const QList<QByteArray> &records)
+{
+    foreach (const QByteArray &record, records)
+    {
+        QDataStream stream(record);
+        quint8 operation;
+        QString serverUrl, channelName;
+        stream >> operation >> serverUrl >> channelName;
+
+        foreach (ServerSettings *server, *(_serverSettings->getList<ServerSettings>()))
+        {
+            if (server->serverUrl() != serverUrl)
+                continue;
+
+            // Added entries may contain the channel key after the name
+            if (operation == JOURNAL_ADD_AUTOJOIN_CHANNEL)
+                server->addAutoJoinChannel(channelName.section(' ', 0, 0), channelName.section(' ', 1, 1));
+            else if (operation == JOURNAL_REMOVE_AUTOJOIN_CHANNEL)
+                server->removeAutoJoinChannel(channelName);
+        }
+    }
+}
+
+void AppSettings::saveServerSettings()
+{
+    TRACE_FUNCTION();
+    // Don't overwrite the stored settings with an incomplete list
+    loadServerSettings();
+    _serverSettingsSaveTimer->stop();
+    emit serverSettingsSnapshotReady(serializeServerSettings());
+}
+
+void AppSettings::scheduleSaveServerSettings()
+{
+    // Restarting the timer, so that a burst of changes results in only one write
+    _serverSettingsSaveTimer->start();
+}
+
+void AppSettings::journalAutoJoinChannel(ServerSettings *serverSettings, const QString &channelName, bool added)
+{
+    if (_isLoadingServerSettings)
+        return;
+
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream << (quint8) (added ? JOURNAL_ADD_AUTOJOIN_CHANNEL : JOURNAL_REMOVE_AUTOJOIN_CHANNEL) << serverSettings->serverUrl() << channelName;
+    emit serverSettingsJournalRecordReady(record);
 }
 
 void AppSettings::appendServerSettings(ServerSettings *serverSettings)
 {
+    loadServerSettings();
+
     if (!_serverSettings->getList()->contains(serverSettings))
     {
         _serverSettings->addItem(serverSettings);
@@ -99,8 +276,10 @@ void AppSettings::deleteServerSettings(ServerSettings *serverSettings)
     serverSettings->deleteLater();
 }
 
-int AppSettings::serverSettingsCount() const
+int AppSettings::serverSettingsCount()
 {
+    loadServerSettings();
+
     return _serverSettings->rowCount();
 }
 
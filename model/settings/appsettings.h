@@ -27,6 +27,10 @@
 #include "helpers/qobjectlistmodel.h"
 #include "model/settings/serversettings.h"
 
+class QThread;
+class QTimer;
+class ServerSettingsStore;
+
 // Increase this when anything changes in the settings
 #define APPSETTINGS_VERSION 4
 
@@ -53,12 +57,29 @@ class AppSettings : public QObject
     Q_PROPERTY(bool notifyOnNick READ notifyOnNick WRITE setNotifyOnNick NOTIFY notifyOnNickChanged)
     Q_PROPERTY(bool notifyOnPrivmsg READ notifyOnPrivmsg WRITE setNotifyOnPrivmsg NOTIFY notifyOnPrivmsgChanged)
     Q_PROPERTY(int fontSize READ fontSize WRITE setFontSize NOTIFY fontSizeChanged)
+    Q_PROPERTY(int lagProbeInterval READ lagProbeInterval WRITE setLagProbeInterval NOTIFY lagProbeIntervalChanged)
+    Q_PROPERTY(int lagProbeMaxMissed READ lagProbeMaxMissed WRITE setLagProbeMaxMissed NOTIFY lagProbeMaxMissedChanged)
+    Q_PROPERTY(QStringList nickColors READ nickColors WRITE setNickColors NOTIFY nickColorsChanged)
+    Q_PROPERTY(bool logChannels READ logChannels WRITE setLogChannels NOTIFY logChannelsChanged)
+    Q_PROPERTY(int logFormat READ logFormat WRITE setLogFormat NOTIFY logFormatChanged)
+    Q_PROPERTY(int logSyncPolicy READ logSyncPolicy WRITE setLogSyncPolicy NOTIFY logSyncPolicyChanged)
+    Q_PROPERTY(QStringList ignoreRules READ ignoreRules WRITE setIgnoreRules NOTIFY ignoreRulesChanged)
 
     QSettings _backend;
     QObjectListModel *_serverSettings;
+    ServerSettingsStore *_serverSettingsStore;
+    QThread *_serverSettingsThread;
+    QTimer *_serverSettingsSaveTimer;
+    bool _isLoadingServerSettings;
+    bool _isServerSettingsLoaded;
+
+    QByteArray serializeServerSettings();
+    void deserializeServerSettings(const QByteArray &array);
+    void replayServerSettingsJournal(const QList<QByteArray> &records);
 
 public:
     explicit AppSettings(QObject *parent = 0);
+    ~AppSettings();
 
     SETTINGPROPERTY(QString, partMessage, setPartMessage, partMessageChanged, "partMessage", "Leaving this channel. (with IRC Chatter)")
     SETTINGPROPERTY(QString, kickMessage, setKickMessage, kickMessageChanged, "kickMessage", "Kindergarten is elsewhere!")
@@ -71,16 +92,30 @@ public:
     SETTINGPROPERTY(bool, notifyOnNick, setNotifyOnNick, notifyOnNickChanged, "notifyOnNick", true)
     SETTINGPROPERTY(bool, notifyOnPrivmsg, setNotifyOnPrivmsg, notifyOnPrivmsgChanged, "notifyOnPrivmsg", true)
     SETTINGPROPERTY(int, fontSize, setFontSize, fontSizeChanged, "fontSize", QFont().pixelSize())
+    // Seconds between lag probes, and the number of unanswered probes after which we reconnect
+    SETTINGPROPERTY(int, lagProbeInterval, setLagProbeInterval, lagProbeIntervalChanged, "lagProbeInterval", 20)
+    SETTINGPROPERTY(int, lagProbeMaxMissed, setLagProbeMaxMissed, lagProbeMaxMissedChanged, "lagProbeMaxMissed", 3)
+    // Palette of the nick colours, empty means the built-in one
+    SETTINGPROPERTY(QStringList, nickColors, setNickColors, nickColorsChanged, "nickColors", QStringList())
+    // Logging of the channels to disk, the format and the sync policy are ChannelLogger::Format and ChannelLogger::SyncPolicy values
+    SETTINGPROPERTY(bool, logChannels, setLogChannels, logChannelsChanged, "logChannels", false)
+    SETTINGPROPERTY(int, logFormat, setLogFormat, logFormatChanged, "logFormat", 0)
+    SETTINGPROPERTY(int, logSyncPolicy, setLogSyncPolicy, logSyncPolicyChanged, "logSyncPolicy", 0)
+    // Rules of the events that are dropped, see IgnoreFilter for the syntax
+    SETTINGPROPERTY(QStringList, ignoreRules, setIgnoreRules, ignoreRulesChanged, "ignoreRules", QStringList())
 
     QObjectListModel *serverSettings();
     Q_INVOKABLE void appendServerSettings(ServerSettings *serverSettings);
     Q_INVOKABLE void deleteServerSettings(ServerSettings *serverSettings);
-    Q_INVOKABLE int serverSettingsCount() const;
+    Q_INVOKABLE int serverSettingsCount();
     Q_INVOKABLE ServerSettings *newServerSettings() { return new ServerSettings(this); }
     Q_INVOKABLE QString getDefaultFont() const;
+    void journalAutoJoinChannel(ServerSettings *serverSettings, const QString &channelName, bool added);
 
 public slots:
+    void loadServerSettings();
     Q_INVOKABLE void saveServerSettings();
+    void scheduleSaveServerSettings();
 
 signals:
     void areSettingsDeletedChanged();
@@ -97,6 +132,17 @@ signals:
     void displayTimestampsChanged();
     void notifyOnNickChanged();
     void notifyOnPrivmsgChanged();
+    void lagProbeIntervalChanged();
+    void lagProbeMaxMissedChanged();
+    void nickColorsChanged();
+    void logChannelsChanged();
+    void logFormatChanged();
+    void logSyncPolicyChanged();
+    void ignoreRulesChanged();
+
+    // Used for handing the data over to the ServerSettingsStore on the worker thread
+    void serverSettingsSnapshotReady(const QByteArray &data);
+    void serverSettingsJournalRecordReady(const QByteArray &record);
 };
 
 #endif // APPSETTINGS_H
@@ -21,54 +21,158 @@
 #include "model/settings/serversettings.h"
 #include "model/settings/appsettings.h"
 
+// Shown in place of the autojoin channel keys in the settings
+#define AUTOJOIN_KEY_MASK "********"
+
 ServerSettings::ServerSettings(QObject *parent, const QString &url, const quint16 &port, bool ssl, const QString &password, const QStringList &autoJoinChannels) :
     QObject(parent),
     _serverUrl(url),
     _serverPort(port),
     _serverSSL(ssl),
+    _sslVerification(SslIgnoreErrors),
     _serverPassword(password),
     _autoJoinChannels(autoJoinChannels),
     _isConnecting(false),
-    _isConnected(false)
+    _isConnected(false),
+    _lag(-1)
 {
+    takeAutoJoinChannelKeys();
 }
 
 QString ServerSettings::autoJoinChannelsInPlainString() const
 {
-    return _autoJoinChannels.join(", ");
+    QStringList entries;
+    foreach (const QString &channelName, autoJoinChannelNames())
+    {
+        if (_autoJoinChannelKeys.contains(channelName.toLower()))
+            entries.append(channelName + ' ' + AUTOJOIN_KEY_MASK);
+        else
+            entries.append(channelName);
+    }
+    return entries.join(", ");
 }
 
 void ServerSettings::setAutoJoinChannelsInPlainString(const QString &value)
 {
-    _autoJoinChannels = value.split(",");
+    QStringList channelNames;
+    QHash<QString, QString> channelKeys;
+
+    foreach (QString entry, value.split(","))
+    {
+        entry = entry.trimmed();
+        QString channelName = entry.section(' ', 0, 0), channelKey = entry.section(' ', 1, 1);
+        if (!channelName.length())
+            continue;
+
+        // A masked key is the one that was already saved
+        if (channelKey == AUTOJOIN_KEY_MASK)
+            channelKey = _autoJoinChannelKeys.value(channelName.toLower());
+        if (channelKey.length())
+            channelKeys.insert(channelName.toLower(), channelKey);
+
+        channelNames.append(channelName);
+    }
+
+    _autoJoinChannels = channelNames;
+    _autoJoinChannelKeys = channelKeys;
+}
+
+void ServerSettings::setAutoJoinChannelKeys(const QHash<QString, QString> &keys)
+{
+    // Older versions kept the keys in the autojoin list, those are preferred
+    QHash<QString, QString> inlineKeys = _autoJoinChannelKeys;
+    _autoJoinChannelKeys = keys;
+    _autoJoinChannelKeys.unite(inlineKeys);
+}
+
+void ServerSettings::takeAutoJoinChannelKeys()
+{
+    // Moves the keys of '#channel key' entries out of the autojoin list
     for (int i = 0; i < _autoJoinChannels.count(); i++)
-        _autoJoinChannels[i] = _autoJoinChannels[i].trimmed();
+    {
+        QString channelName = _autoJoinChannels[i].section(' ', 0, 0), channelKey = _autoJoinChannels[i].section(' ', 1, 1);
+        if (channelKey.length())
+            _autoJoinChannelKeys.insert(channelName.toLower(), channelKey);
+        _autoJoinChannels[i] = channelName;
+    }
 }
 
-void ServerSettings::addAutoJoinChannel(const QString &channelName)
+static int indexOfAutoJoinChannel(const QStringList &entries, const QString &channelName)
 {
-    if (!_autoJoinChannels.contains(channelName, Qt::CaseInsensitive))
+    for (int i = 0; i < entries.count(); i++)
+    {
+        if (entries[i].compare(channelName, Qt::CaseInsensitive) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+QStringList ServerSettings::autoJoinChannelNames() const
+{
+    QStringList result;
+    foreach (const QString &channelName, _autoJoinChannels)
+    {
+        if (channelName.length())
+            result.append(channelName);
+    }
+    return result;
+}
+
+QString ServerSettings::autoJoinChannelKey(const QString &channelName) const
+{
+    return _autoJoinChannelKeys.value(channelName.toLower());
+}
+
+void ServerSettings::addAutoJoinChannel(const QString &channelName, const QString &channelKey)
+{
+    int index = indexOfAutoJoinChannel(_autoJoinChannels, channelName);
+
+    if (index == -1)
     {
         qDebug() << "adding" << channelName << "to autojoin";
         _autoJoinChannels.append(channelName);
-        emit this->autoJoinChannelsChanged();
+        if (channelKey.length())
+            _autoJoinChannelKeys.insert(channelName.toLower(), channelKey);
     }
+    else if (channelKey.length() && autoJoinChannelKey(channelName) != channelKey)
+    {
+        qDebug() << "updating the key of" << channelName << "in autojoin";
+        _autoJoinChannelKeys.insert(channelName.toLower(), channelKey);
+    }
+    else
+    {
+        return;
+    }
+
+    emit this->autoJoinChannelsChanged();
+
+    // The journal is kept in the same store as the server password
+    if (AppSettings *appSettings = qobject_cast<AppSettings*>(parent()))
+        appSettings->journalAutoJoinChannel(this, channelKey.length() ? (channelName + ' ' + channelKey) : channelName, true);
 }
 
 void ServerSettings::removeAutoJoinChannel(const QString &channelName)
 {
-    if (_autoJoinChannels.contains(channelName, Qt::CaseInsensitive))
+    int index = indexOfAutoJoinChannel(_autoJoinChannels, channelName);
+
+    if (index != -1)
     {
         qDebug() << "removing" << channelName << "from autojoin";
-        _autoJoinChannels.removeAll(channelName);
+        _autoJoinChannels.removeAt(index);
+        _autoJoinChannelKeys.remove(channelName.toLower());
         emit this->autoJoinChannelsChanged();
+
+        if (AppSettings *appSettings = qobject_cast<AppSettings*>(parent()))
+            appSettings->journalAutoJoinChannel(this, channelName, false);
     }
 }
 
 void ServerSettings::save()
 {
+    // The change itself is already in the journal, the snapshot can wait
     AppSettings *appSettings = static_cast<AppSettings*>(this->parent());
-    appSettings->saveServerSettings();
+    appSettings->scheduleSaveServerSettings();
 }
 
 void ServerSettings::backendAsksForPassword(QString *password)
@@ -92,7 +196,7 @@ QDataStream &operator<<(QDataStream &stream, const ServerSettings &serverSetting
 
 QDataStream &operator>>(QDataStream &stream, ServerSettings &serverSettings)
 {
-    return stream
+    stream
             >> serverSettings._serverUrl
             >> serverSettings._serverPassword
             >> serverSettings._autoJoinChannels
@@ -102,4 +206,7 @@ QDataStream &operator>>(QDataStream &stream, ServerSettings &serverSettings)
             >> serverSettings._userIdent
             >> serverSettings._userRealName
             >> serverSettings._shouldConnect;
+
+    serverSettings.takeAutoJoinChannelKeys();
+    return stream;
 }
@@ -21,6 +21,7 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
+#include <QtCore/QHash>
 #include <QtCore/QDataStream>
 
 #include "helpers/util.h"
@@ -36,16 +37,25 @@
 class ServerSettings : public QObject
 {
     Q_OBJECT
+    Q_ENUMS(SslVerification)
     GENPROPERTY_F(QString, _serverUrl, serverUrl, setServerUrl, serverUrlChanged)
     Q_PROPERTY(QString serverUrl READ serverUrl WRITE setServerUrl NOTIFY serverUrlChanged)
     GENPROPERTY_F(quint16, _serverPort, serverPort, setServerPort, serverPortChanged)
     Q_PROPERTY(quint16 serverPort READ serverPort WRITE setServerPort NOTIFY serverPortChanged)
     GENPROPERTY_F(bool, _serverSSL, serverSSL, setServerSSL, serverSSLChanged)
     Q_PROPERTY(bool serverSSL READ serverSSL WRITE setServerSSL NOTIFY serverSSLChanged)
+    // One of the SslVerification values
+    GENPROPERTY_F(int, _sslVerification, sslVerification, setSslVerification, sslVerificationChanged)
+    Q_PROPERTY(int sslVerification READ sslVerification WRITE setSslVerification NOTIFY sslVerificationChanged)
+    // Digest of the certificate the server presented first, when pinning
+    GENPROPERTY_S(QByteArray, _sslPinnedDigest, sslPinnedDigest, setSslPinnedDigest)
+    // TLS session of the last connection, offered again when reconnecting - not saved
+    GENPROPERTY_S(QByteArray, _sslSession, sslSession, setSslSession)
     GENPROPERTY_F(QString, _serverPassword, serverPassword, setServerPassword, serverPasswordChanged)
     Q_PROPERTY(QString serverPassword READ serverPassword WRITE setServerPassword NOTIFY serverPasswordChanged)
     GENPROPERTY_F(QStringList, _autoJoinChannels, autoJoinChannels, setAutoJoinChannels, autoJoinChannelsChanged)
     Q_PROPERTY(QStringList autoJoinChannels READ autoJoinChannels WRITE setAutoJoinChannels NOTIFY autoJoinChannelsChanged)
+    // Shows the keys masked, so that they aren't visible in the settings
     Q_PROPERTY(QString autoJoinChannelsInPlainString READ autoJoinChannelsInPlainString WRITE setAutoJoinChannelsInPlainString NOTIFY autoJoinChannelsChanged)
     GENPROPERTY_F(QString, _userNickname, userNickname, setUserNickname, userNicknameChanged)
     Q_PROPERTY(QString userNickname READ userNickname WRITE setUserNickname NOTIFY userNicknameChanged)
@@ -60,14 +70,31 @@ class ServerSettings : public QObject
     Q_PROPERTY(bool isConnecting READ isConnecting WRITE setIsConnecting NOTIFY isConnectingChanged)
     GENPROPERTY_F(bool, _isConnected, isConnected, setIsConnected, isConnectedChanged)
     Q_PROPERTY(bool isConnected READ isConnected WRITE setIsConnected NOTIFY isConnectedChanged)
+    // Current lag of the connection in milliseconds, -1 if unknown
+    GENPROPERTY_F(int, _lag, lag, setLag, lagChanged)
+    Q_PROPERTY(int lag READ lag NOTIFY lagChanged)
 
     friend QDataStream &operator>>(QDataStream &stream, ServerSettings &server);
 
 public:
+    enum SslVerification
+    {
+        // Accept any certificate, this is how older versions behaved
+        SslIgnoreErrors = 0,
+        // Only accept certificates that are valid for the host
+        SslVerifyPeer = 1,
+        // Trust the certificate seen on the first connection, reject any other later
+        SslPinCertificate = 2
+    };
+
     explicit ServerSettings(QObject *parent = 0, const QString &url = DEFAULT_SERVER, const quint16 &port = 6667, bool ssl = false, const QString &password = QString(), const QStringList &autoJoinChannels = QStringList());
     QString autoJoinChannelsInPlainString() const;
     void setAutoJoinChannelsInPlainString(const QString &value);
-    void addAutoJoinChannel(const QString &channelName);
+    QStringList autoJoinChannelNames() const;
+    QString autoJoinChannelKey(const QString &channelName) const;
+    const QHash<QString, QString> &autoJoinChannelKeys() const { return _autoJoinChannelKeys; }
+    void setAutoJoinChannelKeys(const QHash<QString, QString> &keys);
+    void addAutoJoinChannel(const QString &channelName, const QString &channelKey = QString());
     void removeAutoJoinChannel(const QString &channelName);
     void save();
 
@@ -77,6 +104,7 @@ signals:
     void autoJoinChannelsChanged();
     void serverPortChanged();
     void serverSSLChanged();
+    void sslVerificationChanged();
     void userNicknameChanged();
     void userIdentChanged();
     void userRealNameChanged();
@@ -84,6 +112,13 @@ signals:
 
     void isConnectingChanged();
     void isConnectedChanged();
+    void lagChanged();
+
+private:
+    // Channel keys by lowercase channel name, saved like the server password
+    QHash<QString, QString> _autoJoinChannelKeys;
+
+    void takeAutoJoinChannelKeys();
 
 private slots:
     void backendAsksForPassword(QString *password);
@@ -0,0 +1,165 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#if defined(Q_OS_UNIX)
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+#include "model/settings/serversettingsstore.h"
+
+#define SERVERSETTINGSSTORE_MAGIC 0x49524353
+#define SERVERSETTINGSSTORE_VERSION 1
+
+static bool commitFile(QFile &file)
+{
+    if (!file.flush())
+        return false;
+#if defined(Q_OS_UNIX)
+    if (::fsync(file.handle()) != 0)
+        return false;
+#endif
+    return true;
+}
+
+ServerSettingsStore::ServerSettingsStore(const QString &directory, QObject *parent) :
+    QObject(parent),
+    _snapshotPath(QDir(directory).filePath("serversettings.dat")),
+    _journalPath(QDir(directory).filePath("serversettings.journal"))
+{
+    QDir().mkpath(directory);
+}
+
+bool ServerSettingsStore::readSnapshot(QByteArray *data) const
+{
+    QFile file(_snapshotPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_7);
+    quint32 magic, version;
+    quint16 checksum;
+    stream >> magic >> version >> *data >> checksum;
+
+    if (stream.status() != QDataStream::Ok || magic != SERVERSETTINGSSTORE_MAGIC || version != SERVERSETTINGSSTORE_VERSION
+            || checksum != qChecksum(data->constData(), data->size()))
+    {
+        qWarning() << Q_FUNC_INFO << "the server settings snapshot is unreadable, ignoring it";
+        data->clear();
+        return false;
+    }
+
+    return true;
+}
+
+QList<QByteArray> ServerSettingsStore::readJournal() const
+{
+    QList<QByteArray> records;
+    QFile file(_journalPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return records;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_7);
+    while (!stream.atEnd())
+    {
+        QByteArray record;
+        quint16 checksum;
+        stream >> record >> checksum;
+
+        // A torn record at the end means that we crashed while appending it
+        if (stream.status() != QDataStream::Ok || checksum != qChecksum(record.constData(), record.size()))
+            break;
+
+        records.append(record);
+    }
+
+    return records;
+}
+
+bool ServerSettingsStore::writeSnapshot(const QByteArray &data)
+{
+    QString tempPath = _snapshotPath + ".tmp";
+    QFile file(tempPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << Q_FUNC_INFO << "can't open" << tempPath << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_7);
+    stream << (quint32) SERVERSETTINGSSTORE_MAGIC << (quint32) SERVERSETTINGSSTORE_VERSION << data << qChecksum(data.constData(), data.size());
+
+    if (stream.status() != QDataStream::Ok || !commitFile(file))
+    {
+        qWarning() << Q_FUNC_INFO << "can't write" << tempPath << file.errorString();
+        file.close();
+        QFile::remove(tempPath);
+        return false;
+    }
+    file.close();
+
+    // Replace the old snapshot atomically, so that a crash leaves either the old or the new one
+#if defined(Q_OS_UNIX)
+    if (::rename(QFile::encodeName(tempPath).constData(), QFile::encodeName(_snapshotPath).constData()) != 0)
+#else
+    QFile::remove(_snapshotPath);
+    if (!QFile::rename(tempPath, _snapshotPath))
+#endif
+    {
+        qWarning() << Q_FUNC_INFO << "can't replace" << _snapshotPath;
+        return false;
+    }
+
+    // Every change in the journal is now contained by the snapshot
+    QFile::remove(_journalPath);
+    return true;
+}
+
+void ServerSettingsStore::appendJournal(const QByteArray &record)
+{
+    QFile file(_journalPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning() << Q_FUNC_INFO << "can't open" << _journalPath << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_7);
+    stream << record << qChecksum(record.constData(), record.size());
+    file.flush();
+}
+
+void ServerSettingsStore::removeAll()
+{
+    QFile::remove(_snapshotPath);
+    QFile::remove(_journalPath);
+}
+
+void ServerSettingsStore::sync()
+{
+    // Nothing to do: when this is invoked through a blocking queued connection,
+    // returning from it means that all the writes queued before it are finished.
+}
@@ -0,0 +1,53 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef SERVERSETTINGSSTORE_H
+#define SERVERSETTINGSSTORE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+// Stores the serialized server settings on disk.
+// The settings are kept as a snapshot file which is only ever replaced by
+// an atomic rename, plus a small append-only journal of the changes made
+// since the last snapshot. The write slots are meant to be invoked through
+// queued connections, so that the store can live on a worker thread.
+
+class ServerSettingsStore : public QObject
+{
+    Q_OBJECT
+    QString _snapshotPath;
+    QString _journalPath;
+
+public:
+    explicit ServerSettingsStore(const QString &directory, QObject *parent = 0);
+
+    bool readSnapshot(QByteArray *data) const;
+    QList<QByteArray> readJournal() const;
+
+public slots:
+    // Returns false if the snapshot couldn't be written, the old one is kept then
+    bool writeSnapshot(const QByteArray &data);
+    void appendJournal(const QByteArray &record);
+    void removeAll();
+    void sync();
+
+};
+
+#endif // SERVERSETTINGSSTORE_H
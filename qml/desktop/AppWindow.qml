@@ -19,6 +19,7 @@ import QtQuick 2.0
 import "./components"
 import "./pages"
 import "./dialogs"
+import "./misc"
 
 Rectangle {
     id: appWindow
@@ -38,4 +39,6 @@ Rectangle {
     AboutDialog {
         id: aboutDialog
     }
+    MetricsOverlay {
+    }
 }
@@ -152,6 +152,26 @@ Page {
             }
         }
         // SETTING GROUP
+        TitleLabel {
+            color: "#fff"
+            text: "Logging"
+        }
+        // SETTING: log the channels to disk
+        Text {
+            color: "#fff"
+            text: "Log the channels to disk"
+            width: parent.width
+
+            Switch {
+                value: appSettings.logChannels
+                onValueChanged: appSettings.logChannels = value
+                anchors {
+                    right: parent.right
+                    verticalCenter: parent.verticalCenter
+                }
+            }
+        }
+        // SETTING GROUP
         TitleLabel {
             color: "#fff"
             text: "Customizations"
@@ -54,6 +54,8 @@ PageStackWindow {
 
     // Common components
 
+    MetricsOverlay {
+    }
     QueryDialog {
         id: aboutDialog
         titleText: "About IRC Chatter"
@@ -0,0 +1,53 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+import QtQuick 1.1
+
+// Debug overlay with the metrics of the servers and channels, shown with
+// --metrics-overlay or with showOverlay on the /metrics object of the bus
+Rectangle {
+    id: metricsOverlay
+    visible: metrics.isOverlayVisible
+    z: 1000
+    anchors.top: parent.top
+    anchors.left: parent.left
+    anchors.right: parent.right
+    height: metricsText.paintedHeight + 20
+    color: "#c0000000"
+
+    Text {
+        id: metricsText
+        x: 10
+        y: 10
+        width: parent.width - 20
+        color: "#fff"
+        font.family: "Monospace"
+        font.pixelSize: 14
+        wrapMode: Text.WrapAnywhere
+    }
+    Timer {
+        interval: 1000
+        repeat: true
+        triggeredOnStart: true
+        running: metricsOverlay.visible
+        onTriggered: metricsText.text = metrics.report()
+    }
+    MouseArea {
+        anchors.fill: parent
+        onClicked: metrics.hideOverlay()
+    }
+}
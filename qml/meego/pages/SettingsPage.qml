@@ -126,6 +126,25 @@ Page {
                     }
                 }
             }
+            // SETTING: Log the channels to disk
+            Label {
+                text: "Log the channels to disk"
+                width: parent.width
+                height: logChannelsSwitch.height
+                verticalAlignment: Text.AlignVCenter
+
+                Switch {
+                    id: logChannelsSwitch
+                    anchors.right: parent.right
+                    checked: appSettings.logChannels
+
+                    Binding {
+                        target: appSettings
+                        property: "logChannels"
+                        value: logChannelsSwitch.checked
+                    }
+                }
+            }
             // SETTING: Use monospace font for channel text area
             Label {
                 text: "Use monospace font"
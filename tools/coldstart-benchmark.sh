@@ -0,0 +1,25 @@
+#!/bin/sh
+# Repeatable cold start benchmark for IRC Chatter.
+# Starts the application a number of times with --startup-benchmark, which
+# connects to the servers marked for connecting and quits after the first
+# connection is made, and collects time-to-first-frame and time-to-first-connect.
+#
+# Usage: coldstart-benchmark.sh [path to irc-chatter] [number of runs]
+# When run as root, the page cache is dropped before every run.
+
+BINARY=${1:-./irc-chatter}
+RUNS=${2:-5}
+OUTDIR=$(mktemp -d)
+
+i=1
+while [ $i -le $RUNS ]; do
+    if [ "$(id -u)" = "0" ]; then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+
+    "$BINARY" --startup-benchmark --startup-profile="$OUTDIR/run-$i.csv" 2>/dev/null | grep '^time-to-'
+    i=$((i + 1))
+done
+
+echo "Per-phase results are in $OUTDIR"
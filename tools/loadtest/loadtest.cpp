@@ -0,0 +1,101 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+// End-to-end throughput test: a synthetic IRC server on the loopback
+// interface feeds the real client with more and more traffic, until the
+// client falls behind. Usage:
+//   irc-chatter-loadtest [--channels=N] [--users=N] [--rate=N] [--max-rate=N]
+//       [--step=seconds] [--threshold=ms] [--churn=N] [--netsplit=seconds]
+//       [--list-size=N] [--ssl-cert=file --ssl-key=file]
+// With --scenario=name, it runs one of the scenarios of ScenarioTest instead.
+
+#if QT_VERSION >= 0x050000
+#include <QtGui/QGuiApplication>
+#else
+#include <QtGui/QApplication>
+#endif
+
+#include "tools/loadtest/loadtestdriver.h"
+#include "tools/loadtest/scenariotest.h"
+#include "model/ircmodel.h"
+#include "model/settings/appsettings.h"
+
+static int intArgument(const QString &arg, const QString &name, int value)
+{
+    return arg.startsWith(name) ? arg.mid(name.length()).toInt() : value;
+}
+
+int main(int argc, char *argv[])
+{
+#if QT_VERSION >= 0x050000
+    // Nothing is shown, but the settings need a GUI application for the fonts
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+#else
+    QApplication app(argc, argv, false);
+#endif
+
+    // Keeping away from the settings of the real application
+    QCoreApplication::setApplicationName("irc-chatter-loadtest");
+    QCoreApplication::setOrganizationName("irc-chatter");
+
+    SyntheticIrcServer::LoadProfile profile;
+    int rate = 100, maxRate = 100000, step = 5, threshold = 1000;
+    QString certificatePath, keyPath, scenario;
+
+    foreach (const QString &arg, app.arguments().mid(1))
+    {
+        profile.channels = intArgument(arg, "--channels=", profile.channels);
+        profile.users = intArgument(arg, "--users=", profile.users);
+        profile.churnRate = intArgument(arg, "--churn=", profile.churnRate);
+        profile.netsplitInterval = intArgument(arg, "--netsplit=", profile.netsplitInterval);
+        profile.listSize = intArgument(arg, "--list-size=", profile.listSize);
+        rate = intArgument(arg, "--rate=", rate);
+        maxRate = intArgument(arg, "--max-rate=", maxRate);
+        step = intArgument(arg, "--step=", step);
+        threshold = intArgument(arg, "--threshold=", threshold);
+
+        if (arg.startsWith("--ssl-cert="))
+            certificatePath = arg.mid(11);
+        else if (arg.startsWith("--ssl-key="))
+            keyPath = arg.mid(10);
+        else if (arg.startsWith("--scenario="))
+            scenario = arg.mid(11);
+    }
+
+    AppSettings *appSettings = new AppSettings(&app);
+    IrcModel *model = new IrcModel(&app, appSettings);
+
+    if (scenario.length())
+    {
+        // The scenario exits with 0 if every check passed
+        ScenarioTest *scenarioTest = new ScenarioTest(&app, appSettings, model);
+        if (!scenarioTest->start(scenario))
+            return 1;
+        return app.exec();
+    }
+
+    LoadTestDriver *driver = new LoadTestDriver(&app, appSettings, model);
+    driver->setRamp(rate, maxRate, step * 1000, threshold);
+
+    if (!driver->start(profile, certificatePath, keyPath))
+        return 1;
+
+    // The driver exits with 0 if at least the first step passed
+    return app.exec();
+}
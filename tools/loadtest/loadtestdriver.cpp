@@ -0,0 +1,214 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QtAlgorithms>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslKey>
+
+#include <cstdio>
+
+#include "tools/loadtest/loadtestdriver.h"
+#include "clients/communiircclient.h"
+#include "model/ircmodel.h"
+#include "model/settings/appsettings.h"
+#include "model/settings/serversettings.h"
+
+// Time given to the client to connect and join
+#define LOADTEST_CONNECT_TIMEOUT 30000
+// Time after joining before the first step, the NAMES replies are processed in it
+#define LOADTEST_WARMUP 2000
+// A step fails if fewer messages arrive than this percentage of the ones sent
+#define LOADTEST_MIN_DELIVERY 90
+
+LoadTestDriver::LoadTestDriver(QObject *parent, AppSettings *appSettings, IrcModel *model) :
+    QObject(parent),
+    _appSettings(appSettings),
+    _model(model),
+    _server(new SyntheticIrcServer()),
+    _serverThread(new QThread(this)),
+    _serverSettings(0),
+    _client(0),
+    _stepTimer(new QTimer(this)),
+    _lastSequence(0),
+    _gaps(0),
+    _rate(100),
+    _maxRate(100000),
+    _stepDuration(5000),
+    _threshold(1000),
+    _passedRate(0),
+    _requestList(true)
+{
+    _stepTimer->setSingleShot(true);
+    connect(_stepTimer, SIGNAL(timeout()), this, SLOT(finishStep()));
+}
+
+LoadTestDriver::~LoadTestDriver()
+{
+    _serverThread->quit();
+    _serverThread->wait();
+}
+
+void LoadTestDriver::setRamp(int startRate, int maxRate, int stepDuration, int threshold)
+{
+    _rate = qMax(1, startRate);
+    _maxRate = qMax(_rate, maxRate);
+    _stepDuration = qMax(1000, stepDuration);
+    _threshold = qMax(1, threshold);
+}
+
+bool LoadTestDriver::start(const SyntheticIrcServer::LoadProfile &profile, const QString &certificatePath, const QString &keyPath)
+{
+    SyntheticIrcServer::LoadProfile serverProfile = profile;
+    // Quiet until the first step starts
+    serverProfile.messageRate = 0;
+    _server->setProfile(serverProfile);
+
+    bool ssl = certificatePath.length() && keyPath.length();
+    if (ssl)
+    {
+        QFile certificateFile(certificatePath), keyFile(keyPath);
+        if (!certificateFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly))
+        {
+            fprintf(stderr, "could not read the certificate or the key\n");
+            return false;
+        }
+
+        _server->setCertificate(QSslCertificate(certificateFile.readAll()), QSslKey(keyFile.readAll(), QSsl::Rsa));
+    }
+
+    _server->moveToThread(_serverThread);
+    connect(_serverThread, SIGNAL(finished()), _server, SLOT(deleteLater()));
+    _serverThread->start();
+
+    int port = 0;
+    QMetaObject::invokeMethod(_server, "start", Qt::BlockingQueuedConnection, Q_RETURN_ARG(int, port), Q_ARG(int, 0));
+    if (!port)
+        return false;
+
+    QStringList channels;
+    for (int i = 0; i < profile.channels; i++)
+        channels.append(QString("#load-%1").arg(i));
+
+    _serverSettings = new ServerSettings(_appSettings, "127.0.0.1", port, ssl);
+    _serverSettings->setUserNickname("loadtest");
+    _serverSettings->setAutoJoinChannels(channels);
+
+    _client = new CommuniIrcClient(_model, _serverSettings);
+    _model->attachServer(_serverSettings, _client);
+    // Connected after the models, so the time they take is part of the delay
+    connect(_client, SIGNAL(receiveMessage(QString,QString,QString)), this, SLOT(receiveMessage(QString,QString,QString)));
+    connect(_client, SIGNAL(connectedToServer()), this, SLOT(connected()));
+    _client->connectToServer();
+
+    QTimer::singleShot(LOADTEST_CONNECT_TIMEOUT, this, SLOT(timedOut()));
+    printf("synthetic server listening on port %d%s\n", port, ssl ? " with TLS" : "");
+    fflush(stdout);
+    return true;
+}
+
+void LoadTestDriver::finish(int exitCode)
+{
+    _stepTimer->stop();
+    emit finished(exitCode);
+    QCoreApplication::exit(exitCode);
+}
+
+void LoadTestDriver::timedOut()
+{
+    if (_serverSettings && !_serverSettings->isConnected())
+    {
+        fprintf(stderr, "the client did not connect in time\n");
+        finish(1);
+    }
+}
+
+void LoadTestDriver::connected()
+{
+    if (_requestList)
+        _client->sendRaw("LIST");
+
+    QTimer::singleShot(LOADTEST_WARMUP, this, SLOT(startStep()));
+}
+
+void LoadTestDriver::startStep()
+{
+    _delays.clear();
+    _gaps = 0;
+    _stepClock.start();
+    QMetaObject::invokeMethod(_server, "setMessageRate", Qt::QueuedConnection, Q_ARG(int, _rate));
+    _stepTimer->start(_stepDuration);
+}
+
+void LoadTestDriver::receiveMessage(const QString &channelName, const QString &userName, const QString &message)
+{
+    Q_UNUSED(channelName)
+    Q_UNUSED(userName)
+
+    if (!message.startsWith("seq="))
+        return;
+
+    quint64 sequence = message.section(' ', 0, 0).mid(4).toULongLong();
+    qint64 sent = message.section(' ', 1, 1).mid(5).toLongLong();
+
+    if (_lastSequence && sequence != _lastSequence + 1)
+        _gaps++;
+    _lastSequence = sequence;
+
+    if (_stepTimer->isActive())
+        _delays.append(QDateTime::currentMSecsSinceEpoch() - sent);
+}
+
+void LoadTestDriver::finishStep()
+{
+    // Pausing the load, so that a step which fell behind doesn't spoil the verdict
+    QMetaObject::invokeMethod(_server, "setMessageRate", Qt::QueuedConnection, Q_ARG(int, 0));
+
+    QVector<qint64> delays = _delays;
+    qSort(delays);
+    double seconds = _stepClock.elapsed() / 1000.0;
+    double receivedRate = seconds > 0 ? delays.count() / seconds : 0;
+    qint64 p50 = delays.count() ? delays[delays.count() / 2] : -1;
+    qint64 p90 = delays.count() ? delays[qMin(delays.count() - 1, delays.count() * 9 / 10)] : -1;
+
+    bool passed = p90 >= 0 && p90 <= _threshold && receivedRate * 100 >= _rate * LOADTEST_MIN_DELIVERY;
+    printf("rate %d msg/s: received %.0f msg/s, delay p50 %lld ms, p90 %lld ms, gaps %llu - %s\n",
+           _rate, receivedRate, (long long) p50, (long long) p90, (unsigned long long) _gaps, passed ? "ok" : "behind");
+    fflush(stdout);
+
+    if (passed)
+        _passedRate = _rate;
+
+    if (!passed || _rate >= _maxRate)
+    {
+        if (_passedRate)
+            printf("the client keeps up with %d msg/s\n", _passedRate);
+        else
+            printf("the client could not keep up with the first step\n");
+        fflush(stdout);
+        finish(_passedRate ? 0 : 1);
+        return;
+    }
+
+    _rate = qMin(_maxRate, _rate * 3 / 2 + 1);
+    // Letting the client catch up before the next step
+    QTimer::singleShot(LOADTEST_WARMUP, this, SLOT(startStep()));
+}
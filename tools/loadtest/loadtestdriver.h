@@ -0,0 +1,78 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef LOADTESTDRIVER_H
+#define LOADTESTDRIVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+#include "tools/loadtest/syntheticircserver.h"
+
+class QThread;
+class QTimer;
+class AppSettings;
+class IrcModel;
+class ServerSettings;
+class CommuniIrcClient;
+
+// Connects the real client to a SyntheticIrcServer running on its own
+// thread and raises the message rate step by step. A step fails when the
+// messages arrive too late or fewer of them arrive than were sent, the
+// last rate that passed is what the client can keep up with.
+
+class LoadTestDriver : public QObject
+{
+    Q_OBJECT
+    AppSettings *_appSettings;
+    IrcModel *_model;
+    SyntheticIrcServer *_server;
+    QThread *_serverThread;
+    ServerSettings *_serverSettings;
+    CommuniIrcClient *_client;
+    QTimer *_stepTimer;
+    QElapsedTimer _stepClock;
+    QVector<qint64> _delays;
+    quint64 _lastSequence, _gaps;
+    int _rate, _maxRate, _stepDuration, _threshold, _passedRate;
+    bool _requestList;
+
+    void finish(int exitCode);
+
+public:
+    explicit LoadTestDriver(QObject *parent, AppSettings *appSettings, IrcModel *model);
+    ~LoadTestDriver();
+
+    // Starts at startRate messages per second and raises it by half in every step
+    void setRamp(int startRate, int maxRate, int stepDuration, int threshold);
+    void setRequestList(bool value) { _requestList = value; }
+    bool start(const SyntheticIrcServer::LoadProfile &profile, const QString &certificatePath, const QString &keyPath);
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void connected();
+    void startStep();
+    void finishStep();
+    void timedOut();
+    void receiveMessage(const QString &channelName, const QString &userName, const QString &message);
+
+};
+
+#endif // LOADTESTDRIVER_H
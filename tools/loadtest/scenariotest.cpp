@@ -0,0 +1,516 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslKey>
+
+#include <cstdio>
+
+#include "tools/loadtest/scenariotest.h"
+#include "tools/loadtest/syntheticircserver.h"
+#include "clients/communiircclient.h"
+#include "helpers/channellogger.h"
+#include "model/ircmodel.h"
+#include "model/servermodel.h"
+#include "model/channelmodel.h"
+#include "model/settings/appsettings.h"
+#include "model/settings/serversettings.h"
+
+// A scenario fails if it doesn't get through in this time
+#define SCENARIO_TIMEOUT 60000
+#define SCENARIO_POLL_INTERVAL 50
+// Messages per second in the channels, enough to have some scrollback
+#define SCENARIO_MESSAGE_RATE 20
+// Connections the server drops after the first one in the reconnect scenario
+#define SCENARIO_DROPPED_ATTEMPTS 2
+// Longest time without a message in the migrate scenario, the messages alone are about 50 ms apart
+#define SCENARIO_MAX_MIGRATION_GAP 1000
+// Time given to the client to get through with a certificate it should reject
+#define SCENARIO_REJECT_WAIT 3000
+// Messages per second over both channels in the logging scenario, which the logger has to keep up with
+#define SCENARIO_LOG_RATE 10000
+#define SCENARIO_LOG_DURATION 10000
+// The client is done with the burst when the channels are quiet for this long
+#define SCENARIO_LOG_SETTLE 500
+// Lines the server plays back for every channel and for the query
+#define SCENARIO_PLAYBACK_LINES 6
+// Live messages the playback scenario waits for, a few seconds of them
+#define SCENARIO_LIVE_MESSAGES 40
+
+#ifndef SCENARIO_CERTIFICATE_DIR
+#define SCENARIO_CERTIFICATE_DIR "tools/loadtest/certs"
+#endif
+
+ScenarioTest::ScenarioTest(QObject *parent, AppSettings *appSettings, IrcModel *model) :
+    QObject(parent),
+    _appSettings(appSettings),
+    _model(model),
+    _server(0),
+    _secondServer(0),
+    _serverSettings(0),
+    _client(0),
+    _serverModel(0),
+    _pollTimer(new QTimer(this)),
+    _step(0),
+    _failures(0),
+    _acceptCount(0),
+    _joinCount(0),
+    _dropTime(0),
+    _lastAppend(-1),
+    _longestGap(0),
+    _wasDisconnected(false),
+    _closedTooEarly(false),
+    _certificateDirectory(SCENARIO_CERTIFICATE_DIR),
+    _firstHandshake(-1),
+    _burstStart(0),
+    _burstTime(0),
+    _loggedBefore(0),
+    _livePlaybackLines(0),
+    _liveMessages(0)
+{
+    _pollTimer->setInterval(SCENARIO_POLL_INTERVAL);
+    connect(_pollTimer, SIGNAL(timeout()), this, SLOT(poll()));
+}
+
+QStringList ScenarioTest::scenarios()
+{
+    return QStringList() << "reconnect" << "migrate" << "tls" << "logging" << "playback";
+}
+
+SyntheticIrcServer *ScenarioTest::createServer()
+{
+    // The server runs on this thread, the scenarios look into it between the events
+    SyntheticIrcServer *server = new SyntheticIrcServer(this);
+    SyntheticIrcServer::LoadProfile profile;
+    profile.channels = 2;
+    profile.users = 50;
+    profile.messageRate = SCENARIO_MESSAGE_RATE;
+    profile.churnRate = 0;
+    server->setProfile(profile);
+    return server;
+}
+
+void ScenarioTest::connectClient(int port, bool ssl)
+{
+    _serverSettings = new ServerSettings(_appSettings, "127.0.0.1", port, ssl);
+    _serverSettings->setUserNickname("scenario");
+    _serverSettings->setAutoJoinChannelsInPlainString("#load-0 secret, #load-1");
+    // The certificate is self-signed, pinning is the policy which accepts it
+    if (ssl)
+        _serverSettings->setSslVerification(ServerSettings::SslPinCertificate);
+
+    _client = new CommuniIrcClient(_model, _serverSettings);
+    _serverModel = _model->attachServer(_serverSettings, _client);
+    connect(_client, SIGNAL(receiveError(QString)), this, SLOT(receiveError(QString)));
+    connect(_client, SIGNAL(receiveHistory(QString,QList<IrcHistoryLine>)), this, SLOT(receiveHistory(QString,QList<IrcHistoryLine>)));
+    connect(_client, SIGNAL(receiveMessage(QString,QString,QString)), this, SLOT(receiveMessage(QString,QString,QString)));
+    _client->connectToServer();
+}
+
+bool ScenarioTest::loadCertificate(SyntheticIrcServer *server, const QString &name)
+{
+    QFile certificateFile(_certificateDirectory + "/" + name + ".crt"), keyFile(_certificateDirectory + "/" + name + ".key");
+    if (!certificateFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly))
+    {
+        fprintf(stderr, "could not read the certificate %s from %s\n", qPrintable(name), qPrintable(_certificateDirectory));
+        return false;
+    }
+
+    server->setCertificate(QSslCertificate(certificateFile.readAll()), QSslKey(keyFile.readAll(), QSsl::Rsa));
+    return true;
+}
+
+bool ScenarioTest::start(const QString &scenario)
+{
+    if (!scenarios().contains(scenario))
+    {
+        fprintf(stderr, "unknown scenario: %s\n", qPrintable(scenario));
+        return false;
+    }
+
+    _scenario = scenario;
+    _clock.start();
+    _server = createServer();
+    if (_scenario == "tls" && !loadCertificate(_server, "scenario"))
+        return false;
+    if (_scenario == "playback")
+        _server->setPlaybackLength(SCENARIO_PLAYBACK_LINES);
+
+    int port = _server->start();
+    if (!port)
+        return false;
+
+    printf("scenario %s: synthetic server listening on port %d\n", qPrintable(_scenario), port);
+    fflush(stdout);
+
+    if (_scenario == "migrate")
+    {
+        _secondServer = createServer();
+        if (!_secondServer->start())
+            return false;
+    }
+
+    if (_scenario == "logging")
+    {
+        _logDirectory = QDir::temp().filePath(QString("irc-chatter-scenario-%1").arg(QCoreApplication::applicationPid()));
+        if (!ChannelLogger::instance()->start(_logDirectory, ChannelLogger::Structured, ChannelLogger::SyncNever))
+            return false;
+    }
+
+    connectClient(port, _scenario == "tls");
+    _pollTimer->start();
+    QTimer::singleShot(SCENARIO_TIMEOUT, this, SLOT(timedOut()));
+    return true;
+}
+
+void ScenarioTest::check(bool condition, const QString &description)
+{
+    printf("  %s: %s\n", condition ? "ok" : "FAILED", qPrintable(description));
+    fflush(stdout);
+
+    if (!condition)
+        _failures++;
+}
+
+void ScenarioTest::finish()
+{
+    _pollTimer->stop();
+    printf("scenario %s: %s\n", qPrintable(_scenario), _failures ? "failed" : "passed");
+    fflush(stdout);
+
+    emit finished(_failures ? 1 : 0);
+    QCoreApplication::exit(_failures ? 1 : 0);
+}
+
+void ScenarioTest::timedOut()
+{
+    if (!_pollTimer->isActive())
+        return;
+
+    check(false, QString("got through step %1 in time").arg(_step));
+    finish();
+}
+
+void ScenarioTest::poll()
+{
+    if (_scenario == "reconnect")
+        pollReconnect();
+    else if (_scenario == "migrate")
+        pollMigrate();
+    else if (_scenario == "tls")
+        pollTls();
+    else if (_scenario == "logging")
+        pollLogging();
+    else if (_scenario == "playback")
+        pollPlayback();
+}
+
+void ScenarioTest::receiveError(const QString &error)
+{
+    _errors.append(error);
+}
+
+void ScenarioTest::receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines)
+{
+    _history[channelName] += lines;
+}
+
+void ScenarioTest::receiveMessage(const QString &channelName, const QString &userName, const QString &message)
+{
+    Q_UNUSED(userName)
+
+    // The synthetic traffic doesn't look like this, only the playback does
+    if (message.startsWith("history line "))
+        _livePlaybackLines++;
+    else if (channelName.startsWith("#load-") && message.startsWith("seq="))
+        _liveMessages++;
+}
+
+void ScenarioTest::channelTextAppended()
+{
+    qint64 now = _clock.elapsed();
+    if (_lastAppend >= 0)
+        _longestGap = qMax(_longestGap, now - _lastAppend);
+    _lastAppend = now;
+}
+
+void ScenarioTest::pollReconnect()
+{
+    ChannelModel *channel = _serverModel->channels()["#load-0"];
+
+    if (_step == 0)
+    {
+        // Waiting for the channels to have some scrollback
+        if (!_serverSettings->isConnected() || !channel || channel->channelText().isEmpty())
+            return;
+
+        _channelModels = _serverModel->channels().values();
+        _scrollback = channel->channelText();
+        _acceptCount = _server->acceptTimes().count();
+        _joinCount = _server->joinRequests().count();
+
+        printf("  dropping the connection and the next %d attempts\n", SCENARIO_DROPPED_ATTEMPTS);
+        fflush(stdout);
+        _server->setDropCount(SCENARIO_DROPPED_ATTEMPTS);
+        _dropTime = _server->elapsed();
+        _server->dropConnections();
+        _step = 1;
+    }
+    else if (_step == 1)
+    {
+        // Waiting for both channels to be joined again
+        if (!_serverSettings->isConnected() || _server->joinRequests().count() < _joinCount + 2)
+            return;
+
+        QList<qint64> attempts = _server->acceptTimes().mid(_acceptCount);
+        check(attempts.count() == SCENARIO_DROPPED_ATTEMPTS + 1,
+              QString("reconnected with %1 attempts").arg(attempts.count()));
+
+        if (attempts.count() == SCENARIO_DROPPED_ATTEMPTS + 1)
+        {
+            qint64 first = attempts[0] - _dropTime, second = attempts[1] - attempts[0], third = attempts[2] - attempts[1];
+            check(first < 1000, QString("first retry is immediate (%1 ms)").arg(first));
+            check(second > first && third > second, QString("the retries back off (%1 ms, then %2 ms)").arg(second).arg(third));
+        }
+
+        QStringList joins = _server->joinRequests().mid(_joinCount);
+        check(joins.contains("#load-0 secret"), "the channel is joined again with its key");
+        check(joins.contains("#load-1"), "the channel without a key is joined again");
+
+        QList<ChannelModel*> channelModels = _serverModel->channels().values();
+        check(channelModels.toSet() == _channelModels.toSet(), "the channel models are kept");
+        check(channel && channel->channelText().contains(_scrollback.right(200)), "the scrollback is kept");
+
+        finish();
+    }
+}
+
+void ScenarioTest::pollMigrate()
+{
+    ChannelModel *channel = _serverModel->channels()["#load-0"];
+
+    if (_step == 0)
+    {
+        if (!_serverSettings->isConnected() || !channel || channel->channelText().isEmpty())
+            return;
+
+        _channelModels = _serverModel->channels().values();
+        foreach (ChannelModel *channelModel, _channelModels)
+            connect(channelModel, SIGNAL(channelTextAppended(int,int,qint64)), this, SLOT(channelTextAppended()));
+        _clock.start();
+
+        // Like a network change: the new connection goes to another address
+        printf("  migrating the connection to port %d\n", _secondServer->serverPort());
+        fflush(stdout);
+        _serverSettings->setServerPort(_secondServer->serverPort());
+        _serverModel->migrateConnection(new CommuniIrcClient(_model, _serverSettings));
+        _step = 1;
+    }
+    else if (_step == 1)
+    {
+        _wasDisconnected = _wasDisconnected || !_serverSettings->isConnected();
+        // The old connection may only be closed once the new one has joined every channel
+        _closedTooEarly = _closedTooEarly || (!_server->sessionCount() && _secondServer->joinRequests().count() < 2);
+
+        if (_server->sessionCount() || _secondServer->sessionCount() != 1 || _serverModel->isMigrating())
+            return;
+
+        check(_serverModel->ircClient() != _client, "the server model uses the new client");
+        check(_secondServer->joinRequests().contains("#load-0 secret"), "the channel is joined on the new connection with its key");
+        check(!_closedTooEarly, "the old connection is closed after the new one joined");
+        check(!_wasDisconnected, "the server is connected all along");
+        check(_serverModel->channels().values().toSet() == _channelModels.toSet(), "the channel models are kept");
+        check(_longestGap <= SCENARIO_MAX_MIGRATION_GAP, QString("no gap in the channels (longest %1 ms)").arg(_longestGap));
+
+        finish();
+    }
+}
+
+void ScenarioTest::pollTls()
+{
+    if (_step == 0)
+    {
+        if (!_serverSettings->isConnected())
+            return;
+
+        _pinnedDigest = _serverSettings->sslPinnedDigest();
+        _firstHandshake = _client->tlsHandshakeTime();
+        check(!_pinnedDigest.isEmpty(), "the self-signed certificate is pinned");
+        check(_firstHandshake >= 0, QString("the first handshake is done (%1 ms)").arg(_firstHandshake));
+
+        _acceptCount = _server->acceptTimes().count();
+        _server->dropConnections();
+        _step = 1;
+    }
+    else if (_step == 1)
+    {
+        if (!_serverSettings->isConnected() || _server->acceptTimes().count() <= _acceptCount)
+            return;
+
+#if QT_VERSION >= 0x050400
+        check(!_serverSettings->sslSession().isEmpty(), "the previous session is offered on reconnect");
+#endif
+        printf("  full handshake: %d ms, handshake on reconnect: %d ms\n", _firstHandshake, _client->tlsHandshakeTime());
+        fflush(stdout);
+
+        // Another certificate, the pinned one has to be insisted on
+        printf("  changing the certificate of the server\n");
+        fflush(stdout);
+        if (!loadCertificate(_server, "scenario-other"))
+        {
+            check(false, "the other certificate is loaded");
+            finish();
+            return;
+        }
+
+        _errors.clear();
+        _dropTime = _clock.elapsed();
+        _server->dropConnections();
+        _step = 2;
+    }
+    else if (_step == 2)
+    {
+        if (_clock.elapsed() - _dropTime < SCENARIO_REJECT_WAIT)
+            return;
+
+        check(!_serverSettings->isConnected(), "the changed certificate is rejected");
+        check(_errors.count() > 0, QString("the rejection is reported (%1)").arg(_errors.value(0)));
+        check(_serverSettings->sslPinnedDigest() == _pinnedDigest, "the pinned certificate stays the same");
+
+        finish();
+    }
+}
+
+int ScenarioTest::countLogLines()
+{
+    int lines = 0;
+    QDirIterator iterator(_logDirectory, QDir::Files, QDirIterator::Subdirectories);
+
+    while (iterator.hasNext())
+    {
+        QFile file(iterator.next());
+        if (file.open(QIODevice::ReadOnly))
+            lines += file.readAll().count('\n');
+    }
+
+    return lines;
+}
+
+void ScenarioTest::pollLogging()
+{
+    if (_step == 0)
+    {
+        // Waiting for both channels, the burst goes to both of them
+        if (!_serverSettings->isConnected() || !_serverModel->channels().contains("#load-0") || !_serverModel->channels().contains("#load-1"))
+            return;
+
+        // Written out, so that only the lines of the burst are counted at the end
+        ChannelLogger::instance()->stop();
+        _loggedBefore = countLogLines();
+        ChannelLogger::instance()->start(_logDirectory, ChannelLogger::Structured, ChannelLogger::SyncNever);
+
+        foreach (ChannelModel *channelModel, _serverModel->channels().values())
+            connect(channelModel, SIGNAL(channelTextAppended(int,int,qint64)), this, SLOT(channelTextAppended()));
+
+        printf("  sending %d messages per second for %d ms\n", SCENARIO_LOG_RATE, SCENARIO_LOG_DURATION);
+        fflush(stdout);
+        _burstStart = _server->sentMessages();
+        _burstTime = _clock.elapsed();
+        _server->setMessageRate(SCENARIO_LOG_RATE);
+        _step = 1;
+    }
+    else if (_step == 1)
+    {
+        if (_clock.elapsed() - _burstTime < SCENARIO_LOG_DURATION)
+            return;
+
+        _server->setMessageRate(0);
+        _step = 2;
+    }
+    else if (_step == 2)
+    {
+        if (_server->backlog() || _clock.elapsed() - _lastAppend < SCENARIO_LOG_SETTLE)
+            return;
+
+        // The writer takes everything that is still pending before closing the files
+        ChannelLogger::instance()->stop();
+        qint64 duration = qMax((qint64)1, _lastAppend - _burstTime);
+        quint64 sent = _server->sentMessages() - _burstStart;
+        int logged = countLogLines() - _loggedBefore;
+        quint64 dropped = ChannelLogger::instance()->droppedRecords();
+
+        printf("  logged %d lines of %llu messages in %lld ms: %lld lines per second, in %s\n",
+               logged, (unsigned long long)sent, (long long)duration, (long long)(logged * 1000LL / duration), qPrintable(_logDirectory));
+        fflush(stdout);
+
+        check(dropped == 0, QString("no record is dropped (%1)").arg(dropped));
+        check((quint64)logged >= sent, QString("every message is logged (%1 of %2)").arg(logged).arg(sent));
+        check(logged * 1000LL / duration >= SCENARIO_LOG_RATE, QString("the logger keeps up with %1 lines per second").arg(SCENARIO_LOG_RATE));
+
+        finish();
+    }
+}
+
+void ScenarioTest::pollPlayback()
+{
+    // The live lines are tagged too, they have to keep coming as messages of the channels
+    if (_liveMessages < SCENARIO_LIVE_MESSAGES)
+        return;
+
+    check(true, QString("the tagged live messages are received (%1)").arg(_liveMessages));
+
+    if (!CommuniIrcClient::canNegotiateTags())
+    {
+        // This Communi would take the tags for the command, so the server must not send any
+        check(_server->taggedSessionCount() == 0, "no capability that brings tags is requested");
+        check(_history.isEmpty(), "nothing is played back without the tags");
+        finish();
+        return;
+    }
+
+    // Every batch is handed over when it ends
+    QStringList conversations = QStringList() << "#load-0" << "#load-1" << SyntheticIrcServer::playbackFriend();
+    foreach (const QString &conversation, conversations)
+    {
+        if (!_history.contains(conversation))
+            return;
+    }
+
+    check(_server->taggedSessionCount() == 1, "batch and server-time are negotiated");
+
+    foreach (const QString &conversation, conversations)
+    {
+        const QList<IrcHistoryLine> &lines = _history[conversation];
+        check(lines.count() == SCENARIO_PLAYBACK_LINES, QString("the history of %1 is played back (%2 lines)").arg(conversation).arg(lines.count()));
+
+        bool hasTimes = true;
+        for (int i = 0; i < lines.count(); i++)
+            hasTimes = hasTimes && lines[i].time == SyntheticIrcServer::playbackTime(i);
+        check(hasTimes, QString("the lines of %1 have the times of their @time tags").arg(conversation));
+    }
+
+    check(!_history.contains(_serverSettings->userNickname()), "our own messages in the query are played back into the query");
+    check(_livePlaybackLines == 0, QString("no line of the playback is taken for a live one (%1)").arg(_livePlaybackLines));
+
+    finish();
+}
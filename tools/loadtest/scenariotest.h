@@ -0,0 +1,123 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef SCENARIOTEST_H
+#define SCENARIOTEST_H
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "clients/abstractircclient.h"
+
+class QTimer;
+class AppSettings;
+class IrcModel;
+class ServerModel;
+class ServerSettings;
+class ChannelModel;
+class CommuniIrcClient;
+class SyntheticIrcServer;
+
+// Puts the real client through situations which are hard to get on a real
+// network, with SyntheticIrcServer on the loopback interface, and checks
+// how it copes. Every check is printed, the test fails if any of them did.
+// - reconnect: the server drops the connection, then the next attempts,
+//   the client has to back off and resume the channels in place
+// - migrate: the connection is moved to a second listener, like after a
+//   network change, the channels have to keep receiving meanwhile
+// - tls: the server has a self-signed certificate, which the client pins,
+//   resumes the session with on reconnect, and rejects once it changes
+// - logging: a burst of messages with the channels logged to disk, the
+//   logger has to write every one of them at the target rate
+// - playback: the server plays back history with @batch and @time tags,
+//   and tags the live lines with @time, the tags have to get through
+//   Communi to the playback of the client, and the live messages too.
+//   Built against a Communi which can't parse tags, the client must not
+//   negotiate the capabilities which bring them.
+
+class ScenarioTest : public QObject
+{
+    Q_OBJECT
+    AppSettings *_appSettings;
+    IrcModel *_model;
+    SyntheticIrcServer *_server;
+    // The listener the migrate scenario moves the connection to
+    SyntheticIrcServer *_secondServer;
+    ServerSettings *_serverSettings;
+    CommuniIrcClient *_client;
+    ServerModel *_serverModel;
+    QTimer *_pollTimer;
+    QString _scenario;
+    int _step;
+    int _failures;
+    // State saved before the connection was broken
+    QList<ChannelModel*> _channelModels;
+    QString _scrollback;
+    int _acceptCount, _joinCount;
+    qint64 _dropTime;
+    QElapsedTimer _clock;
+    qint64 _lastAppend, _longestGap;
+    bool _wasDisconnected, _closedTooEarly;
+    QString _certificateDirectory;
+    QStringList _errors;
+    QByteArray _pinnedDigest;
+    int _firstHandshake;
+    QString _logDirectory;
+    quint64 _burstStart;
+    qint64 _burstTime;
+    int _loggedBefore;
+    QHash<QString, QList<IrcHistoryLine> > _history;
+    int _livePlaybackLines, _liveMessages;
+
+    SyntheticIrcServer *createServer();
+    void connectClient(int port, bool ssl);
+    bool loadCertificate(SyntheticIrcServer *server, const QString &name);
+    void check(bool condition, const QString &description);
+    void finish();
+    void pollReconnect();
+    void pollMigrate();
+    void pollTls();
+    void pollLogging();
+    void pollPlayback();
+    int countLogLines();
+
+public:
+    explicit ScenarioTest(QObject *parent, AppSettings *appSettings, IrcModel *model);
+
+    static QStringList scenarios();
+    // Where the certificates of the tls scenario are
+    void setCertificateDirectory(const QString &path) { _certificateDirectory = path; }
+    bool start(const QString &scenario);
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void poll();
+    void timedOut();
+    void channelTextAppended();
+    void receiveError(const QString &error);
+    void receiveHistory(const QString &channelName, const QList<IrcHistoryLine> &lines);
+    void receiveMessage(const QString &channelName, const QString &userName, const QString &message);
+
+};
+
+#endif // SCENARIOTEST_H
@@ -0,0 +1,561 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QTimer>
+#include <QtNetwork/QSslSocket>
+
+#include "tools/loadtest/syntheticircserver.h"
+
+#define SERVER_NAME "irc.loadtest.invalid"
+// Interval in which the load is generated
+#define LOAD_TICK 10
+// Time for which the users of a netsplit are away
+#define NETSPLIT_DURATION 3000
+// Length of the NAMES and LIST reply lines, below the IRC limit
+#define REPLY_LINE_LENGTH 400
+// The playback is from the first minute of this day, in UTC
+#define PLAYBACK_DAY "2020-01-01"
+#define PLAYBACK_FRIEND "playback-friend"
+
+static const char *fillerWords[] = { "the", "build", "is", "broken", "again", "after", "that", "merge", "of", "the",
+                                     "qml", "branch", "can", "someone", "look", "at", "socket", "thread", "model", "please" };
+
+SyntheticIrcServer::LoadProfile::LoadProfile() :
+    channels(10),
+    users(500),
+    messageRate(100),
+    churnRate(2),
+    netsplitInterval(0),
+    netsplitPercentage(30),
+    listSize(2000)
+{
+}
+
+SyntheticIrcServer::SyntheticIrcServer(QObject *parent) :
+    QTcpServer(parent),
+    _loadTimer(new QTimer(this)),
+    _lastTick(0),
+    _lastNetsplit(0),
+    _netsplitEnd(0),
+    _messageBudget(0),
+    _churnBudget(0),
+    _sequence(0),
+    _sentMessages(0),
+    _dropCount(0),
+    _playbackLength(0),
+    _nextBatch(0)
+{
+    _clock.start();
+    _loadTimer->setInterval(LOAD_TICK);
+    connect(_loadTimer, SIGNAL(timeout()), this, SLOT(generateLoad()));
+    setupUsers();
+}
+
+void SyntheticIrcServer::setProfile(const LoadProfile &profile)
+{
+    _profile = profile;
+    setupUsers();
+}
+
+void SyntheticIrcServer::setCertificate(const QSslCertificate &certificate, const QSslKey &privateKey)
+{
+    _certificate = certificate;
+    _privateKey = privateKey;
+}
+
+void SyntheticIrcServer::setupUsers()
+{
+    _users.clear();
+    _channelUsers.clear();
+    _splitUsers.clear();
+
+    for (int i = 0; i < _profile.users; i++)
+        _users.append(QString("user%1").arg(i, 4, 10, QChar('0')));
+
+    for (int i = 0; i < _profile.channels; i++)
+        _channelUsers.insert(QString("#load-%1").arg(i), _users);
+}
+
+int SyntheticIrcServer::start(int port)
+{
+    if (!listen(QHostAddress::LocalHost, port))
+    {
+        qWarning() << Q_FUNC_INFO << "could not listen:" << errorString();
+        return 0;
+    }
+
+    _lastTick = _clock.elapsed();
+    _lastNetsplit = _lastTick;
+    _loadTimer->start();
+    return serverPort();
+}
+
+void SyntheticIrcServer::setMessageRate(int messageRate)
+{
+    _profile.messageRate = messageRate;
+}
+
+void SyntheticIrcServer::dropConnections()
+{
+    foreach (QTcpSocket *socket, _sessions.keys())
+    {
+        _sessions.remove(socket);
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+}
+
+qint64 SyntheticIrcServer::backlog() const
+{
+    qint64 result = 0;
+    foreach (QTcpSocket *socket, _sessions.keys())
+    {
+        result += socket->bytesToWrite();
+        if (QSslSocket *sslSocket = qobject_cast<QSslSocket*>(socket))
+            result += sslSocket->encryptedBytesToWrite();
+    }
+    return result;
+}
+
+#if QT_VERSION >= 0x050000
+void SyntheticIrcServer::incomingConnection(qintptr handle)
+#else
+void SyntheticIrcServer::incomingConnection(int handle)
+#endif
+{
+    QTcpSocket *socket;
+    _acceptTimes.append(_clock.elapsed());
+
+    if (_dropCount > 0)
+    {
+        _dropCount--;
+        socket = new QTcpSocket(this);
+        socket->setSocketDescriptor(handle);
+        socket->abort();
+        socket->deleteLater();
+        return;
+    }
+
+    if (!_certificate.isNull())
+    {
+        QSslSocket *sslSocket = new QSslSocket(this);
+        sslSocket->setSocketDescriptor(handle);
+        sslSocket->setLocalCertificate(_certificate);
+        sslSocket->setPrivateKey(_privateKey);
+        sslSocket->startServerEncryption();
+        socket = sslSocket;
+    }
+    else
+    {
+        socket = new QTcpSocket(this);
+        socket->setSocketDescriptor(handle);
+    }
+
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    _sessions.insert(socket, Session());
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+}
+
+void SyntheticIrcServer::clientDisconnected()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    _sessions.remove(socket);
+    socket->deleteLater();
+}
+
+void SyntheticIrcServer::readClient()
+{
+    QTcpSocket *socket = static_cast<QTcpSocket*>(sender());
+    if (!_sessions.contains(socket))
+        return;
+
+    _sessions[socket].buffer += socket->readAll();
+
+    int end;
+    while ((end = _sessions[socket].buffer.indexOf('\n')) != -1)
+    {
+        QByteArray line = _sessions[socket].buffer.left(end);
+        _sessions[socket].buffer.remove(0, end + 1);
+        if (line.endsWith('\r'))
+            line.chop(1);
+        if (line.length())
+            processLine(socket, QString::fromUtf8(line));
+
+        // The client may have quit
+        if (!_sessions.contains(socket))
+            return;
+    }
+}
+
+static QByteArray timeTag()
+{
+    return "@time=" + QDateTime::currentDateTimeUtc().toString("yyyy-MM-dd'T'HH:mm:ss.zzz'Z'").toLatin1() + " ";
+}
+
+void SyntheticIrcServer::sendLine(QTcpSocket *socket, const QString &line)
+{
+    // Like a real server, every line gets a time once server-time was acknowledged
+    QHash<QTcpSocket*, Session>::const_iterator session = _sessions.constFind(socket);
+    if (session != _sessions.constEnd() && session.value().wantsPlayback && !line.startsWith('@'))
+        socket->write(timeTag() + line.toUtf8() + "\r\n");
+    else
+        socket->write(line.toUtf8() + "\r\n");
+}
+
+QString SyntheticIrcServer::userMask(const QString &user) const
+{
+    return user + "!~" + user + "@" + user + ".loadtest.invalid";
+}
+
+void SyntheticIrcServer::processLine(QTcpSocket *socket, const QString &line)
+{
+    Session &session = _sessions[socket];
+    QString trailing;
+    int trailingStart = line.indexOf(" :");
+    if (trailingStart != -1)
+        trailing = line.mid(trailingStart + 2);
+
+    QStringList parameters = line.left(trailingStart).split(' ', QString::SkipEmptyParts);
+    if (trailingStart != -1)
+        parameters.append(trailing);
+    if (parameters.isEmpty())
+        return;
+
+    QString command = parameters.takeFirst().toUpper();
+
+    if (command == "NICK" && parameters.count())
+    {
+        session.nick = parameters[0];
+    }
+    else if (command == "USER" && !session.isRegistered && session.nick.length())
+    {
+        // Like a real server, the registration waits for the end of the capability negotiation
+        session.hasUser = true;
+        if (!session.isNegotiating)
+            registerSession(socket);
+    }
+    else if (command == "PING")
+    {
+        sendLine(socket, ":" SERVER_NAME " PONG " SERVER_NAME " :" + parameters.value(0));
+    }
+    else if (command == "CAP" && parameters.value(0) == "LS")
+    {
+        session.isNegotiating = !session.isRegistered;
+        sendLine(socket, ":" SERVER_NAME " CAP * LS :" + QString(_playbackLength ? "batch server-time" : ""));
+    }
+    else if (command == "CAP" && parameters.value(0) == "REQ")
+    {
+        QStringList capabilities = parameters.value(1).split(' ', QString::SkipEmptyParts);
+        bool isAcked = _playbackLength && capabilities.contains("batch") && capabilities.contains("server-time");
+        session.wantsPlayback = session.wantsPlayback || isAcked;
+        sendLine(socket, ":" SERVER_NAME " CAP * " + QString(isAcked ? "ACK" : "NAK") + " :" + parameters.value(1));
+    }
+    else if (command == "CAP" && parameters.value(0) == "END")
+    {
+        session.isNegotiating = false;
+        if (session.hasUser && !session.isRegistered)
+            registerSession(socket);
+    }
+    else if (command == "JOIN" && parameters.count())
+    {
+        QStringList channelNames = parameters[0].split(','), channelKeys = parameters.value(1).split(',');
+        for (int i = 0; i < channelNames.count(); i++)
+        {
+            const QString &channelName = channelNames[i];
+            if (!_channelUsers.contains(channelName))
+                _channelUsers.insert(channelName, QStringList());
+
+            _joinRequests.append(channelKeys.value(i).length() ? (channelName + ' ' + channelKeys[i]) : channelName);
+            session.channels.insert(channelName);
+            sendLine(socket, ":" + userMask(session.nick) + " JOIN " + channelName);
+            sendLine(socket, ":" SERVER_NAME " 332 " + session.nick + " " + channelName + " :Synthetic load in " + channelName);
+            sendNames(socket, channelName);
+
+            if (session.wantsPlayback)
+            {
+                QStringList lines;
+                for (int j = 0; j < _playbackLength; j++)
+                {
+                    lines.append(":" + userMask(_users.value(j, "user0000")) + " PRIVMSG " + channelName + " :history line " + QString::number(j));
+                }
+                sendPlayback(socket, "chathistory", channelName, lines);
+            }
+        }
+    }
+    else if (command == "PART" && parameters.count())
+    {
+        foreach (const QString &channelName, parameters[0].split(','))
+        {
+            session.channels.remove(channelName);
+            sendLine(socket, ":" + userMask(session.nick) + " PART " + channelName + " :" + parameters.value(1));
+        }
+    }
+    else if (command == "NAMES" && parameters.count())
+    {
+        sendNames(socket, parameters[0]);
+    }
+    else if (command == "LIST")
+    {
+        sendList(socket);
+    }
+    else if (command == "QUIT")
+    {
+        sendLine(socket, "ERROR :Closing link");
+        _sessions.remove(socket);
+        socket->disconnectFromHost();
+    }
+}
+
+void SyntheticIrcServer::registerSession(QTcpSocket *socket)
+{
+    Session &session = _sessions[socket];
+    session.isRegistered = true;
+
+    QString prefix = ":" SERVER_NAME " ";
+    sendLine(socket, prefix + "001 " + session.nick + " :Welcome to the load test network " + session.nick);
+    sendLine(socket, prefix + "002 " + session.nick + " :Your host is " SERVER_NAME);
+    sendLine(socket, prefix + "003 " + session.nick + " :This server was created just now");
+    sendLine(socket, prefix + "004 " + session.nick + " " SERVER_NAME " loadtest-1.0 iow ovntkl");
+    sendLine(socket, prefix + "005 " + session.nick + " CHANTYPES=# PREFIX=(ov)@+ NETWORK=LoadTest :are supported by this server");
+    sendLine(socket, prefix + "375 " + session.nick + " :- Message of the day -");
+    sendLine(socket, prefix + "372 " + session.nick + " :- Synthetic load, nothing here is real.");
+    sendLine(socket, prefix + "376 " + session.nick + " :End of /MOTD command.");
+
+    // A query as a bouncer plays it back, with what we sent in it too
+    if (session.wantsPlayback)
+    {
+        QStringList lines;
+        for (int i = 0; i < _playbackLength; i++)
+        {
+            if (i % 2)
+                lines.append(":" + userMask(PLAYBACK_FRIEND) + " PRIVMSG " + session.nick + " :history line " + QString::number(i));
+            else
+                lines.append(":" + userMask(session.nick) + " PRIVMSG " PLAYBACK_FRIEND " :history line " + QString::number(i));
+        }
+        sendPlayback(socket, "znc.in/playback", QString(), lines);
+    }
+}
+
+void SyntheticIrcServer::sendPlayback(QTcpSocket *socket, const QString &type, const QString &target, const QStringList &lines)
+{
+    QString batch = QString("playback%1").arg(_nextBatch++);
+    sendLine(socket, ":" SERVER_NAME " BATCH +" + batch + " " + type + (target.length() ? " " + target : QString()));
+
+    for (int i = 0; i < lines.count(); i++)
+    {
+        QString time = QString(PLAYBACK_DAY "T00:00:%1.250Z").arg(i % 60, 2, 10, QChar('0'));
+        sendLine(socket, "@batch=" + batch + ";time=" + time + " " + lines[i]);
+    }
+
+    sendLine(socket, ":" SERVER_NAME " BATCH -" + batch);
+}
+
+int SyntheticIrcServer::taggedSessionCount() const
+{
+    int count = 0;
+    foreach (const Session &session, _sessions)
+        count += session.wantsPlayback ? 1 : 0;
+    return count;
+}
+
+QString SyntheticIrcServer::playbackFriend()
+{
+    return PLAYBACK_FRIEND;
+}
+
+qint64 SyntheticIrcServer::playbackTime(int index)
+{
+    return QDateTime(QDate::fromString(PLAYBACK_DAY, Qt::ISODate), QTime(0, 0, index % 60, 250), Qt::UTC).toMSecsSinceEpoch();
+}
+
+void SyntheticIrcServer::sendNames(QTcpSocket *socket, const QString &channelName)
+{
+    const Session &session = _sessions[socket];
+    QString prefix = ":" SERVER_NAME " 353 " + session.nick + " = " + channelName + " :";
+    QString names = session.nick;
+
+    int i = 0;
+    foreach (const QString &user, _channelUsers.value(channelName))
+    {
+        if (names.length() > REPLY_LINE_LENGTH)
+        {
+            sendLine(socket, prefix + names);
+            names.clear();
+        }
+
+        if (names.length())
+            names += ' ';
+        // Some operators and voiced users, like in a real channel
+        names += (i % 20 == 0 ? "@" : (i % 7 == 0 ? "+" : "")) + user;
+        i++;
+    }
+
+    sendLine(socket, prefix + names);
+    sendLine(socket, ":" SERVER_NAME " 366 " + session.nick + " " + channelName + " :End of /NAMES list.");
+}
+
+void SyntheticIrcServer::sendList(QTcpSocket *socket)
+{
+    const QString &nick = _sessions[socket].nick;
+    sendLine(socket, ":" SERVER_NAME " 321 " + nick + " Channel :Users Name");
+
+    for (int i = 0; i < _profile.listSize; i++)
+        sendLine(socket, QString(":" SERVER_NAME " 322 %1 #list-%2 %3 :Topic of the channel number %2").arg(nick).arg(i).arg(qrand() % 1000));
+
+    sendLine(socket, ":" SERVER_NAME " 323 " + nick + " :End of /LIST");
+}
+
+void SyntheticIrcServer::broadcast(const QString &channelName, const QString &line)
+{
+    QByteArray data = line.toUtf8() + "\r\n", taggedData;
+
+    for (QHash<QTcpSocket*, Session>::const_iterator i = _sessions.constBegin(); i != _sessions.constEnd(); ++i)
+    {
+        if (!i.value().channels.contains(channelName))
+            continue;
+
+        if (i.value().wantsPlayback)
+        {
+            if (taggedData.isEmpty())
+                taggedData = timeTag() + data;
+            i.key()->write(taggedData);
+        }
+        else
+        {
+            i.key()->write(data);
+        }
+    }
+}
+
+void SyntheticIrcServer::generateLoad()
+{
+    qint64 now = _clock.elapsed();
+    double seconds = (now - _lastTick) / 1000.0;
+    _lastTick = now;
+
+    QSet<QString> joinedChannels;
+    foreach (const Session &session, _sessions)
+        joinedChannels.unite(session.channels);
+
+    if (joinedChannels.isEmpty())
+        return;
+
+    QStringList channels = joinedChannels.toList();
+
+    _messageBudget += _profile.messageRate * seconds;
+    while (_messageBudget >= 1)
+    {
+        generateMessage(channels);
+        _messageBudget -= 1;
+    }
+
+    _churnBudget += _profile.churnRate * seconds;
+    while (_churnBudget >= 1)
+    {
+        generateChurn(channels);
+        _churnBudget -= 1;
+    }
+
+    if (_splitUsers.length() && now >= _netsplitEnd)
+        endNetsplit();
+    else if (_profile.netsplitInterval > 0 && _splitUsers.isEmpty() && now - _lastNetsplit >= _profile.netsplitInterval * 1000)
+        startNetsplit();
+}
+
+void SyntheticIrcServer::generateMessage(const QStringList &channels)
+{
+    QString channelName = channels[qrand() % channels.count()];
+    const QStringList &users = _channelUsers[channelName];
+    if (users.isEmpty())
+        return;
+
+    QString text = QString("seq=%1 sent=%2").arg(++_sequence).arg(QDateTime::currentMSecsSinceEpoch());
+    int words = 3 + qrand() % 20;
+    for (int i = 0; i < words; i++)
+        text += QString(" ") + fillerWords[qrand() % (sizeof(fillerWords) / sizeof(fillerWords[0]))];
+
+    broadcast(channelName, ":" + userMask(users[qrand() % users.count()]) + " PRIVMSG " + channelName + " :" + text);
+    _sentMessages++;
+}
+
+void SyntheticIrcServer::generateChurn(const QStringList &channels)
+{
+    QString channelName = channels[qrand() % channels.count()];
+    QString user = _users.value(qrand() % qMax(1, _users.count()));
+    if (user.isEmpty() || _splitUsers.contains(user))
+        return;
+
+    QStringList &users = _channelUsers[channelName];
+    if (users.contains(user))
+    {
+        users.removeOne(user);
+        broadcast(channelName, ":" + userMask(user) + " PART " + channelName + " :Leaving");
+    }
+    else
+    {
+        users.append(user);
+        broadcast(channelName, ":" + userMask(user) + " JOIN " + channelName);
+    }
+}
+
+void SyntheticIrcServer::startNetsplit()
+{
+    int count = _users.count() * _profile.netsplitPercentage / 100;
+    _splitUsers = _users.mid(qrand() % qMax(1, _users.count() - count), count);
+    _netsplitEnd = _clock.elapsed() + NETSPLIT_DURATION;
+
+    foreach (const QString &user, _splitUsers)
+    {
+        // Every client sees the quit once, if it shares a channel with the user
+        for (QHash<QTcpSocket*, Session>::const_iterator i = _sessions.constBegin(); i != _sessions.constEnd(); ++i)
+        {
+            foreach (const QString &channelName, i.value().channels)
+            {
+                if (_channelUsers[channelName].contains(user))
+                {
+                    sendLine(i.key(), ":" + userMask(user) + " QUIT :" SERVER_NAME " hub.loadtest.invalid");
+                    break;
+                }
+            }
+        }
+    }
+
+    foreach (const QString &channelName, _channelUsers.keys())
+    {
+        foreach (const QString &user, _splitUsers)
+            _channelUsers[channelName].removeOne(user);
+    }
+}
+
+void SyntheticIrcServer::endNetsplit()
+{
+    foreach (const QString &channelName, _channelUsers.keys())
+    {
+        foreach (const QString &user, _splitUsers)
+        {
+            _channelUsers[channelName].append(user);
+            broadcast(channelName, ":" + userMask(user) + " JOIN " + channelName);
+        }
+    }
+
+    _splitUsers.clear();
+    _lastNetsplit = _clock.elapsed();
+}
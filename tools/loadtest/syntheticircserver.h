@@ -0,0 +1,161 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+#ifndef SYNTHETICIRCSERVER_H
+#define SYNTHETICIRCSERVER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QElapsedTimer>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QSslCertificate>
+#include <QtNetwork/QSslKey>
+
+class QTimer;
+class QTcpSocket;
+
+// A small IRC server for load testing the client over loopback. It does
+// just enough of the protocol for the client to register and join, and
+// generates synthetic traffic in the channels which the client joined:
+// messages at a given rate, users joining and parting, netsplits, and
+// large NAMES and LIST replies. Every generated message carries its
+// sequence number and the time it was sent, so the receiving end can tell
+// how far behind it is. With a certificate and key, it speaks TLS.
+// For the scenario tests it can also drop connections, and it records
+// when connections were accepted and which channels were joined. With a
+// playback length, it offers the batch and server-time capabilities, and
+// plays back history in batches with @batch and @time tags: the history
+// of every channel that is joined, and a query with our own messages.
+// Once server-time is acknowledged, the live lines get @time tags too.
+
+class SyntheticIrcServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    struct LoadProfile
+    {
+        int channels;
+        int users;
+        // Channel messages per second, over all channels
+        int messageRate;
+        // Joins and parts per second, over all channels
+        int churnRate;
+        // Seconds between two netsplits, 0 means none
+        int netsplitInterval;
+        // Percentage of the users who quit in a netsplit
+        int netsplitPercentage;
+        // Number of channels in the LIST reply
+        int listSize;
+
+        LoadProfile();
+    };
+
+private:
+    struct Session
+    {
+        QByteArray buffer;
+        QString nick;
+        QSet<QString> channels;
+        bool isRegistered, hasUser, isNegotiating, wantsPlayback;
+
+        Session() : isRegistered(false), hasUser(false), isNegotiating(false), wantsPlayback(false) { }
+    };
+
+    LoadProfile _profile;
+    QSslCertificate _certificate;
+    QSslKey _privateKey;
+    QTimer *_loadTimer;
+    QElapsedTimer _clock;
+    QHash<QTcpSocket*, Session> _sessions;
+    QStringList _users;
+    // The users of every channel who are currently in it
+    QHash<QString, QStringList> _channelUsers;
+    QStringList _splitUsers;
+    qint64 _lastTick, _lastNetsplit, _netsplitEnd;
+    double _messageBudget, _churnBudget;
+    quint64 _sequence;
+    quint64 _sentMessages;
+    int _dropCount;
+    int _playbackLength;
+    int _nextBatch;
+    QList<qint64> _acceptTimes;
+    QStringList _joinRequests;
+
+    void setupUsers();
+    void processLine(QTcpSocket *socket, const QString &line);
+    void sendLine(QTcpSocket *socket, const QString &line);
+    void registerSession(QTcpSocket *socket);
+    void sendPlayback(QTcpSocket *socket, const QString &type, const QString &target, const QStringList &lines);
+    void broadcast(const QString &channelName, const QString &line);
+    void sendNames(QTcpSocket *socket, const QString &channelName);
+    void sendList(QTcpSocket *socket);
+    void generateMessage(const QStringList &channels);
+    void generateChurn(const QStringList &channels);
+    void startNetsplit();
+    void endNetsplit();
+    QString userMask(const QString &user) const;
+
+protected:
+#if QT_VERSION >= 0x050000
+    void incomingConnection(qintptr handle);
+#else
+    void incomingConnection(int handle);
+#endif
+
+public:
+    explicit SyntheticIrcServer(QObject *parent = 0);
+    void setProfile(const LoadProfile &profile);
+    const LoadProfile &profile() const { return _profile; }
+    // Enables TLS for the connections accepted from now on
+    void setCertificate(const QSslCertificate &certificate, const QSslKey &privateKey);
+    quint64 sentMessages() const { return _sentMessages; }
+    // Bytes written but not yet taken by the client, over every connection
+    qint64 backlog() const;
+    int sessionCount() const { return _sessions.count(); }
+    qint64 elapsed() const { return _clock.elapsed(); }
+    // Time of every accepted connection, in milliseconds since the server was created
+    const QList<qint64> &acceptTimes() const { return _acceptTimes; }
+    // Every channel joined by the clients, with its key if there was one
+    const QStringList &joinRequests() const { return _joinRequests; }
+    // The next count connections are closed as soon as they are accepted
+    void setDropCount(int count) { _dropCount = count; }
+    // Lines of history played back for every channel, 0 means no playback
+    void setPlaybackLength(int lines) { _playbackLength = lines; }
+    // Connections which acknowledged batch and server-time, and get tagged lines
+    int taggedSessionCount() const;
+    // The other side of the query that is played back
+    static QString playbackFriend();
+    // Time in the @time tag of the line with the given index in a playback, in milliseconds since the epoch
+    static qint64 playbackTime(int index);
+
+public slots:
+    // Listens on the loopback interface, returns the port or 0 on failure
+    int start(int port = 0);
+    void setMessageRate(int messageRate);
+    // Closes every connection without a word, like a server that went away
+    void dropConnections();
+
+private slots:
+    void readClient();
+    void clientDisconnected();
+    void generateLoad();
+
+};
+
+#endif // SYNTHETICIRCSERVER_H
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Measures how long connecting and registering takes with latency injected
+# on the loopback interface.
+# Needs a local IRC server (eg. ngircd) listening on 127.0.0.1, configured in
+# IRC Chatter as the only server to connect to. Must be run as root for tc.
+#
+# Usage: registration-latency.sh [path to irc-chatter] [round trip delays in ms...]
+
+BINARY=${1:-./irc-chatter}
+[ $# -gt 0 ] && shift
+DELAYS=${*:-"0 50 150 300"}
+
+trap 'tc qdisc del dev lo root 2>/dev/null' EXIT
+
+for DELAY in $DELAYS; do
+    tc qdisc del dev lo root 2>/dev/null
+    # Every packet crosses lo twice per round trip
+    if [ "$DELAY" -gt 0 ]; then
+        tc qdisc add dev lo root netem delay $((DELAY / 2))ms
+    fi
+
+    echo "round trip delay: ${DELAY} ms"
+    "$BINARY" --startup-benchmark 2>&1 | grep -E '^time-to-first-connect|registered with'
+done
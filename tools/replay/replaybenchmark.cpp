@@ -0,0 +1,523 @@
+// This file is part of IRC Chatter, the first IRC Client for MeeGo.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+// Copyright (C) 2012, Timur Kristóf <venemo@fedoraproject.org>
+
+// Replays recorded IRC traffic through the models, without the UI, and
+// reports how fast the message pipeline is. Usage:
+//   irc-chatter-replay [--iterations=N] [--realtime] [--decode] trace.irc|capture.ircap...
+// Every line of a trace is a raw line as it was received from the server.
+// The lines are written to a loopback connection of a real CommuniIrcClient,
+// so they go through the parser of Communi and the handlers of the client,
+// as they would on a real connection.
+// Captures written with --capture-traffic are replayed one server at a time,
+// as fast as possible or, with --realtime, at the speed they were captured.
+// The event loop stalls are reported too; as fast as possible the event loop
+// only runs between batches of lines, so they are telling with --realtime.
+// With --decode only the decoding of the raw lines is measured, detecting the
+// encoding of every line against the fast path of EncodingDetector, and how
+// many reads of the trace would need more than one legacy encoding.
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDataStream>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMap>
+#include <QtCore/QtEndian>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtCore/QtAlgorithms>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#if QT_VERSION >= 0x050000
+#include <QtGui/QGuiApplication>
+#else
+#include <QtGui/QApplication>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include "clients/communiircclient.h"
+#include "clients/encodingdetector.h"
+#include "clients/trafficcapture.h"
+#include "helpers/stallwatchdog.h"
+#include "model/ircmodel.h"
+#include "model/servermodel.h"
+#include "model/settings/appsettings.h"
+#include "model/settings/serversettings.h"
+
+#if __cplusplus >= 201103L
+#define REPLAY_NOTHROW noexcept
+#else
+#define REPLAY_NOTHROW throw()
+#endif
+
+// Lines processed between two rounds of the event loop, which is not included in the latencies
+#define REPLAY_EVENT_LOOP_INTERVAL 100
+// Time given to the client to connect, and to read a line that was written to it
+#define REPLAY_SOCKET_TIMEOUT 5000
+// Size of the reads that the encoding is chosen for in --decode, a typical read from a busy socket
+#define REPLAY_DECODE_CHUNK_SIZE 4096
+
+// Every allocation of the process is counted, this binary is only for benchmarking
+static QAtomicInt _allocations;
+
+#if defined(__GLIBC__)
+// QString, QByteArray and the containers allocate with malloc, not with operator new, so the
+// functions of the C library are interposed: the libraries call these instead, operator new too.
+#define REPLAY_ALLOCATIONS_LABEL "allocations/message"
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) REPLAY_NOTHROW
+{
+    _allocations.ref();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) REPLAY_NOTHROW
+{
+    _allocations.ref();
+    return __libc_calloc(count, size);
+}
+
+// A realloc that grows a block in place is counted as well, Communi and Qt grow their buffers this way
+void *realloc(void *p, size_t size) REPLAY_NOTHROW
+{
+    _allocations.ref();
+    return __libc_realloc(p, size);
+}
+
+}
+#else
+// Without glibc only operator new is counted, which misses what Qt allocates with malloc
+#define REPLAY_ALLOCATIONS_LABEL "operator new calls/message"
+
+void *operator new(size_t size)
+{
+    _allocations.ref();
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    _allocations.ref();
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) REPLAY_NOTHROW
+{
+    free(p);
+}
+
+void operator delete[](void *p) REPLAY_NOTHROW
+{
+    free(p);
+}
+#endif
+
+static int allocations()
+{
+    return _allocations.fetchAndAddRelaxed(0);
+}
+
+static long peakRssKilobytes()
+{
+#if defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+    return -1;
+}
+
+static qint64 percentile(const QVector<qint64> &sorted, int percent)
+{
+    if (sorted.isEmpty())
+        return 0;
+
+    int index = qMin(sorted.count() - 1, sorted.count() * percent / 100);
+    return sorted[index];
+}
+
+struct ReplayTrace
+{
+    QString name;
+    // The lines as they were received, without CR-LF
+    QList<QByteArray> rawLines;
+    // Microseconds since the capture started, empty for text traces
+    QVector<qint64> timestamps;
+};
+
+static QList<ReplayTrace> readCapture(QFile &file)
+{
+    QDataStream stream(&file);
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (version != TRAFFICCAPTURE_VERSION)
+    {
+        fprintf(stderr, "unsupported capture version %d in %s\n", version, qPrintable(file.fileName()));
+        return QList<ReplayTrace>();
+    }
+
+    QMap<int, ReplayTrace> traces;
+    while (!stream.atEnd())
+    {
+        quint8 type;
+        quint16 serverId;
+        quint64 timestamp;
+        QByteArray data;
+        stream >> type >> serverId >> timestamp >> data;
+        if (stream.status() != QDataStream::Ok)
+        {
+            // The end of a capture that was not stopped properly may be cut off
+            fprintf(stderr, "capture %s is truncated\n", qPrintable(file.fileName()));
+            break;
+        }
+
+        ReplayTrace &trace = traces[serverId];
+        if (type == TrafficCapture::ServerRecord)
+        {
+            trace.name = QFileInfo(file.fileName()).fileName() + ":" + QString::fromUtf8(data);
+        }
+        else if (type == TrafficCapture::InboundRecord)
+        {
+            trace.rawLines.append(data);
+            trace.timestamps.append(timestamp);
+        }
+    }
+
+    QList<ReplayTrace> result;
+    foreach (int serverId, traces.keys())
+    {
+        ReplayTrace &trace = traces[serverId];
+        if (trace.name.isEmpty())
+            trace.name = QFileInfo(file.fileName()).fileName() + ":" + QString::number(serverId);
+        if (trace.rawLines.count())
+            result.append(trace);
+    }
+    return result;
+}
+
+static QList<ReplayTrace> readTrace(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QList<ReplayTrace>();
+
+    QByteArray magic = file.peek(4);
+    if (magic.length() == 4 && qFromBigEndian<quint32>((const uchar*) magic.constData()) == TRAFFICCAPTURE_MAGIC)
+        return readCapture(file);
+
+    ReplayTrace trace;
+    trace.name = QFileInfo(path).fileName();
+    while (!file.atEnd())
+    {
+        QByteArray line = file.readLine();
+        while (line.endsWith('\n') || line.endsWith('\r'))
+            line.chop(1);
+        if (line.length())
+            trace.rawLines.append(line);
+    }
+
+    QList<ReplayTrace> result;
+    if (trace.rawLines.count())
+        result.append(trace);
+    return result;
+}
+
+// Runs the event loop until the given time of the replay comes
+static void waitUntil(const QElapsedTimer &clock, qint64 usecs)
+{
+    qint64 remaining = usecs / 1000 - clock.elapsed();
+    if (remaining <= 0)
+        return;
+
+    QEventLoop loop;
+    QTimer::singleShot(remaining, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+// Answers the lag probes of the client, so that it doesn't give up on a long replay
+static void answerPings(QTcpSocket *socket)
+{
+    while (socket->canReadLine())
+    {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.startsWith("PING "))
+            socket->write("PONG" + line.mid(4) + "\r\n");
+    }
+}
+
+static void replayTrace(QCoreApplication *app, IrcModel *model, AppSettings *appSettings, const ReplayTrace &trace, int iterations, bool realtime)
+{
+    const QList<QByteArray> &lines = trace.rawLines;
+    realtime = realtime && trace.timestamps.count();
+
+    QVector<qint64> latencies;
+    latencies.reserve(lines.count() * iterations);
+    quint64 received = 0;
+    int timeouts = 0;
+    qint64 totalNsecs = 0;
+    int allocated = 0;
+    StallWatchdog::instance()->reset();
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        QTcpServer listener;
+        if (!listener.listen(QHostAddress::LocalHost))
+        {
+            fprintf(stderr, "could not listen on the loopback interface: %s\n", qPrintable(listener.errorString()));
+            return;
+        }
+
+        ServerSettings *serverSettings = new ServerSettings(appSettings, "127.0.0.1", listener.serverPort());
+        serverSettings->setUserNickname("replay");
+        CommuniIrcClient *client = new CommuniIrcClient(model, serverSettings);
+        model->attachServer(serverSettings, client);
+        client->connectToServer();
+
+        QTcpSocket *server = listener.waitForNewConnection(REPLAY_SOCKET_TIMEOUT) ? listener.nextPendingConnection() : 0;
+        if (!server || !client->socket()->waitForConnected(REPLAY_SOCKET_TIMEOUT))
+        {
+            fprintf(stderr, "the client could not connect to the replay server\n");
+            return;
+        }
+
+        // Registration and CAP negotiation are written by the client, they are not part of the replay
+        app->processEvents();
+
+        int startAllocations = allocations();
+        quint64 startLines = client->linesReceived();
+        QElapsedTimer total, line;
+        total.start();
+
+        for (int i = 0; i < lines.count(); i++)
+        {
+            // Waiting is not part of the latency, but it is part of the total time
+            if (realtime)
+            {
+                waitUntil(total, trace.timestamps[i] - trace.timestamps[0]);
+                answerPings(server);
+            }
+
+            QByteArray data = lines[i] + "\r\n";
+            quint64 expected = client->bytesReceived() + data.length();
+
+            line.start();
+            server->write(data);
+            server->flush();
+            // The client reads while waiting, so Communi and the client process the line right here
+            while (client->bytesReceived() < expected)
+            {
+                if (!client->socket()->waitForReadyRead(REPLAY_SOCKET_TIMEOUT))
+                {
+                    timeouts++;
+                    break;
+                }
+            }
+#if QT_VERSION >= 0x040800
+            latencies.append(line.nsecsElapsed());
+#else
+            latencies.append(line.elapsed() * 1000000);
+#endif
+
+            if (!realtime && i % REPLAY_EVENT_LOOP_INTERVAL == 0)
+            {
+                app->processEvents();
+                answerPings(server);
+            }
+        }
+
+        app->processEvents();
+#if QT_VERSION >= 0x040800
+        totalNsecs += total.nsecsElapsed();
+#else
+        totalNsecs += total.elapsed() * 1000000;
+#endif
+        received += client->linesReceived() - startLines;
+        allocated += allocations() - startAllocations;
+
+        model->disconnectFromServers();
+        // The server model deletes the client later too, and processEvents() doesn't delete either
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+        QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+        delete server;
+        delete serverSettings;
+    }
+
+    int messages = lines.count() * iterations;
+    qSort(latencies);
+
+    printf("trace: %s\n", qPrintable(trace.name));
+    printf("  messages: %d, received by the client: %llu, timeouts: %d, iterations: %d%s\n", messages, (unsigned long long) received, timeouts, iterations, realtime ? ", realtime" : "");
+    printf("  messages/sec: %.0f\n", totalNsecs > 0 ? received * 1e9 / totalNsecs : 0.0);
+    printf("  latency us: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+           percentile(latencies, 50) / 1000.0, percentile(latencies, 90) / 1000.0,
+           percentile(latencies, 99) / 1000.0, (latencies.isEmpty() ? 0 : latencies.last()) / 1000.0);
+    printf("  " REPLAY_ALLOCATIONS_LABEL ": %.1f\n", received ? (double) allocated / received : 0.0);
+    printf("  peak rss kB: %ld\n", peakRssKilobytes());
+    foreach (const QString &line, StallWatchdog::instance()->report().split('\n'))
+        printf("  %s\n", qPrintable(line.trimmed()));
+    fflush(stdout);
+}
+
+// Decodes the raw lines of the trace, returns the nanoseconds it took
+static qint64 decodeLines(const QList<QByteArray> &lines, int iterations, bool detectEveryLine, EncodingDetector *detector)
+{
+    int characters = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        // Every iteration starts with an empty cache, as a new connection would
+        *detector = EncodingDetector();
+        foreach (const QByteArray &line, lines)
+        {
+            if (detectEveryLine)
+                characters += EncodingDetector::detect(line)->toUnicode(line).length();
+            else
+                characters += detector->decode(line).length();
+        }
+    }
+
+#if QT_VERSION >= 0x040800
+    qint64 nsecs = timer.nsecsElapsed();
+#else
+    qint64 nsecs = timer.elapsed() * 1000000;
+#endif
+    // Keeps the compiler from optimizing the decoding away
+    if (characters < 0)
+        printf("%d\n", characters);
+    return nsecs;
+}
+
+static void decodeTrace(const ReplayTrace &trace, int iterations)
+{
+    qint64 bytes = 0;
+    int kinds[3] = { 0, 0, 0 };
+    foreach (const QByteArray &line, trace.rawLines)
+    {
+        bytes += line.length() + 2;
+        kinds[EncodingDetector::classify(line.constData(), line.length())]++;
+    }
+
+    EncodingDetector detector;
+    qint64 everyLineNsecs = decodeLines(trace.rawLines, iterations, true, &detector);
+    qint64 fastPathNsecs = decodeLines(trace.rawLines, iterations, false, &detector);
+    int lines = trace.rawLines.count() * iterations;
+    bytes *= iterations;
+
+    // The encoding is chosen for every read, as the client does, the mixed ones keep the previous one
+    EncodingDetector chunkDetector;
+    QByteArray data;
+    foreach (const QByteArray &line, trace.rawLines)
+        data += line + "\r\n";
+    int chunks = 0;
+    for (int position = 0; position < data.length(); position += REPLAY_DECODE_CHUNK_SIZE, chunks++)
+        chunkDetector.codecNameForData(data.mid(position, REPLAY_DECODE_CHUNK_SIZE));
+
+    printf("trace: %s\n", qPrintable(trace.name));
+    printf("  lines: %d ascii, %d utf-8, %d legacy, iterations: %d\n", kinds[EncodingDetector::Ascii], kinds[EncodingDetector::Utf8], kinds[EncodingDetector::Legacy], iterations);
+    printf("  detecting every line: %.0f lines/sec, %.1f MB/sec\n",
+           everyLineNsecs > 0 ? lines * 1e9 / everyLineNsecs : 0.0, everyLineNsecs > 0 ? bytes * 1e3 / everyLineNsecs : 0.0);
+    printf("  fast path: %.0f lines/sec, %.1f MB/sec, %llu detections, %llu cache hits in the last iteration\n",
+           fastPathNsecs > 0 ? lines * 1e9 / fastPathNsecs : 0.0, fastPathNsecs > 0 ? bytes * 1e3 / fastPathNsecs : 0.0,
+           (unsigned long long) detector.detections(), (unsigned long long) detector.cacheHits());
+    printf("  reads of %d bytes: %d, needing more than one legacy encoding: %llu\n",
+           REPLAY_DECODE_CHUNK_SIZE, chunks, (unsigned long long) chunkDetector.mixedChunks());
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+#if QT_VERSION >= 0x050000
+    // Nothing is shown, but the settings need a GUI application for the fonts
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+#else
+    QApplication app(argc, argv, false);
+#endif
+
+    // Keeping away from the settings of the real application
+    QCoreApplication::setApplicationName("irc-chatter-replay");
+    QCoreApplication::setOrganizationName("irc-chatter");
+
+    int iterations = 1;
+    bool realtime = false;
+    bool decode = false;
+    QStringList traces;
+    foreach (const QString &arg, app.arguments().mid(1))
+    {
+        if (arg.startsWith("--iterations="))
+            iterations = qMax(1, arg.mid(13).toInt());
+        else if (arg == "--realtime")
+            realtime = true;
+        else if (arg == "--decode")
+            decode = true;
+        else
+            traces.append(arg);
+    }
+
+    if (traces.isEmpty())
+    {
+        fprintf(stderr, "usage: %s [--iterations=N] [--realtime] [--decode] trace.irc|capture.ircap...\n", argv[0]);
+        return 1;
+    }
+
+    AppSettings *appSettings = new AppSettings(&app);
+    IrcModel *model = new IrcModel(&app, appSettings);
+    StallWatchdog::instance()->start();
+
+    foreach (const QString &path, traces)
+    {
+        QList<ReplayTrace> replayTraces = readTrace(path);
+        if (replayTraces.isEmpty())
+            fprintf(stderr, "could not read any lines from %s\n", qPrintable(path));
+
+        foreach (const ReplayTrace &trace, replayTraces)
+        {
+            if (decode)
+                decodeTrace(trace, iterations);
+            else
+                replayTrace(&app, model, appSettings, trace, iterations, realtime);
+        }
+    }
+
+    return 0;
+}